@@ -24,6 +24,7 @@
  * THE SOFTWARE.
  */
 #include <cctype>
+#include <algorithm>
 
 #include <graphene/app/api.hpp>
 #include <graphene/app/api_access.hpp>
@@ -36,6 +37,7 @@
 #include <graphene/chain/transaction_object.hpp>
 #include <graphene/chain/withdraw_permission_object.hpp>
 #include <graphene/seeding/seeding_utility.hpp>
+#include <graphene/account_history/account_history_plugin.hpp>
 
 
 #include <fc/crypto/hex.hpp>
@@ -162,8 +164,9 @@ namespace graphene { namespace app {
 
     void network_broadcast_api::broadcast_block( const signed_block& b )
     {
-       _app.chain_database()->push_block(b, 0, false);
-       _app.p2p_node()->broadcast( net::block_message( b ));
+       const validated_block block( b );
+       _app.chain_database()->push_block(block, 0, false);
+       _app.p2p_node()->broadcast( net::block_message( block ));
     }
 
     void network_broadcast_api::broadcast_transaction_with_callback(confirmation_callback cb, const signed_transaction& trx)
@@ -418,25 +421,8 @@ namespace graphene { namespace app {
                                                                        operation_history_id_type start ) const
     {
        FC_ASSERT( _app.chain_database() );
-       const auto& db = *_app.chain_database();       
-       FC_ASSERT( limit <= 100 );
-       vector<operation_history_object> result;
-       const auto& stats = account(db).statistics(db);
-       if( stats.most_recent_op == account_transaction_history_id_type() ) return result;
-       const account_transaction_history_object* node = &stats.most_recent_op(db);
-       if( start == operation_history_id_type() )
-          start = node->operation_id;
-          
-       while(node && node->operation_id.instance.value > stop.instance.value && result.size() < limit)
-       {
-          if( node->operation_id.instance.value <= start.instance.value )
-             result.push_back( node->operation_id(db) );
-          if( node->next == account_transaction_history_id_type() )
-             node = nullptr;
-          else node = &node->next(db);
-       }
-       
-       return result;
+       auto plugin = _app.get_plugin<account_history::account_history_plugin>( "account_history" );
+       return plugin->get_account_history( account, stop, limit, start );
     }
     
     vector<operation_history_object> history_api::get_relative_account_history( account_id_type account, 
@@ -445,26 +431,8 @@ namespace graphene { namespace app {
                                                                                 uint32_t start) const
     {
        FC_ASSERT( _app.chain_database() );
-       const auto& db = *_app.chain_database();
-       FC_ASSERT(limit <= 100);
-       vector<operation_history_object> result;
-       if( start == 0 )
-         start = account(db).statistics(db).total_ops;
-       else start = min( account(db).statistics(db).total_ops, start );
-       const auto& hist_idx = db.get_index_type<account_transaction_history_index>();
-       const auto& by_seq_idx = hist_idx.indices().get<by_seq>();
-       
-       auto itr = by_seq_idx.upper_bound( boost::make_tuple( account, start ) );
-       auto itr_stop = by_seq_idx.lower_bound( boost::make_tuple( account, stop ) );
-       --itr;
-       
-       while ( itr != itr_stop && result.size() < limit )
-       {
-          result.push_back( itr->operation_id(db) );
-          --itr;
-       }
-       
-       return result;
+       auto plugin = _app.get_plugin<account_history::account_history_plugin>( "account_history" );
+       return plugin->get_relative_account_history( account, stop, limit, start );
     }
     
     crypto_api::crypto_api(){};
@@ -541,74 +509,78 @@ namespace graphene { namespace app {
     {
     }
 
+    namespace {
+       /** copies the messages of [first, last) from the newest one on, up to max_count of them in total */
+       template<typename Iterator, typename GetMessage>
+       void collect_newest_messages( Iterator first, Iterator last, uint32_t max_count, GetMessage&& get_message, vector<message_object>& result )
+       {
+          // max_count comes from the client, only reserve what the range actually holds
+          size_t matching = 0;
+          for( Iterator itr = last; itr != first && result.size() + matching < max_count; ++matching )
+             --itr;
+          result.reserve( result.size() + matching );
+
+          while( last != first && result.size() < max_count )
+          {
+             --last;
+             result.push_back( get_message( *last ) );
+          }
+       }
+    }
+
     vector<message_object> messaging_api::get_message_objects(optional<account_id_type> sender, optional<account_id_type> receiver, uint32_t max_count) const
+    {
+       vector<message_object> result = get_message_objects_before( sender, receiver, optional<object_id_type>(), max_count );
+       std::reverse( result.begin(), result.end() );
+       return result;
+    }
+
+    vector<message_object> messaging_api::get_message_objects_before(optional<account_id_type> sender, optional<account_id_type> receiver, optional<object_id_type> start, uint32_t max_count) const
     {
        FC_ASSERT(_app.chain_database());
        const auto& db = *_app.chain_database();
+       const auto& idx = db.get_index_type<message_index>();
+       const auto& messages_by_id = idx.indices().get<by_id>();
        vector<message_object> result;
 
-       if (receiver) {
-        
-          const auto& idx = db.get_index_type<message_index>();
+       // the page ends right before the start message
+       fc::time_point_sec start_created;
+       if( start ) {
+          auto itr = messages_by_id.find( *start );
+          FC_ASSERT( itr != messages_by_id.end(), "Message ${id} does not exist", ("id", *start) );
+          start_created = itr->created;
+       }
+
+       if( receiver ) {
           const auto& aidx = dynamic_cast<const primary_index<message_index>&>(idx);
           const auto& refs = aidx.get_secondary_index<graphene::chain::message_receiver_index>();
-          auto itr = refs.message_to_receiver_memberships.find(*receiver);
-
-          if (itr != refs.message_to_receiver_memberships.end())
-          {
-             result.reserve(itr->second.size());
-             int count = itr->second.size();
-             int counter = 0;
-             if (sender) {
-                for (const object_id_type& item : itr->second) {
-                   if (result.size() >= max_count)
-                      break;
-                   auto msg_itr = db.get_index_type<message_index>().indices().get<by_id>().find(item);
-                   if (msg_itr != db.get_index_type<message_index>().indices().get<by_id>().end()) {
-                      message_object o = *msg_itr;
-                      if (count - counter <= max_count && (*msg_itr).sender == *sender)
-                        result.emplace_back(o);
-                      counter++;
-                   }
-                }
-             }
-             else
-             {
-                for (const object_id_type& item : itr->second) {
-                   if (result.size() >= max_count)
-                      break;
-                   auto msg_itr = db.get_index_type<message_index>().indices().get<by_id>().find(item);
-                   if (msg_itr != db.get_index_type<message_index>().indices().get<by_id>().end()) {
-                      message_object o = *msg_itr;
-                      if (count - counter <= max_count)
-                        result.emplace_back(o);
-                      counter++;
-                   }
-                }
-             }
+          auto get_message = [&]( const message_receiver_index::entry& e ) -> const message_object& {
+             return *messages_by_id.find( e.message );
+          };
+
+          if( sender ) {
+             const auto& entries = refs.entries().get<by_receiver_sender>();
+             auto first = entries.lower_bound( boost::make_tuple( *receiver, *sender ) );
+             auto last = start ? entries.lower_bound( boost::make_tuple( *receiver, *sender, start_created, *start ) )
+                               : entries.upper_bound( boost::make_tuple( *receiver, *sender ) );
+             collect_newest_messages( first, last, max_count, get_message, result );
           }
-       }
-       else 
-       if(sender) {
-          const auto& range = db.get_index_type<message_index>().indices().get<by_sender>().equal_range(*sender);
-          const auto& index_by_sender = db.get_index_type<message_index>().indices().get<by_sender>();
-          auto itr = index_by_sender.lower_bound(*sender);
-          itr = range.first;
-
-          int count = distance(range.first, range.second);
-          if (count) {
-             result.reserve(count);
-             int counter = 0;
-            
-             while (itr != range.second && result.size() < max_count) {
-               if (count - counter <= max_count)
-                  result.emplace_back(*itr);
-               itr++;
-               counter++;
-             }
+          else {
+             const auto& entries = refs.entries().get<by_receiver>();
+             auto first = entries.lower_bound( boost::make_tuple( *receiver ) );
+             auto last = start ? entries.lower_bound( boost::make_tuple( *receiver, start_created, *start ) )
+                               : entries.upper_bound( boost::make_tuple( *receiver ) );
+             collect_newest_messages( first, last, max_count, get_message, result );
           }
        }
-       
+       else if( sender ) {
+          const auto& messages = idx.indices().get<by_sender>();
+          auto first = messages.lower_bound( boost::make_tuple( *sender ) );
+          auto last = start ? messages.lower_bound( boost::make_tuple( *sender, start_created, *start ) )
+                            : messages.upper_bound( boost::make_tuple( *sender ) );
+          collect_newest_messages( first, last, max_count, []( const message_object& m ) -> const message_object& { return m; }, result );
+       }
+
        return result;
     }
 } } // graphene::app
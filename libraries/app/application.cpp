@@ -59,6 +59,7 @@
 
 #include <boost/range/adaptor/reversed.hpp>
 #include <decent/package/package_config.hpp>
+#include <decent/encrypt/custodyutils.hpp>
 
 namespace graphene { namespace app {
 using net::item_hash_t;
@@ -70,6 +71,8 @@ using net::trx_message;
 using chain::block_header;
 using chain::signed_block_header;
 using chain::signed_block;
+using chain::validated_block;
+using chain::validated_block_ptr;
 using chain::block_id_type;
 
 using std::vector;
@@ -350,10 +353,30 @@ namespace detail {
 
          _chain_db->add_checkpoints( loaded_checkpoints );
 
+         if( _options->count("force-validate") )
+         {
+            ilog( "All transaction signatures will be validated" );
+            _force_validate = true;
+         }
+
+         const uint32_t state_checkpoint_interval = _options->count("state-checkpoint-interval") ?
+                                                    _options->at("state-checkpoint-interval").as<uint32_t>() : 0;
+         _chain_db->set_state_checkpoint_interval( state_checkpoint_interval );
+
+         if( _options->count("custody-cache-capacity") )
+            decent::encrypt::CustodyUtils::instance().set_cache_capacity( _options->at("custody-cache-capacity").as<uint32_t>() );
+
+         // with --force-validate the blockchain is also replayed with full validation
+         const uint32_t replay_skip = _force_validate ? database::skip_nothing : database::replay_skip_flags;
+         auto reindex = [&]()
+         {
+            _chain_db->reindex(_data_dir / "blockchain", initial_state(), replay_skip);
+         };
+
          if( _options->count("replay-blockchain") )
          {
             ilog("Replaying blockchain on user request.");
-            _chain_db->reindex(_data_dir/"blockchain", initial_state());
+            reindex();
          } else if( clean ) {
 
             auto is_new = [&]() -> bool
@@ -395,7 +418,7 @@ namespace detail {
             {
                ilog("Replaying blockchain due to ${reason}", ("reason", reindex_reason) );
 
-               _chain_db->reindex(_data_dir / "blockchain", initial_state());
+               reindex();
 
                // doing this down here helps ensure that DB will be wiped
                // if any of the above steps were interrupted on a previous run
@@ -411,7 +434,8 @@ namespace detail {
             }
          } else {
             wlog("Detected unclean shutdown. Replaying blockchain...");
-            _chain_db->reindex(_data_dir / "blockchain", initial_state());
+            if( !_chain_db->replay_from_checkpoint(_data_dir / "blockchain", replay_skip) )
+               reindex();
          }
 
          if (!_options->count("genesis-json") &&
@@ -421,15 +445,10 @@ namespace detail {
             _chain_db.reset();
             _chain_db = std::make_shared<chain::database>();
             _chain_db->add_checkpoints(loaded_checkpoints);
+            _chain_db->set_state_checkpoint_interval( state_checkpoint_interval );
             _chain_db->open(_data_dir / "blockchain", initial_state);
          }
 
-         if( _options->count("force-validate") )
-         {
-            ilog( "All transaction signatures will be validated" );
-            _force_validate = true;
-         }
-
          graphene::time::now();
 
          if( _options->count("api-access") )
@@ -489,6 +508,33 @@ namespace detail {
          FC_CAPTURE_AND_RETHROW( (id) )
       }
 
+      /**
+       * @brief starts recovering the miner's key of a sync block while the blocks before it are applied
+       */
+      virtual void prefetch_block( const graphene::net::block_message& blk_msg ) override
+      {
+         const uint32_t head_block_num = _chain_db->head_block_num();
+         drop_prefetched_blocks( head_block_num );
+         if( blk_msg.block.block_num() <= head_block_num )
+            return;
+         // blocks which are never handled are dropped only when the chain passes them, so don't let them pile up
+         if( _prefetched_blocks.size() >= 16 * GRAPHENE_SIGNATURE_LOOKAHEAD_BLOCKS )
+            return;
+         validated_block_ptr block = std::make_shared<const validated_block>( blk_msg.block );
+         _prefetched_blocks[ block->id() ] = block;
+         _chain_db->precompute_block_signee( block );
+      }
+
+      /**
+       * @brief forgets the prefetched blocks up to @p block_num, duplicates and forks the chain has passed are never handled
+       */
+      void drop_prefetched_blocks( uint32_t block_num )
+      {
+         // block ids start with the block number, so the map is ordered by it
+         while( !_prefetched_blocks.empty() && block_header::num_from_id( _prefetched_blocks.begin()->first ) <= block_num )
+            _prefetched_blocks.erase( _prefetched_blocks.begin() );
+      }
+
       /**
        * @brief allows the application to validate an item prior to broadcasting to peers.
        *
@@ -501,6 +547,17 @@ namespace detail {
                                 std::vector<fc::uint160_t>& contained_transaction_message_ids) override
       { try {
 
+         validated_block_ptr block;
+         auto prefetched = _prefetched_blocks.find( blk_msg.block_id );
+         if( prefetched != _prefetched_blocks.end() )
+         {
+            block = prefetched->second;
+            // block ids start with the block number, so this also drops the blocks of abandoned forks
+            _prefetched_blocks.erase( _prefetched_blocks.begin(), ++prefetched );
+         }
+         else
+            block = std::make_shared<const validated_block>( blk_msg.block );
+
          auto latency = graphene::time::now() - blk_msg.block.timestamp;
          if (!sync_mode || blk_msg.block.block_num() % 10000 == 0)
          {
@@ -520,10 +577,11 @@ namespace detail {
             // you can help the network code out by throwing a block_older_than_undo_history exception.
             // when the net code sees that, it will stop trying to push blocks from that chain, but
             // leave that peer connected so that they can get sync blocks from us
-            bool result = _chain_db->push_block(blk_msg.block,
+            bool result = _chain_db->push_block(*block,
                                                 (_is_block_producer | _force_validate) ? database::skip_nothing
                                                                                        : database::skip_transaction_signatures,
                                                 sync_mode);
+            drop_prefetched_blocks( _chain_db->head_block_num() );
 
             // the block was accepted, so we now know all of the transactions contained in the block
             if (!sync_mode)
@@ -912,6 +970,8 @@ namespace detail {
       api_access _apiaccess;
 
       std::shared_ptr<graphene::chain::database>            _chain_db;
+      /// sync blocks passed to prefetch_block(), handle_block() pushes the same objects so nothing is hashed twice
+      std::map<block_id_type, validated_block_ptr>          _prefetched_blocks;
       std::shared_ptr<graphene::net::node>                  _p2p_network;
       std::shared_ptr<fc::http::websocket_server>      _websocket_server;
       std::shared_ptr<fc::http::websocket_tls_server>  _websocket_tls_server;
@@ -950,6 +1010,9 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("seed-node,s", bpo::value<vector<string>>()->composing(), "P2P nodes to connect to on startup (may specify multiple times)")
 
          ("checkpoint,c", bpo::value<vector<string>>()->composing(), "Pairs of [BLOCK_NUM,BLOCK_ID] that should be enforced as checkpoints.")
+         ("state-checkpoint-interval", bpo::value<uint32_t>()->default_value(0), "Save the chain state every this many irreversible blocks, so that an unclean shutdown only replays the blocks after it. "
+                                                                                  "Saving blocks the node for a while, 0 disables it")
+         ("custody-cache-capacity", bpo::value<uint32_t>()->default_value(DECENT_CUSTODY_CACHE_CAPACITY), "Number of contents whose proof of custody tables are kept in memory, each takes about 50kB per sector (0 disables)")
          ("rpc-endpoint", bpo::value<string>()->default_value("127.0.0.1:8090"), "Endpoint for websocket RPC to listen on")
          ("rpc-tls-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8089"), "Endpoint for TLS websocket RPC to listen on")
          ("enable-permessage-deflate", "Enable support for per-message deflate compression in the websocket servers "
@@ -1035,6 +1098,11 @@ std::shared_ptr<chain::database> application::chain_database() const
    return my->_chain_db;
 }
 
+const fc::path& application::data_dir() const
+{
+   return my->_data_dir;
+}
+
 void application::set_block_production(bool producing_blocks)
 {
    my->_is_block_producer = producing_blocks;
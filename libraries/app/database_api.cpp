@@ -44,6 +44,7 @@
 #include <cctype>
 
 #include <cfenv>
+#include <mutex>
 #include <iostream>
 #include "json.hpp"
 
@@ -77,6 +78,178 @@ namespace {
 namespace graphene { namespace app {
 
    class database_api_impl;
+
+   /**
+    *  The objects changed or removed by one notification of the database, shared by all API sessions.
+    *  Whatever a session needs is built by the first session asking for it, so each changed object is
+    *  converted to a variant once per notification however many sessions are subscribed.
+    */
+   class object_change_set
+   {
+   public:
+      object_change_set( const graphene::chain::database& db, vector<object_id_type> ids )
+      : _db(db), _ids(std::move(ids)) {}
+
+      /** @return array of the changed objects, or of just their ids for objects that no longer exist */
+      std::shared_ptr<const fc::variant> updates()const
+      {
+         if( !_updates )
+         {
+            fc::time_point start = fc::time_point::now();
+            fc::variants result;
+            result.reserve( _ids.size() );
+            for( const object_id_type& id : _ids )
+            {
+               const object* obj = _db.find_object( id );
+               if( obj )
+                  result.emplace_back( obj->to_variant() );
+               else
+                  result.emplace_back( id ); // send just the id to indicate removal
+            }
+            _updates = std::make_shared<const fc::variant>( std::move( result ) );
+            dlog( "serialized ${n} changed objects for subscribers in ${t} us",
+                  ("n", _ids.size())("t", (fc::time_point::now() - start).count()) );
+         }
+         return _updates;
+      }
+
+      /** @return array of the removed objects' ids */
+      std::shared_ptr<const fc::variant> removed_ids()const
+      {
+         if( !_updates )
+         {
+            fc::variants result;
+            result.reserve( _ids.size() );
+            for( const object_id_type& id : _ids )
+               result.emplace_back( id );
+            _updates = std::make_shared<const fc::variant>( std::move( result ) );
+         }
+         return _updates;
+      }
+
+      /** @return URIs of the changed content objects */
+      const vector<string>& content_uris()const
+      {
+         if( !_content_uris )
+         {
+            _content_uris = vector<string>();
+            for( const object_id_type& id : _ids )
+            {
+               if( id.space() != content_object::space_id || id.type() != content_object::type_id )
+                  continue;
+               const object* obj = _db.find_object( id );
+               if( obj )
+                  _content_uris->push_back( static_cast<const content_object*>( obj )->URI );
+            }
+         }
+         return *_content_uris;
+      }
+
+      bool empty()const { return _ids.empty(); }
+
+   private:
+      const graphene::chain::database&                    _db;
+      vector<object_id_type>                              _ids;
+      mutable std::shared_ptr<const fc::variant>          _updates;
+      mutable optional<vector<string>>                    _content_uris;
+   };
+
+   /**
+    *  Captures the changes reported by the database signals into an object_change_set before the sessions'
+    *  own handlers run, so they all see the same one.  One instance exists per database for as long as
+    *  sessions use it.
+    */
+   class object_change_notifier
+   {
+   public:
+      /** the group the sessions connect their handlers to, so that the notifier can tell when all of them are done */
+      static const int session_group = 0;
+
+      static std::shared_ptr<object_change_notifier> get( graphene::chain::database& db )
+      {
+         std::lock_guard<std::mutex> guard( notifiers_mutex() );
+         std::weak_ptr<object_change_notifier>& entry = notifiers()[&db];
+         std::shared_ptr<object_change_notifier> result = entry.lock();
+         if( !result )
+         {
+            result.reset( new object_change_notifier( db ) );
+            result->_self = result;
+            entry = result;
+         }
+         return result;
+      }
+
+      const std::shared_ptr<const object_change_set>& changed()const { return _changed; }
+      const std::shared_ptr<const object_change_set>& removed()const { return _removed; }
+
+   private:
+      explicit object_change_notifier( graphene::chain::database& db )
+      {
+         // at_front makes these run before the handlers of any session
+         _change_connection = db.changed_objects.connect( [this,&db]( const vector<object_id_type>& ids ) {
+            _changed = std::make_shared<const object_change_set>( db, ids );
+            _dispatch_start = fc::time_point::now();
+         }, boost::signals2::at_front );
+         _removed_connection = db.removed_objects.connect( [this,&db]( const vector<const object*>& objs ) {
+            vector<object_id_type> ids;
+            ids.reserve( objs.size() );
+            for( const object* obj : objs )
+               ids.push_back( obj->id );
+            _removed = std::make_shared<const object_change_set>( db, std::move( ids ) );
+            _dispatch_start = fc::time_point::now();
+         }, boost::signals2::at_front );
+
+         // the group after the sessions' one runs once every session has handled the set
+         _changed_done_connection = db.changed_objects.connect( session_group + 1, [this]( const vector<object_id_type>& ids ) {
+            dispatched( "changed", ids.size() );
+         } );
+         _removed_done_connection = db.removed_objects.connect( session_group + 1, [this]( const vector<const object*>& objs ) {
+            dispatched( "removed", objs.size() );
+         } );
+      }
+
+      /** reports the time all sessions spent on one notification and drops the notifiers nobody uses anymore */
+      void dispatched( const char* kind, size_t objects )
+      {
+         // every session owns one reference
+         const long sessions = _self.use_count();
+         dlog( "notified ${s} sessions of ${n} ${k} objects in ${t} us",
+               ("s", sessions)("n", objects)("k", kind)("t", (fc::time_point::now() - _dispatch_start).count()) );
+
+         std::lock_guard<std::mutex> guard( notifiers_mutex() );
+         auto& all = notifiers();
+         for( auto itr = all.begin(); itr != all.end(); )
+         {
+            if( itr->second.expired() )
+               itr = all.erase( itr );
+            else
+               ++itr;
+         }
+      }
+
+      static std::mutex& notifiers_mutex()
+      {
+         static std::mutex m;
+         return m;
+      }
+
+      static std::map<const graphene::chain::database*, std::weak_ptr<object_change_notifier>>& notifiers()
+      {
+         static std::map<const graphene::chain::database*, std::weak_ptr<object_change_notifier>> m;
+         return m;
+      }
+
+      std::weak_ptr<object_change_notifier>    _self;
+      std::shared_ptr<const object_change_set> _changed;
+      std::shared_ptr<const object_change_set> _removed;
+      fc::time_point                           _dispatch_start;
+      boost::signals2::scoped_connection       _change_connection;
+      boost::signals2::scoped_connection       _removed_connection;
+      boost::signals2::scoped_connection       _changed_done_connection;
+      boost::signals2::scoped_connection       _removed_done_connection;
+   };
+
+   const int object_change_notifier::session_group;
    
    
    class database_api_impl : public std::enable_shared_from_this<database_api_impl>
@@ -98,6 +271,7 @@ namespace graphene { namespace app {
       // Blocks and transactions
       optional<block_header> get_block_header(uint32_t block_num)const;
       optional<signed_block> get_block(uint32_t block_num)const;
+      vector<vector<char>> get_blocks(uint32_t start, uint32_t count)const;
       processed_transaction get_transaction( uint32_t block_num, uint32_t trx_in_block )const;
       fc::time_point_sec head_block_time()const;
       miner_reward_input get_time_to_maint_by_block_time(fc::time_point_sec block_time) const;
@@ -221,11 +395,11 @@ namespace graphene { namespace app {
          return _subscribe_filter.contains( i );
       }
       
-      void broadcast_updates( const vector<variant>& updates );
+      void broadcast_updates( const std::shared_ptr<const fc::variant>& updates );
       
       /** called every time a block is applied to report the objects that were changed */
-      void on_objects_changed(const vector<object_id_type>& ids);
-      void on_objects_removed(const vector<const object*>& objs);
+      void on_objects_changed();
+      void on_objects_removed();
       void on_applied_block();
       
       mutable fc::bloom_filter                               _subscribe_filter;
@@ -239,6 +413,7 @@ namespace graphene { namespace app {
       boost::signals2::scoped_connection                                                                                           _pending_trx_connection;
       map< string, std::function<void()> >                              _content_subscriptions;
       graphene::chain::database&                                                                                                   _db;
+      std::shared_ptr<object_change_notifier>                                                                                      _change_notifier;
    };
    
    //////////////////////////////////////////////////////////////////////
@@ -252,14 +427,14 @@ namespace graphene { namespace app {
    
    database_api::~database_api() {}
    
-   database_api_impl::database_api_impl( graphene::chain::database& db ):_db(db)
+   database_api_impl::database_api_impl( graphene::chain::database& db ):_db(db), _change_notifier(object_change_notifier::get(db))
    {
       wlog("creating database api ${x}", ("x",int64_t(this)) );
-      _change_connection = _db.changed_objects.connect([this](const vector<object_id_type>& ids) {
-         on_objects_changed(ids);
+      _change_connection = _db.changed_objects.connect(object_change_notifier::session_group, [this](const vector<object_id_type>&) {
+         on_objects_changed();
       });
-      _removed_connection = _db.removed_objects.connect([this](const vector<const object*>& objs) {
-         on_objects_removed(objs);
+      _removed_connection = _db.removed_objects.connect(object_change_notifier::session_group, [this](const vector<const object*>&) {
+         on_objects_removed();
       });
       _applied_block_connection = _db.applied_block.connect([this](const signed_block&){ on_applied_block(); });
       
@@ -408,6 +583,17 @@ namespace graphene { namespace app {
    {
       return _db.fetch_block_by_number(block_num);
    }
+
+   vector<vector<char>> database_api::get_blocks(uint32_t start, uint32_t count)const
+   {
+      return my->get_blocks( start, count );
+   }
+
+   vector<vector<char>> database_api_impl::get_blocks(uint32_t start, uint32_t count)const
+   {
+      FC_ASSERT( count <= 100 );
+      return _db.fetch_packed_blocks( start, count );
+   }
    
    processed_transaction database_api::get_transaction( uint32_t block_num, uint32_t trx_in_block )const
    {
@@ -2050,6 +2236,57 @@ namespace
    
    namespace {
       
+      /**
+       * @param term lowercased search term
+       * @return true if the content passes all search_content filters, it is then filled into @ref content
+       */
+      bool search_content_filter(graphene::chain::database& db,
+                                 const content_object& co,
+                                 const string& term,
+                                 const string& user,
+                                 const string& region_code,
+                                 const ContentObjectTypeValue& filter_type,
+                                 content_summary& content)
+      {
+         const auto& idx_account = db.get_index_type<account_index>().indices().get<by_id>();
+         const auto account_itr = idx_account.find(co.author);
+         if ( false == user.empty() )
+         {
+            if ( account_itr->name != user )
+               return false;
+         }
+
+         if (false == co.price.Valid(region_code))
+         {
+            // this is going to be possible if a content object does not have
+            // a price defined for this region
+            // we allow such objects be placed in db index anyway, but simply skip those
+            // during enumeration
+            return false;
+         }
+
+         if ( user.empty() && false == co.recent_proof(60*60*24)  )
+            return false;
+
+         if ( co.is_blocked ) // Content can be cancelled by an author. In such a case content is not available to purchase.
+            return false;
+
+         content.set( co , *account_itr, region_code );
+         if (content.expiration <= fc::time_point::now())
+            return false;
+
+         std::string author = content.author;
+         boost::algorithm::to_lower(author);
+
+         if (false == term.empty() &&
+             author.find(term) == std::string::npos &&
+             co.title_lowercase.find(term) == std::string::npos &&
+             co.description_lowercase.find(term) == std::string::npos)
+            return false;
+
+         return co.type.filter(filter_type);
+      }
+
       template <bool is_ascending, class sort_tag>
       void search_content_template(graphene::chain::database& db,
                                    const string& search_term,
@@ -2061,93 +2298,92 @@ namespace
                                    vector<content_summary>& result)
       {
          const auto& idx_by_sort_tag = db.get_index_type<content_index>().indices().get<sort_tag>();
-         
-         auto itr_begin = return_one<is_ascending>::choose(idx_by_sort_tag.cbegin(), idx_by_sort_tag.crbegin());
-         auto itr_end = return_one<is_ascending>::choose(idx_by_sort_tag.cend(), idx_by_sort_tag.crend());
-
-         correct_iterator<content_index, content_object, sort_tag, decltype(itr_begin), is_ascending>(db, id, itr_begin);
 
          content_summary content;
-         const auto& idx_account = db.get_index_type<account_index>().indices().get<by_id>();
-
          ContentObjectTypeValue filter_type;
          filter_type.from_string(type);
-         
-         while(count && itr_begin != itr_end)
+
+         std::string term = search_term;
+         boost::algorithm::to_lower(term);
+
+         const auto& pidx = dynamic_cast<const primary_index<content_index>&>(db.get_index_type<content_index>());
+         const auto& search_idx = pidx.get_secondary_index<content_search_index>();
+         optional< vector<content_id_type> > candidates = search_idx.find_candidates(term);
+
+         const auto& idx_by_id = db.get_index_type<content_index>().indices().get<by_id>();
+         vector<const content_object*> objects;
+         bool narrowed = false;
+         if (candidates.valid())
          {
-            const auto account_itr = idx_account.find(itr_begin->author);
-            if ( false == user.empty() )
+            narrowed = true;
+            objects.reserve(candidates->size());
+            for (const content_id_type& candidate : *candidates)
             {
-               if ( account_itr->name != user )
-               {
-                  ++itr_begin;
-                  continue;
-               }
+               auto itr = idx_by_id.find(candidate);
+               if (itr != idx_by_id.end())
+                  objects.push_back(&*itr);
             }
+         }
+         else if (filter_type.type.size() > 1)
+         {
+            // a specific type, not just the application, is a range of the type index
+            const auto& idx_by_type = db.get_index_type<content_index>().indices().get<by_type>();
+            for (auto itr = idx_by_type.lower_bound(boost::make_tuple(filter_type.type));
+                 itr != idx_by_type.end() && itr->type.filter(filter_type);
+                 ++itr)
+               objects.push_back(&*itr);
+            narrowed = true;
+         }
 
-            if (false == itr_begin->price.Valid(region_code))
+         if (narrowed)
+         {
+            // only the objects which may match are checked, in the order of the sort index
+            // with equal keys ordered by id
+            const auto& key = idx_by_sort_tag.key_extractor();
+            const auto& comp = idx_by_sort_tag.key_comp();
+            auto ascending_less = [&](const content_object* a, const content_object* b)
             {
-               // this is going to be possible if a content object does not have
-               // a price defined for this region
-               // we allow such objects be placed in db index anyway, but simply skip those
-               // during enumeration
-               ++itr_begin;
-               continue;
-            }
-
-            if ( user.empty() && false == itr_begin->recent_proof(60*60*24)  )
+               if (comp(key(*a), key(*b)))
+                  return true;
+               if (comp(key(*b), key(*a)))
+                  return false;
+               return a->id < b->id;
+            };
+            auto before = [&](const content_object* a, const content_object* b)
             {
-               ++itr_begin;
-               continue;
-            }
+               return is_ascending ? ascending_less(a, b) : ascending_less(b, a);
+            };
+            std::sort(objects.begin(), objects.end(), before);
 
-            if ( itr_begin->is_blocked ) // Content can be cancelled by an author. In such a case content is not available to purchase.
-            {
-               ++itr_begin;
-               continue;
-            }
+            auto itr_begin = objects.begin();
+            auto itr_id = idx_by_id.find(id);
+            if (itr_id != idx_by_id.end())
+               itr_begin = std::lower_bound(objects.begin(), objects.end(), &*itr_id, before);
 
-            content.set( *itr_begin , *account_itr, region_code );
-            if (content.expiration > fc::time_point::now())
+            for (; count && itr_begin != objects.end(); ++itr_begin)
             {
-               std::string term = search_term;
-               std::string title = content.synopsis;
-               std::string desc = "";
-               std::string author = content.author;
-               ContentObjectTypeValue content_type;
-
-
-               try {
-                  ContentObjectPropertyManager synopsis_parser(content.synopsis);
-                  title = synopsis_parser.get<ContentObjectTitle>();
-                  desc = synopsis_parser.get<ContentObjectDescription>();
-                  content_type = synopsis_parser.get<ContentObjectType>();
-               } catch (...) {}
-               
-               boost::algorithm::to_lower(term);
-               boost::algorithm::to_lower(title);
-               boost::algorithm::to_lower(desc);
-               boost::algorithm::to_lower(author);
-
-               if (false == term.empty() &&
-                   author.find(term) == std::string::npos &&
-                   title.find(term) == std::string::npos &&
-                   desc.find(term) == std::string::npos)
+               if (search_content_filter(db, **itr_begin, term, user, region_code, filter_type, content))
                {
-                  ++itr_begin;
-                  continue;
+                  count--;
+                  result.push_back( content );
                }
+            }
+            return;
+         }
 
-               if (false == content_type.filter(filter_type))
-               {
-                  ++itr_begin;
-                  continue;
-               }
+         auto itr_begin = return_one<is_ascending>::choose(idx_by_sort_tag.cbegin(), idx_by_sort_tag.crbegin());
+         auto itr_end = return_one<is_ascending>::choose(idx_by_sort_tag.cend(), idx_by_sort_tag.crend());
+
+         correct_iterator<content_index, content_object, sort_tag, decltype(itr_begin), is_ascending>(db, id, itr_begin);
 
+         while(count && itr_begin != itr_end)
+         {
+            if (search_content_filter(db, *itr_begin, term, user, region_code, filter_type, content))
+            {
                count--;
                result.push_back( content );
             }
-            
+
             ++itr_begin;
          }
          
@@ -2352,63 +2588,38 @@ namespace
    //                                                                  //
    //////////////////////////////////////////////////////////////////////
    
-   void database_api_impl::broadcast_updates( const vector<variant>& updates )
+   void database_api_impl::broadcast_updates( const std::shared_ptr<const fc::variant>& updates )
    {
-      if( updates.size() ) {
-         auto capture_this = shared_from_this();
-         fc::async([capture_this,updates](){
-            capture_this->_subscribe_callback( fc::variant(updates) );
-         });
-      }
+      auto capture_this = shared_from_this();
+      fc::async([capture_this,updates](){
+         capture_this->_subscribe_callback( *updates );
+      });
    }
    
-   void database_api_impl::on_objects_removed( const vector<const object*>& objs )
+   void database_api_impl::on_objects_removed()
    {
       /// we need to ensure the database_api is not deleted for the life of the async operation
-      if( _subscribe_callback )
-      {
-         vector<variant>    updates;
-         updates.reserve(objs.size());
-         
-         for( auto obj : objs )
-            updates.emplace_back( obj->id );
-         broadcast_updates( updates );
-      }
-
+      const std::shared_ptr<const object_change_set>& removed = _change_notifier->removed();
+      if( _subscribe_callback && !removed->empty() )
+         broadcast_updates( removed->removed_ids() );
    }
    
-   void database_api_impl::on_objects_changed(const vector<object_id_type>& ids)
+   void database_api_impl::on_objects_changed()
    {
-      vector<variant>    updates;
+      const std::shared_ptr<const object_change_set>& changed = _change_notifier->changed();
+      std::shared_ptr<const fc::variant> updates;
       vector< string > content_update_queue;
-      
-      for(auto id : ids)
-      {
-         const object* obj = nullptr;
-         if( _subscribe_callback )
-         {
-            obj = _db.find_object( id );
-            if( obj )
-            {
-               updates.emplace_back( obj->to_variant() );
-            }
-            else
-            {
-               updates.emplace_back(id); // send just the id to indicate removal
-            }
-         }
 
-         if( _content_subscriptions.size() )
-         {
-            if( !_subscribe_callback )
-               obj = _db.find_object( id );
-            if( obj )
-            {
-               const content_object* content = dynamic_cast<const content_object*>(obj);
-               if(content && _content_subscriptions[ content->URI ] )
-                  content_update_queue.emplace_back( content->URI );
-            }
+      if( _subscribe_callback )
+         updates = changed->updates();
 
+      if( _content_subscriptions.size() )
+      {
+         for( const string& URI : changed->content_uris() )
+         {
+            auto itr = _content_subscriptions.find( URI );
+            if( itr != _content_subscriptions.end() && itr->second )
+               content_update_queue.emplace_back( URI );
          }
       }
       
@@ -2418,7 +2629,7 @@ namespace
       /// if a connection hangs then this could get backed up and result in
       /// a failure to exit cleanly.
       fc::async([capture_this,this,updates, content_update_queue](){
-         if( _subscribe_callback ) _subscribe_callback( updates );
+         if( _subscribe_callback ) _subscribe_callback( updates ? *updates : fc::variant( fc::variants() ) );
          
          for( const auto& item: content_update_queue )
          {
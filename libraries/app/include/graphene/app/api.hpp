@@ -376,6 +376,17 @@ namespace graphene { namespace app {
        * @ingroup MessagingAPI
        */
       vector<message_object> get_message_objects(optional<account_id_type> sender, optional<account_id_type> receiver, uint32_t max_count) const;
+
+      /**
+       * @brief Receives message objects by sender and/or receiver page by page, from the newest message on.
+       * @param sender name of message sender. If you dont want to filter by sender then let it empty
+       * @param receiver name of message receiver. If you dont want to filter by receiver then let it empty
+       * @param start id of the last message of the previous page. If empty, the newest messages are returned
+       * @param max_count maximal number of messages to be returned
+       * @return a vector of message objects older than the start one, the newest first
+       * @ingroup MessagingAPI
+       */
+      vector<message_object> get_message_objects_before(optional<account_id_type> sender, optional<account_id_type> receiver, optional<object_id_type> start, uint32_t max_count) const;
    private:
       application& _app;
    };
@@ -498,6 +509,7 @@ FC_API(graphene::app::crypto_api,
      )
 FC_API(graphene::app::messaging_api,
       (get_message_objects)
+      (get_message_objects_before)
      )
 FC_API(graphene::app::login_api,
        (login)
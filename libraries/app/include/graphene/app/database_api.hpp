@@ -219,6 +219,15 @@ namespace graphene { namespace app {
           */
          optional<signed_block> get_block(uint32_t block_num)const;
 
+         /**
+          * @brief Retrieve a range of blocks in their binary form, as stored by the node.
+          * @param start height of the first block to be returned
+          * @param count maximum number of blocks to be returned, up to 100
+          * @return the packed blocks in order, ending early at the first block the node doesn't have
+          * @ingroup DatabaseAPI_BlockTx
+          */
+         vector<vector<char>> get_blocks(uint32_t start, uint32_t count)const;
+
          /**
           * @brief Used to fetch an individual transaction.
           * @param block_num id of the block
@@ -900,6 +909,7 @@ FC_API(graphene::app::database_api,
           // Blocks and transactions
           (get_block_header)
           (get_block)
+          (get_blocks)
           (get_transaction)
           (head_block_time)
           (get_recent_transaction_by_id)
@@ -39,21 +39,56 @@ FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(block_id) );
 
 namespace graphene { namespace chain {
 
+block_database::mapped_file::mapped_file( const fc::path& file, uint64_t size )
+   : mapping( file.generic_string().c_str(), fc::read_only ),
+     region( mapping, fc::read_only, 0, size ),
+     data( (const char*)region.get_address() ),
+     size( size )
+{
+}
+
+block_database::mapped_file_ptr block_database::map_file( mapped_file_ptr& current, const fc::path& file, uint64_t min_size )const
+{
+   auto result = std::atomic_load( &current );
+   if( result && min_size && result->size >= min_size )
+      return result;
+
+   std::lock_guard<std::mutex> guard( _map_mutex );
+   result = std::atomic_load( &current );
+   if( result && min_size && result->size >= min_size )
+      return result;
+
+   uint64_t file_size = fc::file_size( file );
+   if( file_size == 0 || file_size < min_size )
+      return mapped_file_ptr();
+   if( result && result->size == file_size )
+      return result;
+
+   result = std::make_shared<const mapped_file>( file, file_size );
+   std::atomic_store( &current, result );
+   return result;
+}
+
 void block_database::open( const fc::path& dbdir )
 { try {
    fc::create_directories(dbdir);
    _block_num_to_pos.exceptions(std::ios_base::failbit | std::ios_base::badbit);
    _blocks.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 
-   if( !fc::exists( dbdir/"index" ) )
+   _index_path = dbdir/"index";
+   _blocks_path = dbdir/"blocks";
+   std::atomic_store( &_index_map, mapped_file_ptr() );
+   std::atomic_store( &_blocks_map, mapped_file_ptr() );
+
+   if( !fc::exists( _index_path ) )
    {
-     _block_num_to_pos.open( (dbdir/"index").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
+     _block_num_to_pos.open( _index_path.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
+     _blocks.open( _blocks_path.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
    }
    else
    {
-     _block_num_to_pos.open( (dbdir/"index").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+     _block_num_to_pos.open( _index_path.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+     _blocks.open( _blocks_path.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
    }
 } FC_CAPTURE_AND_RETHROW( (dbdir) ) }
 
@@ -64,6 +99,8 @@ bool block_database::is_open()const
 
 void block_database::close()
 {
+  std::atomic_store( &_index_map, mapped_file_ptr() );
+  std::atomic_store( &_blocks_map, mapped_file_ptr() );
   _blocks.close();
   _block_num_to_pos.close();
 }
@@ -82,34 +119,47 @@ void block_database::store( const block_id_type& _id, const signed_block& b )
       id = b.id();
       elog( "id argument of block_database::store() was not initialized for block ${id}", ("id", id) );
    }
+   store_packed( id, fc::raw::pack( b ) );
+}
+
+void block_database::store( const validated_block& b )
+{
+   store_packed( b.id(), b.packed() );
+}
+
+void block_database::store_packed( const block_id_type& id, const vector<char>& packed )
+{
    auto num = block_header::num_from_id(id);
    _block_num_to_pos.seekp( sizeof( index_entry ) * num );
    index_entry e;
    _blocks.seekp( 0, _blocks.end );
-   auto vec = fc::raw::pack( b );
    e.block_pos  = _blocks.tellp();
-   e.block_size = vec.size();
+   e.block_size = packed.size();
    e.block_id   = id;
-   _blocks.write( vec.data(), vec.size() );
+   _blocks.write( packed.data(), packed.size() );
    _block_num_to_pos.write( (char*)&e, sizeof(e) );
+
+   // readers see the files through the mappings, the block has to be in the file before its index entry
+   _blocks.flush();
+   _block_num_to_pos.flush();
 }
 
 void block_database::remove( const block_id_type& id )
 { try {
    index_entry e;
    auto index_pos = sizeof(e)*block_header::num_from_id(id);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   auto index = map_index( index_pos + sizeof(e) );
+   if ( !index )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block ${id} not contained in block database", ("id", id));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
+   memcpy( (char*)&e, index->data + index_pos, sizeof(e) );
 
    if( e.block_id == id )
    {
       e.block_size = 0;
       _block_num_to_pos.seekp( sizeof(e)*block_header::num_from_id(id) );
       _block_num_to_pos.write( (char*)&e, sizeof(e) );
+      _block_num_to_pos.flush();
    }
 } FC_CAPTURE_AND_RETHROW( (id) ) }
 
@@ -120,11 +170,10 @@ bool block_database::contains( const block_id_type& id )const
 
    index_entry e;
    auto index_pos = sizeof(e)*block_header::num_from_id(id);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   auto index = map_index( index_pos + sizeof(e) );
+   if ( !index )
       return false;
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
+   memcpy( (char*)&e, index->data + index_pos, sizeof(e) );
 
    return e.block_id == id && e.block_size > 0;
 }
@@ -134,12 +183,11 @@ block_id_type block_database::fetch_block_id( uint32_t block_num )const
    assert( block_num != 0 );
    index_entry e;
    auto index_pos = sizeof(e)*block_num;
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= int64_t(index_pos) )
+   auto index = map_index( index_pos + sizeof(e) );
+   if ( !index )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block number ${block_num} not contained in block database", ("block_num", block_num));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
+   memcpy( (char*)&e, index->data + index_pos, sizeof(e) );
 
    FC_ASSERT( e.block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
    return e.block_id;
@@ -151,20 +199,19 @@ optional<signed_block> block_database::fetch_optional( const block_id_type& id )
    {
       index_entry e;
       auto index_pos = sizeof(e)*block_header::num_from_id(id);
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
+      auto index = map_index( index_pos + sizeof(e) );
+      if ( !index )
          return {};
 
-      _block_num_to_pos.seekg( index_pos );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
+      memcpy( (char*)&e, index->data + index_pos, sizeof(e) );
 
       if( e.block_id != id ) return optional<signed_block>();
 
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      if (e.block_size)
-         _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
+      auto blocks = map_blocks( e.block_pos + e.block_size );
+      FC_ASSERT( blocks && e.block_size );
+      fc::datastream<const char*> ds( blocks->data + e.block_pos, e.block_size );
+      signed_block result;
+      fc::raw::unpack( ds, result );
       FC_ASSERT( result.id() == e.block_id );
       return result;
    }
@@ -183,17 +230,17 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
    {
       index_entry e;
       auto index_pos = sizeof(e)*block_num;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
+      auto index = map_index( index_pos + sizeof(e) );
+      if ( !index )
          return {};
 
-      _block_num_to_pos.seekg( index_pos, _block_num_to_pos.beg );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
+      memcpy( (char*)&e, index->data + index_pos, sizeof(e) );
 
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
+      auto blocks = map_blocks( e.block_pos + e.block_size );
+      FC_ASSERT( blocks && e.block_size );
+      fc::datastream<const char*> ds( blocks->data + e.block_pos, e.block_size );
+      signed_block result;
+      fc::raw::unpack( ds, result );
       FC_ASSERT( result.id() == e.block_id );
       return result;
    }
@@ -206,33 +253,64 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
    return optional<signed_block>();
 }
 
+vector<vector<char>> block_database::fetch_packed_range( uint32_t first_block_num, uint32_t count )const
+{
+   vector<vector<char>> result;
+   if( first_block_num == 0 || count == 0 )
+      return result;
+
+   const uint64_t first_pos = sizeof(index_entry) * uint64_t(first_block_num);
+   auto index = map_index( 0 );
+   if( !index || index->size < first_pos + sizeof(index_entry) )
+      return result;
+
+   const uint64_t available = (index->size - first_pos) / sizeof(index_entry);
+   result.reserve( std::min<uint64_t>( count, available ) );
+   mapped_file_ptr blocks;
+   for( uint64_t i = 0; i < count && i < available; ++i )
+   {
+      index_entry e;
+      memcpy( (char*)&e, index->data + first_pos + i * sizeof(e), sizeof(e) );
+      if( e.block_size == 0 )
+         break;
+      if( !blocks || blocks->size < e.block_pos + e.block_size )
+      {
+         blocks = map_blocks( e.block_pos + e.block_size );
+         if( !blocks )
+            break;
+      }
+      const char* data = blocks->data + e.block_pos;
+      result.emplace_back( data, data + e.block_size );
+   }
+   return result;
+}
+
 optional<signed_block> block_database::last()const
 {
    try
    {
       index_entry e;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
+      auto index = map_index( 0 );
 
-      if( _block_num_to_pos.tellp() < sizeof(index_entry) )
+      if( !index || index->size < sizeof(index_entry) )
          return optional<signed_block>();
 
-      _block_num_to_pos.seekg( -sizeof(index_entry), _block_num_to_pos.end );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      uint64_t pos = _block_num_to_pos.tellg();
+      uint64_t pos = index->size - index->size % sizeof(index_entry) - sizeof(index_entry);
+      memcpy( (char*)&e, index->data + pos, sizeof(e) );
       while( e.block_size == 0 && pos > 0 )
       {
          pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
+         memcpy( (char*)&e, index->data + pos, sizeof(e) );
       }
 
       if( e.block_size == 0 )
          return optional<signed_block>();
 
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
+      auto blocks = map_blocks( e.block_pos + e.block_size );
+      FC_ASSERT( blocks );
+      fc::datastream<const char*> ds( blocks->data + e.block_pos, e.block_size );
+      signed_block result;
+      fc::raw::unpack( ds, result );
       return result;
    }
    catch (const fc::exception&)
@@ -249,19 +327,17 @@ optional<block_id_type> block_database::last_id()const
    try
    {
       index_entry e;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
+      auto index = map_index( 0 );
 
-      if( _block_num_to_pos.tellp() < sizeof(index_entry) )
+      if( !index || index->size < sizeof(index_entry) )
          return optional<block_id_type>();
 
-      _block_num_to_pos.seekg( -sizeof(index_entry), _block_num_to_pos.end );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      uint64_t pos = _block_num_to_pos.tellg();
+      uint64_t pos = index->size - index->size % sizeof(index_entry) - sizeof(index_entry);
+      memcpy( (char*)&e, index->data + pos, sizeof(e) );
       while( e.block_size == 0 && pos > 0 )
       {
          pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
+         memcpy( (char*)&e, index->data + pos, sizeof(e) );
       }
 
       if( e.block_size == 0 )
@@ -3,6 +3,11 @@
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/database.hpp>
 
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <functional>
+
 namespace graphene { namespace chain {
 
    map<uint32_t, string> RegionCodes::s_mapCodeToName;
@@ -97,4 +102,124 @@ namespace graphene { namespace chain {
       return set(co, ao, it->second);
    }
 
+   void content_object::set_synopsis( const string& str_synopsis )
+   {
+      // the title falls back to the whole synopsis if it can't be parsed
+      synopsis = str_synopsis;
+      title_lowercase = synopsis;
+      description_lowercase.clear();
+      type = ContentObjectTypeValue();
+      try {
+         ContentObjectPropertyManager synopsis_parser(synopsis);
+         title_lowercase = synopsis_parser.get<ContentObjectTitle>();
+         description_lowercase = synopsis_parser.get<ContentObjectDescription>();
+         type = synopsis_parser.get<ContentObjectType>();
+      } catch (...) {}
+
+      boost::algorithm::to_lower(title_lowercase);
+      boost::algorithm::to_lower(description_lowercase);
+   }
+
+   namespace {
+
+      void add_trigrams( string text, vector<uint32_t>& trigrams )
+      {
+         boost::algorithm::to_lower( text );
+         for( size_t i = 0; i + 3 <= text.size(); ++i )
+            trigrams.push_back( uint32_t(uint8_t(text[i])) << 16 | uint32_t(uint8_t(text[i + 1])) << 8 | uint8_t(text[i + 2]) );
+      }
+
+      size_t searched_text_hash( const content_object& co )
+      {
+         return std::hash<string>()( co.title_lowercase + '\n' + co.description_lowercase );
+      }
+
+   }
+
+   void content_search_index::add( const content_object& co )
+   {
+      entry& e = _entries[co.id];
+      e.author = co.author;
+      e.text_hash = searched_text_hash( co );
+      e.trigrams.clear();
+      add_trigrams( co.title_lowercase, e.trigrams );
+      add_trigrams( co.description_lowercase, e.trigrams );
+      add_trigrams( co.author(_db).name, e.trigrams );
+      std::sort( e.trigrams.begin(), e.trigrams.end() );
+      e.trigrams.erase( std::unique( e.trigrams.begin(), e.trigrams.end() ), e.trigrams.end() );
+
+      for( uint32_t trigram : e.trigrams )
+         _postings[trigram].insert( co.id );
+   }
+
+   void content_search_index::remove( content_id_type id )
+   {
+      auto itr = _entries.find( id );
+      if( itr == _entries.end() )
+         return;
+      for( uint32_t trigram : itr->second.trigrams )
+      {
+         auto posting = _postings.find( trigram );
+         posting->second.erase( id );
+         if( posting->second.empty() )
+            _postings.erase( posting );
+      }
+      _entries.erase( itr );
+   }
+
+   void content_search_index::object_inserted( const object& obj )
+   {
+      assert( dynamic_cast<const content_object*>(&obj) ); // for debug only
+      add( static_cast<const content_object&>(obj) );
+   }
+
+   void content_search_index::object_removed( const object& obj )
+   {
+      remove( obj.id );
+   }
+
+   void content_search_index::object_modified( const object& after )
+   {
+      assert( dynamic_cast<const content_object*>(&after) ); // for debug only
+      const content_object& co = static_cast<const content_object&>(after);
+      // most modifications are proofs, ratings and purchases, which leave the searched fields alone
+      auto itr = _entries.find( co.id );
+      if( itr != _entries.end() && itr->second.author == co.author && itr->second.text_hash == searched_text_hash( co ) )
+         return;
+      remove( co.id );
+      add( co );
+   }
+
+   optional< vector<content_id_type> > content_search_index::find_candidates( const string& term )const
+   {
+      if( term.size() < 3 )
+         return optional< vector<content_id_type> >();
+
+      vector<uint32_t> trigrams;
+      add_trigrams( term, trigrams );
+      std::sort( trigrams.begin(), trigrams.end() );
+      trigrams.erase( std::unique( trigrams.begin(), trigrams.end() ), trigrams.end() );
+
+      vector< const flat_set<content_id_type>* > postings;
+      for( uint32_t trigram : trigrams )
+      {
+         auto itr = _postings.find( trigram );
+         if( itr == _postings.end() )
+            return vector<content_id_type>();
+         postings.push_back( &itr->second );
+      }
+      std::sort( postings.begin(), postings.end(),
+                 []( const flat_set<content_id_type>* a, const flat_set<content_id_type>* b ) { return a->size() < b->size(); } );
+
+      vector<content_id_type> result( postings.front()->begin(), postings.front()->end() );
+      for( size_t i = 1; i < postings.size() && !result.empty(); ++i )
+      {
+         const auto& posting = *postings[i];
+         result.erase( std::remove_if( result.begin(), result.end(),
+                                       [&posting]( const content_id_type& id ) { return posting.find( id ) == posting.end(); } ),
+                       result.end() );
+      }
+      return result;
+   }
+
 }}
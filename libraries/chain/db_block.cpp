@@ -39,12 +39,34 @@
 
 #include <fc/smart_ref_impl.hpp>
 
+#include <thread>
+
 namespace graphene { namespace chain {
 
 bool database::is_known_block( const block_id_type& id )const
 {
    return _fork_db.is_known_block(id) || _block_id_to_block.contains(id);
 }
+
+void database::precompute_block_signee( const validated_block_ptr& b )
+{
+   const block_id_type& id = b->id();
+   if( b->block_num() <= head_block_num() || _precomputed_signees.count( id ) )
+      return;
+   // blocks which are never applied are dropped only when a later block is, so don't let them pile up
+   if( _precomputed_signees.size() >= 16 * GRAPHENE_SIGNATURE_LOOKAHEAD_BLOCKS )
+      return;
+
+   if( _signature_threads.empty() )
+   {
+      const size_t thread_count = std::max( 1u, std::thread::hardware_concurrency() );
+      for( size_t i = 0; i < thread_count; ++i )
+         _signature_threads.emplace_back( new fc::thread( "signature_" + std::to_string( i ) ) );
+   }
+
+   fc::thread* worker = _signature_threads[ _next_signature_thread++ % _signature_threads.size() ].get();
+   _precomputed_signees[ id ] = worker->async( [b]() { return b->signee(); }, "recover_block_signee" );
+}
 /**
  * Only return true *if* the transaction has not expired or been invalidated. If this
  * method is called with a VERY old transaction we will return false, they should
@@ -79,6 +101,11 @@ optional<signed_block> database::fetch_block_by_number( uint32_t num )const
    return optional<signed_block>();
 }
 
+vector<vector<char>> database::fetch_packed_blocks( uint32_t first_block_num, uint32_t count )const
+{
+   return _block_id_to_block.fetch_packed_range( first_block_num, count );
+}
+
 const signed_transaction& database::get_recent_transaction(const transaction_id_type& trx_id) const
 {
    auto& index = get_index_type<transaction_index>().indices().get<by_trx_id>();
@@ -112,21 +139,33 @@ std::vector<block_id_type> database::get_block_ids_on_fork(block_id_type head_of
  * @return true if we switched forks as a result of this push.
  */
 bool database::push_block(const signed_block &new_block, uint32_t skip, bool sync_mode)
+{
+   return push_block( validated_block( new_block ), skip, sync_mode );
+}
+
+bool database::push_block(const validated_block &new_block, uint32_t skip, bool sync_mode)
 {
    //idump((new_block.block_num())(new_block.id())(new_block.timestamp)(new_block.previous));
    bool result;
    detail::with_skip_flags( *this, skip, [&]()
    {
       detail::without_pending_transactions( *this, std::move(_pending_tx),
-      [&]()
+      [&]( optional< flat_set<object_id_type> >& changed_objects )
       {
+         const block_id_type previous_head = head_block_id();
          result = _push_block( new_block, sync_mode );
+         // the changes are known unless we switched forks
+         if( head_block_id() == previous_head )
+            changed_objects = flat_set<object_id_type>();
+         else if( !result && head_block_id() == new_block.id() && _undo_db.enabled() )
+            changed_objects = get_head_undo_changes();
+         check_state_checkpoint();
       });
    });
    return result;
 }
 
-bool database::_push_block(const signed_block &new_block, bool sync_mode)
+bool database::_push_block(const validated_block &new_block, bool sync_mode)
 { try {
    uint32_t skip = get_node_properties().skip_flags;
    if( !(skip&skip_fork_db) )
@@ -156,8 +195,9 @@ bool database::_push_block(const signed_block &new_block, bool sync_mode)
                 optional<fc::exception> except;
                 try {
                    undo_database::session session = _undo_db.start_undo_session();
-                   apply_block( (*ritr)->data, skip );
-                   _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
+                   const validated_block fork_block( (*ritr)->data, (*ritr)->id );
+                   apply_block( fork_block, skip );
+                   _block_id_to_block.store( fork_block );
                    session.commit();
                 }
                 catch ( const fc::exception& e ) { except = e; }
@@ -180,8 +220,9 @@ bool database::_push_block(const signed_block &new_block, bool sync_mode)
                    for( auto ritr = branches.second.rbegin(); ritr != branches.second.rend(); ++ritr )
                    {
                       auto session = _undo_db.start_undo_session();
-                      apply_block( (*ritr)->data, skip );
-                      _block_id_to_block.store( new_block.id(), (*ritr)->data );
+                      const validated_block good_block( (*ritr)->data, (*ritr)->id );
+                      apply_block( good_block, skip );
+                      _block_id_to_block.store( good_block );
                       session.commit();
                    }
                    throw *except;
@@ -196,7 +237,7 @@ bool database::_push_block(const signed_block &new_block, bool sync_mode)
    try {
       auto session = _undo_db.start_undo_session();
       apply_block(new_block, skip);
-      _block_id_to_block.store(new_block.id(), new_block);
+      _block_id_to_block.store(new_block);
       session.commit();
       //we will notify after session commit, since we want to be sure that seeding plugin works and generated tx will refer to commited block_objects
 
@@ -208,7 +249,7 @@ bool database::_push_block(const signed_block &new_block, bool sync_mode)
    auto session = _undo_db.start_undo_session();
    try {
 
-      for( const auto &trx : new_block.transactions ) {
+      for( const auto &trx : new_block.block().transactions ) {
          for( const auto &op : trx.operations ) {
             operation_history_object oh(op);
             oh.block_num = new_block.block_num();
@@ -229,7 +270,7 @@ bool database::_push_block(const signed_block &new_block, bool sync_mode)
       elog("Failed to notify listeners on commited operation:\n${e}", ("e", e.to_detail_string()));
    }
    return false;
-} FC_CAPTURE_AND_RETHROW( (new_block) ) }
+} FC_CAPTURE_AND_RETHROW( (new_block.block()) ) }
 
 /**
  * Attempts to push the transaction into the pending queue
@@ -257,6 +298,11 @@ processed_transaction database::push_transaction( const signed_transaction& trx,
 } FC_CAPTURE_AND_RETHROW( (trx) ) }
 
 processed_transaction database::_push_transaction( const signed_transaction& trx )
+{
+   return _push_transaction( trx, trx.id() );
+}
+
+processed_transaction database::_push_transaction( const signed_transaction& trx, const transaction_id_type& trx_id )
 {
    // If this is the first transaction pushed after applying a block, start a new undo session.
    // This allows us to quickly rewind to the clean state of the head block, in case a new block arrives.
@@ -269,8 +315,8 @@ processed_transaction database::_push_transaction( const signed_transaction& trx
    // apply the changes.
 
    auto temp_session = _undo_db.start_undo_session();
-   auto processed_trx = _apply_transaction( trx );
-   _pending_tx.push_back(processed_trx);
+   auto processed_trx = _apply_transaction( trx, trx_id );
+   _pending_tx.push( processed_trx, trx_id, get_head_undo_changes() );
 
    notify_changed_objects();
    // The transaction applied successfully. Merge its changes into the pending block session.
@@ -348,69 +394,47 @@ signed_block database::_generate_block(
 
    static const size_t max_block_header_size = fc::raw::pack_size( signed_block_header() ) + 4;
    auto maximum_block_size = get_global_properties().parameters.maximum_block_size;
-   size_t total_block_size = max_block_header_size;
 
    signed_block pending_block;
 
    //
-   // The following code throws away existing pending_tx_session and
-   // rebuilds it by re-applying pending transactions.
+   // The pending transactions have been applied on top of the head block in order, and only a new head block
+   // changes the state they were applied to.  So the leading pending transactions which fit into the block are
+   // taken with their results as they are, instead of being applied again.  The block is validated by
+   // push_block() below, which also rebuilds the pending state from the remaining transactions.
    //
-   // This rebuild is necessary because pending transactions' validity
-   // and semantics may have changed since they were received, because
-   // time-based semantics are evaluated based on the current block
-   // time.  These changes can only be reflected in the database when
-   // the value of the "when" variable is known, which means we need to
-   // re-apply pending transactions in this method.
+   // Transactions are postponed from the first one which does not fit on, as the following ones may depend
+   // on it.
    //
-   _pending_tx_session.reset();
-   _pending_tx_session = _undo_db.start_undo_session();
-
-   uint64_t postponed_tx_count = 0;
-   // pop pending state (reset to head block state)
-   for( const processed_transaction& tx : _pending_tx )
+   if( !_pending_tx.empty() && !_pending_tx_session.valid() )
    {
-      size_t tx_size = fc::raw::pack_size( tx );
-      size_t new_total_size = total_block_size + tx_size;
-
-      // postpone transaction if it would make block too big
-      if( new_total_size >= maximum_block_size )
+      // pop_block() has thrown the pending state away, so the pending transactions have to be applied again
+      pending_transaction_pool pending = std::move( _pending_tx );
+      _pending_tx.clear();
+      for( const pending_transaction_pool::entry& tx : pending.entries() )
       {
-         postponed_tx_count++;
-         continue;
-      }
-
-      try
-      {
-         auto temp_session = _undo_db.start_undo_session();
-         processed_transaction ptx = _apply_transaction( tx );
-         temp_session.merge();
-
-         // We have to recompute pack_size(ptx) because it may be different
-         // than pack_size(tx) (i.e. if one or more results increased
-         // their size)
-         total_block_size += fc::raw::pack_size( ptx );
-         pending_block.transactions.push_back( ptx );
-      }
-      catch ( const fc::exception& e )
-      {
-         // Do nothing, transaction will not be re-applied
-         wlog( "Transaction was not processed while generating block due to ${e}", ("e", e) );
-         wlog( "The transaction was ${t}", ("t", tx) );
+         try
+         {
+            if( !is_known_transaction( tx.id ) )
+               _push_transaction( tx.trx, tx.id );
+         }
+         catch ( const fc::exception& e )
+         {
+            // Do nothing, transaction will not be re-applied
+            wlog( "Transaction was not processed while generating block due to ${e}", ("e", e) );
+            wlog( "The transaction was ${t}", ("t", tx.trx) );
+         }
       }
    }
-   if( postponed_tx_count > 0 )
+
+   const size_t tx_count = _pending_tx.fitting_prefix( maximum_block_size - max_block_header_size );
+   if( tx_count < _pending_tx.size() )
    {
-      wlog( "Postponed ${n} transactions due to block size limit", ("n", postponed_tx_count) );
+      wlog( "Postponed ${n} transactions due to block size limit", ("n", _pending_tx.size() - tx_count) );
    }
-
-   _pending_tx_session.reset();
-
-   // We have temporarily broken the invariant that
-   // _pending_tx_session is the result of applying _pending_tx, as
-   // _pending_tx now consists of the set of postponed transactions.
-   // However, the push_block() call below will re-create the
-   // _pending_tx_session.
+   pending_block.transactions.reserve( tx_count );
+   for( size_t i = 0; i < tx_count; ++i )
+      pending_block.transactions.push_back( _pending_tx.entries()[i].trx );
 
    pending_block.previous = head_block_id();
    pending_block.timestamp = when;
@@ -421,12 +445,13 @@ signed_block database::_generate_block(
       pending_block.sign( block_signing_private_key );
 
    // TODO:  Move this to _push_block() so session is restored.
+   const validated_block new_block( pending_block );
    if( !(skip & skip_block_size_check) )
    {
-      FC_ASSERT( fc::raw::pack_size(pending_block) <= get_global_properties().parameters.maximum_block_size );
+      FC_ASSERT( new_block.packed().size() <= get_global_properties().parameters.maximum_block_size );
    }
 
-   push_block( pending_block, skip );
+   push_block( new_block, skip );
 
    return pending_block;
 } FC_CAPTURE_AND_RETHROW( (miner_id) ) }
@@ -489,6 +514,11 @@ const vector<optional< operation_history_object > >& database::get_applied_opera
 //////////////////// private methods ////////////////////
 
 void database::apply_block( const signed_block& next_block, uint32_t skip )
+{
+   apply_block( validated_block( next_block ), skip );
+}
+
+void database::apply_block( const validated_block& next_block, uint32_t skip )
 {
    auto block_num = next_block.block_num();
    if( _checkpoints.size() && _checkpoints.rbegin()->second != block_id_type() )
@@ -508,15 +538,16 @@ void database::apply_block( const signed_block& next_block, uint32_t skip )
    return;
 }
 
-void database::_apply_block( const signed_block& next_block )
+void database::_apply_block( const validated_block& validated )
 { try {
-   uint32_t next_block_num = next_block.block_num();
+   const signed_block& next_block = validated.block();
+   uint32_t next_block_num = validated.block_num();
    uint32_t skip = get_node_properties().skip_flags;
    _applied_ops.clear();
 
-   FC_ASSERT( (skip & skip_merkle_check) || next_block.transaction_merkle_root == next_block.calculate_merkle_root(), "", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",next_block.calculate_merkle_root())("next_block",next_block)("id",next_block.id()) );
+   FC_ASSERT( (skip & skip_merkle_check) || next_block.transaction_merkle_root == validated.merkle_root(), "", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",validated.merkle_root())("next_block",next_block)("id",validated.id()) );
 
-   const miner_object& signing_miner = validate_block_header(skip, next_block);
+   const miner_object& signing_miner = validate_block_header(skip, validated);
    const auto& global_props = get_global_properties();
    const auto& dynamic_global_props = get<dynamic_global_property_object>(dynamic_global_property_id_type());
    bool maint_needed = (dynamic_global_props.next_maintenance_time <= next_block.timestamp)  ;
@@ -524,19 +555,28 @@ void database::_apply_block( const signed_block& next_block )
    _current_block_num    = next_block_num;
    _current_trx_in_block = 0;
 
-   for( const auto& trx : next_block.transactions )
+   if( !(skip & skip_validate) )
+      verify_custody_proofs( next_block );
+
+   const vector<transaction_id_type>& trx_ids = validated.transaction_ids();
+   detail::with_skip_flags( *this, skip | skip_transaction_signatures, [&]()
    {
-      /* We do not need to push the undo state for each transaction
-       * because they either all apply and are valid or the
-       * entire block fails to apply.  We only need an "undo" state
-       * for transactions when validating broadcast transactions or
-       * when building a block.
-       */
-      apply_transaction( trx, skip | skip_transaction_signatures );
-      ++_current_trx_in_block;
-   }
+      for( const auto& trx : next_block.transactions )
+      {
+         /* We do not need to push the undo state for each transaction
+          * because they either all apply and are valid or the
+          * entire block fails to apply.  We only need an "undo" state
+          * for transactions when validating broadcast transactions or
+          * when building a block.
+          */
+         _apply_transaction( trx, trx_ids[_current_trx_in_block] );
+         ++_current_trx_in_block;
+      }
+   });
 
-   update_global_dynamic_data(next_block);
+   _verified_custody_proofs.clear();
+
+   update_global_dynamic_data(validated);
    update_signing_miner(signing_miner, next_block);
    update_last_irreversible_block();
 
@@ -544,7 +584,7 @@ void database::_apply_block( const signed_block& next_block )
    if( maint_needed )
       perform_chain_maintenance(next_block, global_props);
 
-   create_block_summary(next_block);
+   create_block_summary(validated);
    clear_expired_transactions();
    clear_expired_proposals();
    update_expired_feeds();
@@ -568,6 +608,18 @@ void database::_apply_block( const signed_block& next_block )
    notify_changed_objects();
 } FC_CAPTURE_AND_RETHROW( (next_block.block_num()) )  }
 
+flat_set<object_id_type> database::get_head_undo_changes()const
+{
+   flat_set<object_id_type> result;
+   if( !_undo_db.enabled() || _undo_db.size() == 0 )
+      return result;
+   const auto& head_undo = _undo_db.head();
+   result.reserve( head_undo.old_values.size() + head_undo.removed.size() );
+   for( const auto& item : head_undo.old_values ) result.insert( item.first );
+   for( const auto& item : head_undo.removed ) result.insert( item.first );
+   return result;
+}
+
 void database::notify_changed_objects()
 { try {
    if( _undo_db.enabled() ) 
@@ -598,6 +650,11 @@ processed_transaction database::apply_transaction(const signed_transaction& trx,
 }
 
 processed_transaction database::_apply_transaction(const signed_transaction& trx)
+{
+   return _apply_transaction( trx, trx.id() );
+}
+
+processed_transaction database::_apply_transaction(const signed_transaction& trx, const transaction_id_type& trx_id)
 { try {
    uint32_t skip = get_node_properties().skip_flags;
 
@@ -606,7 +663,6 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
 
    auto& trx_idx = get_mutable_index_type<transaction_index>();
    const chain_id_type& chain_id = get_chain_id();
-   auto trx_id = trx.id();
    FC_ASSERT( (skip & skip_transaction_dupe_check) ||
               trx_idx.indices().get<by_trx_id>().find(trx_id) == trx_idx.indices().get<by_trx_id>().end() );
    transaction_evaluation_state eval_state(this);
@@ -685,14 +741,15 @@ operation_result database::apply_operation(transaction_evaluation_state& eval_st
    return result;
 } FC_CAPTURE_AND_RETHROW(  ) }
 
-const miner_object& database::validate_block_header( uint32_t skip, const signed_block& next_block )const
+const miner_object& database::validate_block_header( uint32_t skip, const validated_block& validated )const
 {
+   const signed_block& next_block = validated.block();
    FC_ASSERT( head_block_id() == next_block.previous, "", ("head_block_id",head_block_id())("next.prev",next_block.previous) );
    FC_ASSERT( head_block_time() < next_block.timestamp, "", ("head_block_time",head_block_time())("next",next_block.timestamp)("blocknum",next_block.block_num()) );
    const miner_object& miner = next_block.miner(*this);
 
    if( !(skip&skip_miner_signature) ) 
-      FC_ASSERT( next_block.validate_signee( miner.signing_key ) );
+      FC_ASSERT( get_block_signee( validated ) == miner.signing_key );
 
    if( !(skip&skip_miner_schedule_check) )
    {
@@ -708,7 +765,22 @@ const miner_object& database::validate_block_header( uint32_t skip, const signed
    return miner;
 }
 
-void database::create_block_summary(const signed_block& next_block)
+fc::ecc::public_key database::get_block_signee( const validated_block& next_block )const
+{
+   if( _precomputed_signees.empty() )
+      return next_block.signee();
+
+   auto itr = _precomputed_signees.find( next_block.id() );
+   if( itr == _precomputed_signees.end() )
+      return next_block.signee();
+
+   fc::future<fc::ecc::public_key> signee = itr->second;
+   // block ids start with the block number, so this also drops the blocks of abandoned forks
+   _precomputed_signees.erase( _precomputed_signees.begin(), ++itr );
+   return signee.wait();
+}
+
+void database::create_block_summary(const validated_block& next_block)
 {
    block_summary_id_type sid(next_block.block_num() & 0xffff );
    modify( sid(*this), [&](block_summary_object& p) {
@@ -35,11 +35,27 @@
 #include <graphene/chain/transaction_detail_object.hpp>
 #include <graphene/chain/vesting_balance_object.hpp>
 #include <graphene/chain/miner_object.hpp>
+#include <graphene/chain/real_supply_index.hpp>
+#include <graphene/chain/vote_tally_index.hpp>
+
+#include <decent/encrypt/custodyutils.hpp>
 
 #include <algorithm>
 
 namespace graphene { namespace chain {
 
+namespace {
+
+digest_type custody_proof_digest( const proof_of_custody_operation& o, const custody_data_type& cd )
+{
+   digest_type::encoder enc;
+   fc::raw::pack( enc, o );
+   fc::raw::pack( enc, cd );
+   return enc.result();
+}
+
+}
+
 void database::buying_expire(const buying_object& buying)
 {
    return_escrow_buying_operation rebop;
@@ -222,6 +238,10 @@ void database::decent_housekeeping()
 {
    set_and_reset_seeding_stats();
 
+   const decent::encrypt::CustodyUtils::CacheStats cache = decent::encrypt::CustodyUtils::instance().get_cache_stats();
+   dlog( "custody cache: ${s}/${c} entries, ${h} hits, ${m} misses",
+         ("s", cache.size)("c", cache.capacity)("h", cache.hits)("m", cache.misses) );
+
    const auto& cidx = get_index_type<content_index>().indices().get<by_expiration>();
    auto citr = cidx.lower_bound( get_dynamic_global_properties().last_budget_time + get_global_properties().parameters.block_interval );
    while( citr != cidx.end() && citr->expiration <= head_block_time() )
@@ -392,7 +412,27 @@ share_type database::get_miner_budget(uint32_t blocks_to_maint)
    return blocks_to_maint * get_new_asset_per_block();
 }
 
+namespace {
+   template<typename TotalIndex, typename IndexType>
+   share_type running_total( const database& db )
+   {
+      const auto& pidx = dynamic_cast<const primary_index<IndexType>&>( db.get_index_type<IndexType>() );
+      return pidx.template get_secondary_index<TotalIndex>().total();
+   }
+}
+
 real_supply database::get_real_supply()const
+{
+   real_supply total;
+   total.account_balances = running_total<account_balance_total_index, account_balance_index>( *this );
+   total.vesting_balances = running_total<vesting_balance_total_index, vesting_balance_index>( *this );
+   total.escrows = running_total<content_escrow_total_index, content_index>( *this )
+                 + running_total<buying_escrow_total_index, buying_index>( *this );
+   total.pools = running_total<core_pool_total_index, simple_index<asset_dynamic_data_object>>( *this );
+   return total;
+}
+
+real_supply database::scan_real_supply()const
 {
    //walk through account_balances, vesting_balances and escrows in content and buying objects
    real_supply total;
@@ -435,37 +475,64 @@ real_supply database::get_real_supply()const
 
 vector<database::votes_gained> database::get_actual_votes() const
 {
-   vector<uint64_t> vote_tally_buffer;
    vector<database::votes_gained> res;
-   const auto& props = get_global_properties();
-   vote_tally_buffer.resize(props.next_available_vote_id);
-   const auto& aidx = get_index_type<account_index>().indices().get<by_id>();
-   for( const auto& a : aidx ){
-      const account_object& opinion_account = (a.options.voting_account == GRAPHENE_PROXY_TO_SELF_ACCOUNT) ? a : get(a.options.voting_account);
-      const auto& stats = a.statistics(*this);
-      uint64_t voting_stake = stats.total_core_in_orders.value
-                              + (a.cashback_vb.valid() ? (*a.cashback_vb)(*this).balance.amount.value: 0)
-                              + get_balance(a.get_id(), asset_id_type()).amount.value;
-      for( vote_id_type id : opinion_account.options.votes )
-      {
-         uint32_t offset = id.instance();
-         // if they somehow managed to specify an illegal offset, ignore it.
-         if( offset < vote_tally_buffer.size() )
-            vote_tally_buffer[offset] += voting_stake;
-      }
-   }
+   const vote_tally_index& tally = get_vote_tally();
 
    const auto& all_miners = get_index_type<miner_index>().indices();
    for( const miner_object& wit : all_miners )
    {
       database::votes_gained vg;
-      vg.votes = vote_tally_buffer[wit.vote_id];
+      vg.votes = tally.votes( wit.vote_id.instance() ).value;
       vg.account_name = wit.miner_account(*this).name;
       res.push_back(vg);
    }
    std::sort(res.begin(), res.end(), [](database::votes_gained a, database::votes_gained b)-> bool{return a.votes > b.votes;});
    return res;
 }
+void database::verify_custody_proofs( const signed_block& next_block )
+{
+   _verified_custody_proofs.clear();
+
+   vector<custody_data_type> cds;
+   vector<custody_proof_type> proofs;
+   vector<digest_type> digests;
+   const auto& idx = get_index_type<content_index>().indices().get<by_URI>();
+
+   for( const auto& trx : next_block.transactions )
+   {
+      for( const auto& op : trx.operations )
+      {
+         if( op.which() != operation::tag<proof_of_custody_operation>::value )
+            continue;
+         const auto& poc = op.get<proof_of_custody_operation>();
+         if( !poc.proof.valid() )
+            continue;
+         const auto& content = idx.find( poc.URI );
+         if( content == idx.end() || !content->cd.valid() )
+            continue;
+         cds.push_back( *content->cd );
+         proofs.push_back( *poc.proof );
+         digests.push_back( custody_proof_digest( poc, *content->cd ) );
+      }
+   }
+
+   // nothing to gain for a single proof
+   if( proofs.size() < 2 )
+      return;
+
+   if( decent::encrypt::CustodyUtils::instance().verify_by_miner( cds, proofs ) == 0 )
+      _verified_custody_proofs.insert( digests.begin(), digests.end() );
+   else
+      wlog( "Batch verification of ${n} proofs of custody in block ${b} failed, verifying them one by one",
+            ("n", proofs.size())("b", next_block.block_num()) );
+}
+
+bool database::is_custody_proof_verified( const proof_of_custody_operation& o, const custody_data_type& cd )const
+{
+   if( _verified_custody_proofs.empty() )
+      return false;
+   return _verified_custody_proofs.find( custody_proof_digest( o, cd ) ) != _verified_custody_proofs.end();
+}
 
 }
 }
@@ -27,6 +27,7 @@
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/chain_property_object.hpp>
 #include <graphene/chain/global_property_object.hpp>
+#include <graphene/chain/vote_tally_index.hpp>
 
 #include <fc/smart_ref_impl.hpp>
 
@@ -57,6 +58,12 @@ const fee_schedule&  database::current_fee_schedule()const
    return get_global_properties().parameters.current_fees;
 }
 
+const vote_tally_index& database::get_vote_tally()const
+{
+   const auto& pidx = dynamic_cast<const primary_index<account_index>&>( get_index_type<account_index>() );
+   return pidx.get_secondary_index<vote_tally_index>();
+}
+
 time_point_sec database::head_block_time()const
 {
    return get( dynamic_global_property_id_type() ).time;
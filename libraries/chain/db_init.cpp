@@ -34,6 +34,8 @@
 #include <graphene/chain/global_property_object.hpp>
 #include <graphene/chain/operation_history_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
+#include <graphene/chain/real_supply_index.hpp>
+#include <graphene/chain/vote_tally_index.hpp>
 #include <graphene/chain/seeder_object.hpp>
 #include <graphene/chain/transaction_object.hpp>
 #include <graphene/chain/vesting_balance_object.hpp>
@@ -163,6 +165,7 @@ void database::initialize_indexes()
 
    auto acnt_index = add_index< primary_index<account_index> >();
    acnt_index->add_secondary_index<account_member_index>();
+   auto vote_tally = acnt_index->add_secondary_index<vote_tally_index>();
 
    add_index< primary_index<miner_index> >();
 
@@ -170,21 +173,30 @@ void database::initialize_indexes()
    prop_index->add_secondary_index<required_approval_index>();
 
    add_index< primary_index<withdraw_permission_index > >();
-   add_index< primary_index<vesting_balance_index> >();
+   auto vesting_idx = add_index< primary_index<vesting_balance_index> >();
+   vesting_idx->add_secondary_index<vesting_balance_total_index>();
+   vesting_idx->add_secondary_index< vote_tally_observer<vesting_balance_object> >( *vote_tally );
 
    //Implementation object indexes
    add_index< primary_index<transaction_index                             > >();
-   add_index< primary_index<account_balance_index                         > >();
+   auto balance_idx = add_index< primary_index<account_balance_index       > >();
+   balance_idx->add_secondary_index<account_balance_total_index>();
+   balance_idx->add_secondary_index< vote_tally_observer<account_balance_object> >( *vote_tally );
    add_index< primary_index<simple_index<global_property_object          >> >();
    add_index< primary_index<simple_index<dynamic_global_property_object  >> >();
-   add_index< primary_index<simple_index<account_statistics_object       >> >();
-   add_index< primary_index<simple_index<asset_dynamic_data_object       >> >();
+   auto stats_idx = add_index< primary_index<simple_index<account_statistics_object> > >();
+   stats_idx->add_secondary_index< vote_tally_observer<account_statistics_object> >( *vote_tally );
+   auto asset_data_idx = add_index< primary_index<simple_index<asset_dynamic_data_object> > >();
+   asset_data_idx->add_secondary_index<core_pool_total_index>();
    add_index< primary_index<flat_index<  block_summary_object            >> >();
    add_index< primary_index<simple_index<chain_property_object          > > >();
    add_index< primary_index<simple_index<miner_schedule_object        > > >();
    add_index< primary_index< seeder_index                                 > >();
-   add_index< primary_index< content_index                                > >();
-   add_index< primary_index< buying_index                                 > >();
+   auto content_idx = add_index< primary_index< content_index             > >();
+   content_idx->add_secondary_index<content_search_index>( *this );
+   content_idx->add_secondary_index<content_escrow_total_index>();
+   auto buying_idx = add_index< primary_index< buying_index               > >();
+   buying_idx->add_secondary_index<buying_escrow_total_index>();
    add_index< primary_index< subscription_index                                 > >();
    add_index< primary_index< transaction_detail_index                     > >();
    add_index< primary_index< seeding_statistics_index                     > >();
@@ -37,6 +37,7 @@
 #include <graphene/chain/global_property_object.hpp>
 #include <graphene/chain/vesting_balance_object.hpp>
 #include <graphene/chain/vote_count.hpp>
+#include <graphene/chain/vote_tally_index.hpp>
 #include <graphene/chain/miner_object.hpp>
 
 namespace graphene { namespace chain {
@@ -165,6 +166,15 @@ void database::process_budget()
          rec.from_initial_reserve = core_asset.reserved(*this);
          rec.from_accumulated_fees = core.asset_pool + dpo.unspent_fee_budget;
          rec._real_supply = get_real_supply();
+#ifndef NDEBUG
+         {
+            const real_supply scanned = scan_real_supply();
+            assert( rec._real_supply.account_balances == scanned.account_balances );
+            assert( rec._real_supply.vesting_balances == scanned.vesting_balances );
+            assert( rec._real_supply.escrows == scanned.escrows );
+            assert( rec._real_supply.pools == scanned.pools );
+         }
+#endif
          if(    (dpo.last_budget_time == fc::time_point_sec())
                 || (now <= dpo.last_budget_time) )
          {
@@ -220,58 +230,49 @@ void database::perform_chain_maintenance(const signed_block& next_block, const g
 {
    const auto& gpo = get_global_properties();
 
-   struct vote_tally_helper {
-      database& d;
-      const global_property_object& props;
+   // the stake behind every vote is kept up to date by vote_tally_index, only copy it into the buffers
+   const vote_tally_index& tally = get_vote_tally();
+   _vote_tally_buffer.resize( gpo.next_available_vote_id );
+   for( uint32_t offset = 0; offset < _vote_tally_buffer.size(); ++offset )
+      _vote_tally_buffer[offset] = tally.votes( offset ).value;
 
-      vote_tally_helper(database& d, const global_property_object& gpo)
-         : d(d), props(gpo)
+   _miner_count_histogram_buffer.resize( gpo.parameters.maximum_miner_count / 2 + 1 );
+   for( const auto& item : tally.miner_count_votes() )
+   {
+      // votes for a number greater than maximum_miner_count are ignored
+      if( item.first <= gpo.parameters.maximum_miner_count )
       {
-         d._vote_tally_buffer.resize(props.next_available_vote_id);
-         d._miner_count_histogram_buffer.resize(props.parameters.maximum_miner_count / 2 + 1);
-         d._total_voting_stake = 0;
+         size_t offset = std::min( size_t(item.first / 2), _miner_count_histogram_buffer.size() - 1 );
+         _miner_count_histogram_buffer[offset] += item.second.value;
       }
+   }
+   _total_voting_stake = tally.total_voting_stake().value;
+#ifndef NDEBUG
+   {
+      // the same tally, computed from the stake of every account
+      vector<uint64_t> scanned_votes( _vote_tally_buffer.size() );
+      vector<uint64_t> scanned_miner_counts( _miner_count_histogram_buffer.size() );
+      uint64_t scanned_total = 0;
+      for( const account_object& stake_account : get_index_type<account_index>().indices() )
+      {
+         const account_object& opinion_account = (stake_account.options.voting_account == GRAPHENE_PROXY_TO_SELF_ACCOUNT) ?
+                                                 stake_account : get(stake_account.options.voting_account);
+         const uint64_t voting_stake = stake_account.statistics(*this).total_core_in_orders.value
+            + (stake_account.cashback_vb.valid() ? (*stake_account.cashback_vb)(*this).balance.amount.value : 0)
+            + get_balance(stake_account.get_id(), asset_id_type()).amount.value;
 
-      void operator()(const account_object& stake_account) {
-         // There may be a difference between the account whose stake is voting and the one specifying opinions.
-         // Usually they're the same, but if the stake account has specified a voting_account, that account is the one
-         // specifying the opinions.
-         const account_object& opinion_account = (stake_account.options.voting_account == GRAPHENE_PROXY_TO_SELF_ACCOUNT) ? stake_account : d.get(stake_account.options.voting_account);
-         
-         const auto& stats = stake_account.statistics(d);
-         uint64_t voting_stake = stats.total_core_in_orders.value
-            + (stake_account.cashback_vb.valid() ? (*stake_account.cashback_vb)(d).balance.amount.value: 0)
-            + d.get_balance(stake_account.get_id(), asset_id_type()).amount.value;
-         
          for( vote_id_type id : opinion_account.options.votes )
-         {
-            uint32_t offset = id.instance();
-            // if they somehow managed to specify an illegal offset, ignore it.
-            if( offset < d._vote_tally_buffer.size() )
-               d._vote_tally_buffer[offset] += voting_stake;
-         }
-         
-         if( opinion_account.options.num_miner <= props.parameters.maximum_miner_count )
-         {
-            uint16_t offset = std::min(size_t(opinion_account.options.num_miner/2),
-                                       d._miner_count_histogram_buffer.size() - 1);
-            // votes for a number greater than maximum_miner_count
-            // are turned into votes for maximum_miner_count.
-            //
-            // in particular, this takes care of the case where a
-            // member was voting for a high number, then the
-            // parameter was lowered.
-            d._miner_count_histogram_buffer[offset] += voting_stake;
-         }
-         
-         d._total_voting_stake += voting_stake;
+            if( id.instance() < scanned_votes.size() )
+               scanned_votes[id.instance()] += voting_stake;
+         if( opinion_account.options.num_miner <= gpo.parameters.maximum_miner_count )
+            scanned_miner_counts[std::min( size_t(opinion_account.options.num_miner / 2), scanned_miner_counts.size() - 1 )] += voting_stake;
+         scanned_total += voting_stake;
       }
-      
-   } tally_helper(*this, gpo);
-
-   perform_account_maintenance(std::tie(
-      tally_helper
-   ));
+      assert( scanned_votes == _vote_tally_buffer );
+      assert( scanned_miner_counts == _miner_count_histogram_buffer );
+      assert( scanned_total == _total_voting_stake );
+   }
+#endif
 
    struct clear_canary {
       clear_canary(vector<uint64_t>& target): target(target){}
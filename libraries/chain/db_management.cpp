@@ -29,11 +29,94 @@
 #include <graphene/chain/protocol/fee_schedule.hpp>
 
 #include <fc/io/fstream.hpp>
+#include <fc/io/json.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
 
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace graphene { namespace chain { namespace detail {
+
+   /**
+    * Saved next to the object graph of a state checkpoint, identifies the block it belongs to
+    */
+   struct state_checkpoint_manifest
+   {
+      std::string    db_version;
+      uint32_t       block_num = 0;
+      block_id_type  block_id;
+      fc::sha256     checksum;
+   };
+
+   /**
+    * @return block numbers of the complete checkpoints in @ref dir, newest first
+    */
+   std::vector<uint32_t> list_state_checkpoints( const fc::path& dir )
+   {
+      std::vector<uint32_t> result;
+      if( !fc::exists( dir ) )
+         return result;
+      for( fc::directory_iterator itr( dir ); itr != fc::directory_iterator(); ++itr )
+      {
+         const std::string name = (*itr).filename().generic_string();
+         if( !name.empty() && std::all_of( name.begin(), name.end(), ::isdigit ) )
+            result.push_back( std::stoul( name ) );
+      }
+      std::sort( result.rbegin(), result.rend() );
+      return result;
+   }
+
+   /**
+    * Flushes the content of the file or the entries of the directory @ref path to the disk
+    */
+   void sync_file( const fc::path& path )
+   {
+#ifdef _WIN32
+      // directory entries cannot be flushed on Windows
+      if( fc::is_directory( path ) )
+         return;
+      int fd = _open( path.generic_string().c_str(), _O_RDWR | _O_BINARY );
+      FC_ASSERT( fd >= 0, "Cannot open ${p}", ("p", path) );
+      const int res = _commit( fd );
+      _close( fd );
+#else
+      int fd = ::open( path.generic_string().c_str(), O_RDONLY );
+      FC_ASSERT( fd >= 0, "Cannot open ${p}", ("p", path) );
+      const int res = ::fsync( fd );
+      ::close( fd );
+#endif
+      FC_ASSERT( res == 0, "Cannot flush ${p}", ("p", path) );
+   }
+
+   /**
+    * Flushes @ref dir and everything below it to the disk
+    */
+   void sync_tree( const fc::path& dir )
+   {
+      for( fc::directory_iterator itr( dir ); itr != fc::directory_iterator(); ++itr )
+      {
+         if( fc::is_directory( *itr ) )
+            sync_tree( *itr );
+         else
+            sync_file( *itr );
+      }
+      sync_file( dir );
+   }
+
+} } }
+
+FC_REFLECT( graphene::chain::detail::state_checkpoint_manifest, (db_version)(block_num)(block_id)(checksum) )
+
 namespace graphene { namespace chain {
 
 database::database()
@@ -47,12 +130,66 @@ database::~database()
    clear_pending();
 }
 
-void database::reindex(fc::path data_dir, const genesis_state_type& initial_allocation)
+void database::reindex(fc::path data_dir, const genesis_state_type& initial_allocation, uint32_t skip)
 { try {
    ilog( "reindexing blockchain" );
    wipe(data_dir, false);
    open(data_dir, [&initial_allocation]{return initial_allocation;});
 
+   replay_blocks( 1, skip );
+} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+
+bool database::replay_from_checkpoint(fc::path data_dir, uint32_t skip)
+{ try {
+   wipe(data_dir, false);
+   _block_id_to_block.open(data_dir / "database" / "block_num_to_block");
+   const auto last_block = _block_id_to_block.last();
+   if( !last_block )
+      return false;
+
+   fc::path checkpoint_dir;
+   detail::state_checkpoint_manifest manifest;
+   for( uint32_t num : detail::list_state_checkpoints( data_dir / "state_checkpoints" ) )
+   {
+      const fc::path dir = data_dir / "state_checkpoints" / fc::to_string( num );
+      try
+      {
+         manifest = fc::json::from_file( dir / "manifest.json" ).as<detail::state_checkpoint_manifest>();
+         FC_ASSERT( manifest.db_version == GRAPHENE_CURRENT_DB_VERSION, "Saved by an incompatible version" );
+         FC_ASSERT( manifest.block_num == num && num <= last_block->block_num() );
+         FC_ASSERT( _block_id_to_block.fetch_block_id( num ) == manifest.block_id, "Block is no longer on the chain" );
+         FC_ASSERT( snapshot_checksum( dir ) == manifest.checksum, "Checksum mismatch" );
+         checkpoint_dir = dir;
+         break;
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "Skipping state checkpoint ${d}: ${e}", ("d", dir)("e", e.to_string()) );
+      }
+   }
+   if( checkpoint_dir.generic_string().empty() )
+      return false;
+
+   try
+   {
+      ilog( "Replaying blockchain from state checkpoint at block ${n}", ("n", manifest.block_num) );
+      object_database::open( data_dir, checkpoint_dir );
+      FC_ASSERT( head_block_id() == manifest.block_id, "Loaded state does not belong to the checkpoint block" );
+      _fork_db.start_block( *last_block );
+      _last_state_checkpoint_num = manifest.block_num;
+
+      replay_blocks( manifest.block_num + 1, skip );
+   }
+   catch( const fc::exception& e )
+   {
+      elog( "Failed to replay from state checkpoint ${d}: ${e}", ("d", checkpoint_dir)("e", e.to_detail_string()) );
+      return false;
+   }
+   return true;
+} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+
+void database::replay_blocks( uint32_t first_block_num, uint32_t skip )
+{
    auto start = fc::time_point::now();
    auto last_block = _block_id_to_block.last();
    if( !last_block ) {
@@ -62,14 +199,27 @@ void database::reindex(fc::path data_dir, const genesis_state_type& initial_allo
    }
 
    const auto last_block_num = last_block->block_num();
+   const bool recover_signees = !(skip & skip_miner_signature);
+   const uint32_t lookahead = recover_signees ? GRAPHENE_SIGNATURE_LOOKAHEAD_BLOCKS : 1;
+   std::deque< validated_block_ptr > prefetched;
 
    ilog( "Replaying blocks..." );
    _undo_db.disable();
-   for( uint32_t i = 1; i <= last_block_num; ++i )
+   for( uint32_t i = first_block_num; i <= last_block_num; ++i )
    {
       if( i % 2000 == 0 ) std::cerr << "   " << double(i*100)/last_block_num << "%   "<<i << " of " <<last_block_num<<"   \n";
-      fc::optional< signed_block > block = _block_id_to_block.fetch_by_number(i);
-      if( !block.valid() )
+      // keep the signees of the following blocks being recovered while this one is applied
+      while( prefetched.size() < lookahead && i + prefetched.size() <= last_block_num &&
+             ( prefetched.empty() || prefetched.back() ) )
+      {
+         fc::optional< signed_block > next = _block_id_to_block.fetch_by_number( i + prefetched.size() );
+         prefetched.push_back( next.valid() ? std::make_shared<const validated_block>( std::move( *next ) ) : validated_block_ptr() );
+         if( recover_signees && prefetched.back() )
+            precompute_block_signee( prefetched.back() );
+      }
+      validated_block_ptr block = std::move( prefetched.front() );
+      prefetched.pop_front();
+      if( !block )
       {
          wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
          uint32_t dropped_count = 0;
@@ -88,18 +238,70 @@ void database::reindex(fc::path data_dir, const genesis_state_type& initial_allo
          wlog( "Dropped ${n} blocks from after the gap", ("n", dropped_count) );
          break;
       }
-      apply_block(*block, skip_miner_signature |
-                          skip_transaction_signatures |
-                          skip_transaction_dupe_check |
-                          skip_tapos_check |
-                          skip_miner_schedule_check |
-                          skip_authority_check);
-
+      apply_block(*block, skip);
    }
    _undo_db.enable();
+   // checkpoints are not worth their time while replaying, take a single one of the replayed state
+   if( _state_checkpoint_interval != 0 && head_block_num() > _last_state_checkpoint_num )
+      save_state_checkpoint();
    auto end = fc::time_point::now();
    ilog( "Done reindexing, elapsed time: ${t} sec", ("t",double((end-start).count())/1000000.0 ) );
-} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+}
+
+void database::check_state_checkpoint()
+{
+   if( _state_checkpoint_interval == 0 ||
+       get_dynamic_global_properties().last_irreversible_block_num < _last_state_checkpoint_num + _state_checkpoint_interval )
+      return;
+   save_state_checkpoint();
+}
+
+void database::save_state_checkpoint()
+{
+   const fc::path checkpoints_dir = get_data_dir() / "state_checkpoints";
+   const fc::path tmp_dir = checkpoints_dir / "tmp";
+   const uint32_t num = head_block_num();
+   try
+   {
+      auto start = fc::time_point::now();
+      fc::remove_all( tmp_dir );
+      fc::create_directories( tmp_dir );
+      // indexes unchanged since the previous checkpoint are hard linked from it
+      snapshot_info snapshot = save_snapshot( tmp_dir, _last_state_checkpoint );
+
+      detail::state_checkpoint_manifest manifest;
+      manifest.db_version = GRAPHENE_CURRENT_DB_VERSION;
+      manifest.block_num = num;
+      manifest.block_id = head_block_id();
+      manifest.checksum = snapshot.checksum();
+      fc::json::save_to_file( manifest, tmp_dir / "manifest.json" );
+      detail::sync_tree( tmp_dir );
+
+      // the checkpoint gets its final name only once it is complete
+      const fc::path dir = checkpoints_dir / fc::to_string( num );
+      fc::remove_all( dir );
+      fc::rename( tmp_dir, dir );
+      detail::sync_file( checkpoints_dir );
+      snapshot.dir = dir;
+      _last_state_checkpoint = std::move( snapshot );
+      _last_state_checkpoint_num = num;
+
+      // keep the previous one in case a fork switch takes this block away
+      const auto checkpoints = detail::list_state_checkpoints( checkpoints_dir );
+      for( size_t i = 2; i < checkpoints.size(); ++i )
+         fc::remove_all( checkpoints_dir / fc::to_string( checkpoints[i] ) );
+
+      auto end = fc::time_point::now();
+      ilog( "Saved state checkpoint at block ${n}, elapsed time: ${t} sec", ("n", num)("t", double((end-start).count())/1000000.0) );
+   }
+   catch( const fc::exception& e )
+   {
+      // a failed checkpoint only means a longer replay after a crash, don't stop the node
+      elog( "Failed to save state checkpoint at block ${n}: ${e}", ("n", num)("e", e.to_detail_string()) );
+      _last_state_checkpoint = snapshot_info();
+      _last_state_checkpoint_num = num;
+   }
+}
 
 void database::wipe(const fc::path& data_dir, bool include_blocks)
 {
@@ -107,7 +309,10 @@ void database::wipe(const fc::path& data_dir, bool include_blocks)
    close();
    object_database::wipe(data_dir);
    if( include_blocks )
+   {
       fc::remove_all( data_dir / "database" );
+      fc::remove_all( data_dir / "state_checkpoints" );
+   }
 }
 
 void database::open(
@@ -122,6 +327,7 @@ void database::open(
 
       if( !find(global_property_id_type()) )
          init_genesis(genesis_loader());
+      _last_state_checkpoint_num = head_block_num();
 
       fc::optional<signed_block> last_block = _block_id_to_block.last();
       if( last_block.valid() )
@@ -187,6 +393,7 @@ void database::close(bool rewind)
       _block_id_to_block.close();
 
    _fork_db.reset();
+   _precomputed_signees.clear();
 }
 
 } }
@@ -40,8 +40,9 @@
 
 namespace graphene { namespace chain {
 
-void database::update_global_dynamic_data( const signed_block& b )
+void database::update_global_dynamic_data( const validated_block& next_block )
 {
+   const signed_block& b = next_block.block();
    const dynamic_global_property_object& _dgp =
       dynamic_global_property_id_type(0)(*this);
 
@@ -77,7 +78,7 @@ void database::update_global_dynamic_data( const signed_block& b )
          dgp.recently_missed_count--;
 
       dgp.head_block_number = b.block_num();
-      dgp.head_block_id = b.id();
+      dgp.head_block_id = next_block.id();
       dgp.time = b.timestamp;
       dgp.current_miner = b.miner;
       dgp.recent_slots_filled = (
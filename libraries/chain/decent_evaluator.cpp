@@ -295,7 +295,7 @@ void_result set_publishing_right_evaluator::do_evaluate( const set_publishing_ri
                                            }
                                         }
 
-                                        co.synopsis = o.synopsis;
+                                        co.set_synopsis( o.synopsis );
                                         co.co_authors = o.co_authors;
                                         /*
                                         co.publishing_fee_escrow += o.publishing_fee;
@@ -337,7 +337,7 @@ void_result set_publishing_right_evaluator::do_evaluate( const set_publishing_ri
                                         }
 
                                         co.size = o.size;
-                                        co.synopsis = o.synopsis;
+                                        co.set_synopsis( o.synopsis );
                                         co.URI = o.URI;
                                         co.publishing_fee_escrow = o.publishing_fee;
                                         auto itr1 = o.seeders.begin();
@@ -819,7 +819,8 @@ void_result set_publishing_right_evaluator::do_evaluate( const set_publishing_ri
       FC_ASSERT( content->cd.valid() == o.proof.valid() );
 
       if(!(db().get_node_properties().skip_flags&db().skip_validate)) {
-         FC_ASSERT( !(content->cd.valid() ) || _custody_utils.verify_by_miner( *(content->cd), *(o.proof) ) == 0, "Invalid proof of custody" );
+         FC_ASSERT( !(content->cd.valid() ) || db().is_custody_proof_verified( o, *(content->cd) ) ||
+                    decent::encrypt::CustodyUtils::instance().verify_by_miner( *(content->cd), *(o.proof) ) == 0, "Invalid proof of custody" );
       }
       //ilog("proof_of_custody OK");
 
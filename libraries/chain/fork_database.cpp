@@ -56,6 +56,11 @@ void     fork_database::start_block(signed_block b)
  *
  */
 shared_ptr<fork_item>  fork_database::push_block(const signed_block& b)
+{
+   return push_block( validated_block( b ) );
+}
+
+shared_ptr<fork_item>  fork_database::push_block(const validated_block& b)
 {
    auto item = std::make_shared<fork_item>(b);
    try {
@@ -23,9 +23,18 @@
  */
 #pragma once
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <graphene/chain/protocol/block.hpp>
+#include <fc/interprocess/file_mapping.hpp>
 
 namespace graphene { namespace chain {
+   /**
+    *  Blocks are appended to the "blocks" file and located through fixed size entries of the "index" file.
+    *  Both files are written through streams by the single writer, while readers access them through
+    *  read-only memory mappings. A mapping is replaced by a larger one when a reader needs data appended
+    *  after it was created; readers holding the old one keep using it, so they never wait for each other.
+    */
    class block_database 
    {
       public:
@@ -35,16 +44,47 @@ namespace graphene { namespace chain {
          void close();
 
          void store( const block_id_type& id, const signed_block& b );
+         void store( const validated_block& b );
          void remove( const block_id_type& id );
 
          bool                   contains( const block_id_type& id )const;
          block_id_type          fetch_block_id( uint32_t block_num )const;
          optional<signed_block> fetch_optional( const block_id_type& id )const;
          optional<signed_block> fetch_by_number( uint32_t block_num )const;
+         /**
+          *  @return packed blocks numbered from @p first_block_num on, at most @p count of them; stops at the
+          *  first block missing from the database
+          */
+         vector<vector<char>>   fetch_packed_range( uint32_t first_block_num, uint32_t count )const;
          optional<signed_block> last()const;
          optional<block_id_type> last_id()const;
       private:
-         mutable std::fstream _blocks;
-         mutable std::fstream _block_num_to_pos;
+         struct mapped_file
+         {
+            mapped_file( const fc::path& file, uint64_t size );
+
+            fc::file_mapping  mapping;
+            fc::mapped_region region;
+            const char*       data;
+            uint64_t          size;
+         };
+         typedef std::shared_ptr<const mapped_file> mapped_file_ptr;
+
+         /**
+          *  @return mapping of the file covering at least min_size bytes or null if the file is smaller;
+          *  min_size of 0 requests the whole current file
+          */
+         mapped_file_ptr map_file( mapped_file_ptr& current, const fc::path& file, uint64_t min_size )const;
+         mapped_file_ptr map_index( uint64_t min_size )const { return map_file( _index_map, _index_path, min_size ); }
+         mapped_file_ptr map_blocks( uint64_t min_size )const { return map_file( _blocks_map, _blocks_path, min_size ); }
+         void store_packed( const block_id_type& id, const vector<char>& packed );
+
+         fc::path                 _blocks_path;
+         fc::path                 _index_path;
+         std::fstream             _blocks;
+         std::fstream             _block_num_to_pos;
+         mutable mapped_file_ptr  _blocks_map;
+         mutable mapped_file_ptr  _index_map;
+         mutable std::mutex       _map_mutex;
    };
 } }
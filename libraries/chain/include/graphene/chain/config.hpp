@@ -169,10 +169,16 @@
 #define GRAPHENE_RECENTLY_MISSED_COUNT_INCREMENT             4
 #define GRAPHENE_RECENTLY_MISSED_COUNT_DECREMENT             3
 
-#define GRAPHENE_CURRENT_DB_VERSION                          "DCT1.0"
+#define GRAPHENE_CURRENT_DB_VERSION                          "DCT1.1"
 
 #define GRAPHENE_IRREVERSIBLE_THRESHOLD                      (70 * GRAPHENE_1_PERCENT)
 
+/**
+ * Number of blocks ahead of the one being applied whose miner signatures are recovered
+ * in parallel while replaying the blockchain
+ */
+#define GRAPHENE_SIGNATURE_LOOKAHEAD_BLOCKS                  64
+
 /**
  *  Reserved Account IDs with special meaning
  */
@@ -7,17 +7,23 @@
 #include <graphene/db/object.hpp>
 #include <graphene/db/generic_index.hpp>
 
+#include <boost/multi_index/composite_key.hpp>
+
 #include <fc/crypto/ripemd160.hpp>
 #include <fc/reflect/reflect.hpp>
 #include <fc/io/json.hpp>
 
+#include <fc/container/flat.hpp>
+
 #include <stdint.h>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 
 
 
 namespace graphene { namespace chain {
+   class database;
 using namespace decent::encrypt;
 
 
@@ -284,7 +290,7 @@ using namespace decent::encrypt;
          init();
       }
 
-      bool filter(ContentObjectTypeValue const& filter)
+      bool filter(ContentObjectTypeValue const& filter) const
       {
          bool bRes = true;
          if (filter.type.size() > type.size())
@@ -442,6 +448,11 @@ using namespace decent::encrypt;
       PriceRegions price;
 
       string synopsis;
+      /// parsed from the synopsis by set_synopsis(), so that listings and searches don't need to parse it
+      string title_lowercase;
+      string description_lowercase;
+      ContentObjectTypeValue type;
+
       uint64_t size;
       uint32_t quorum;
       string URI;
@@ -479,6 +490,13 @@ using namespace decent::encrypt;
          return region_price->amount;
       }
 
+      /**
+       * Sets the synopsis together with the title, description and type parsed from it
+       */
+      void set_synopsis( const string& str_synopsis );
+
+      const vector<uint32_t>& get_type_path() const { return type.type; }
+
       bool recent_proof( uint64_t validity_seconds ) const {
          auto  now = fc::time_point::now();
          for( auto i: last_proof ){
@@ -497,6 +515,7 @@ using namespace decent::encrypt;
    struct by_times_bought;
    struct by_expiration;
    struct by_created;
+   struct by_type;
 
    template <typename TAG, typename _t_object>
    struct key_extractor;
@@ -598,6 +617,13 @@ using namespace decent::encrypt;
 
             ordered_non_unique<tag<by_created>,
                member<content_object, time_point_sec, &content_object::created>
+            >,
+
+            ordered_unique<tag<by_type>,
+               composite_key<content_object,
+                  const_mem_fun<content_object, const vector<uint32_t>&, &content_object::get_type_path>,
+                  member<object, object_id_type, &object::id>
+               >
             >
    
          >
@@ -605,12 +631,51 @@ using namespace decent::encrypt;
    
    
    typedef generic_index< content_object, content_object_multi_index_type > content_index;
+
+   /**
+    * @brief Trigram index over the lowercased title, description and author name of content objects
+    *
+    * A field containing a search term also contains all trigrams of the term, so intersecting their
+    * posting lists gives the few objects which may match without looking at the others.
+    */
+   class content_search_index : public secondary_index
+   {
+      public:
+         explicit content_search_index( const database& db ) : _db(db) {}
+
+         virtual void object_inserted( const object& obj ) override;
+         virtual void object_removed( const object& obj ) override;
+         virtual void object_modified( const object& after ) override;
+
+         /**
+          * @param term lowercased search term
+          * @return sorted ids of the content objects which may contain @ref term, or nothing if the term is
+          * shorter than a trigram and every object has to be checked
+          */
+         optional< vector<content_id_type> > find_candidates( const string& term )const;
+
+      private:
+         struct entry
+         {
+            account_id_type  author;
+            size_t           text_hash = 0;
+            vector<uint32_t> trigrams;
+         };
+
+         void add( const content_object& co );
+         void remove( content_id_type id );
+
+         const database&                                          _db;
+         map< content_id_type, entry >                            _entries;
+         std::unordered_map< uint32_t, flat_set<content_id_type> > _postings;
+   };
    
 }}
 
 FC_REFLECT_DERIVED(graphene::chain::content_object,
                    (graphene::db::object),
                    (author)(co_authors)(expiration)(created)(price)(size)(synopsis)
+                   (title_lowercase)(description_lowercase)(type)
                    (URI)(quorum)(key_parts)(_hash)(last_proof)(is_blocked)
                    (AVG_rating)(num_of_ratings)(times_bought)(publishing_fee_escrow)(cd)(seeder_price) )
 
@@ -30,6 +30,7 @@
 #include <graphene/chain/budget_record_object.hpp>
 #include <graphene/chain/fork_database.hpp>
 #include <graphene/chain/block_database.hpp>
+#include <graphene/chain/pending_transaction_pool.hpp>
 #include <graphene/chain/genesis_state.hpp>
 #include <graphene/chain/evaluator.hpp>
 
@@ -37,6 +38,7 @@
 #include <graphene/db/object.hpp>
 #include <graphene/db/simple_index.hpp>
 #include <fc/signals.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <graphene/chain/protocol/protocol.hpp>
 
@@ -52,6 +54,7 @@ namespace graphene { namespace chain {
 
    struct budget_record;
    struct real_supply;
+   class vote_tally_index;
 
    /**
     *   @class database
@@ -83,6 +86,14 @@ namespace graphene { namespace chain {
             skip_validate               = 1 << 11 ///< used prior to checkpoint, skips validate() call on transaction
          };
 
+         /// checks skipped when replaying blocks which were already validated when they were received
+         static const uint32_t replay_skip_flags = skip_miner_signature |
+                                                   skip_transaction_signatures |
+                                                   skip_transaction_dupe_check |
+                                                   skip_tapos_check |
+                                                   skip_miner_schedule_check |
+                                                   skip_authority_check;
+
          /**
           * @brief Open a database, creating a new one if necessary
           *
@@ -103,8 +114,29 @@ namespace graphene { namespace chain {
           *
           * This method may be called after or instead of @ref database::open, and will rebuild the object graph by
           * replaying blockchain history. When this method exits successfully, the database will be open.
+          *
+          * Unless @ref skip contains skip_miner_signature, the miner signatures of the next
+          * GRAPHENE_SIGNATURE_LOOKAHEAD_BLOCKS blocks are recovered in parallel while the current one is applied.
+          */
+         void reindex(fc::path data_dir, const genesis_state_type& initial_allocation = genesis_state_type(),
+                      uint32_t skip = replay_skip_flags);
+
+         /**
+          * @brief Rebuild object graph from the newest valid state checkpoint and open database
+          *
+          * Like @ref reindex, but only the blocks after the checkpoint are replayed. A checkpoint is valid if
+          * its files match the checksum in its manifest and its block is still part of the stored chain.
+          *
+          * @return false if there is no valid checkpoint or loading it failed, the object graph is then left
+          * in an undefined state and has to be rebuilt by @ref reindex
           */
-         void reindex(fc::path data_dir, const genesis_state_type& initial_allocation = genesis_state_type());
+         bool replay_from_checkpoint(fc::path data_dir, uint32_t skip = replay_skip_flags);
+
+         /**
+          * @brief Save a state checkpoint whenever the last irreversible block advances by @ref interval blocks
+          * past the previous one, 0 disables checkpoints. Replays take only one checkpoint, once they are done
+          */
+         void set_state_checkpoint_interval( uint32_t interval ) { _state_checkpoint_interval = interval; }
 
          /**
           * @brief wipe Delete database from disk, and potentially the raw chain as well.
@@ -123,10 +155,18 @@ namespace graphene { namespace chain {
           *  part of the official chain, otherwise return false
           */
          bool                       is_known_block( const block_id_type& id )const;
+
+         /**
+          *  Starts recovering the miner's public key from the signature of @ref b on the signature thread pool,
+          *  so that validating the block later only has to pick up the result.
+          */
+         void                       precompute_block_signee( const validated_block_ptr& b );
          bool                       is_known_transaction( const transaction_id_type& id )const;
          block_id_type              get_block_id_for_num( uint32_t block_num )const;
          optional<signed_block>     fetch_block_by_id( const block_id_type& id )const;
          optional<signed_block>     fetch_block_by_number( uint32_t num )const;
+         /** @return packed blocks of the chain numbered from @p first_block_num on, at most @p count of them */
+         vector<vector<char>>       fetch_packed_blocks( uint32_t first_block_num, uint32_t count )const;
          const signed_transaction&  get_recent_transaction( const transaction_id_type& trx_id )const;
          std::vector<block_id_type> get_block_ids_on_fork(block_id_type head_of_fork) const;
 
@@ -141,10 +181,12 @@ namespace graphene { namespace chain {
          bool before_last_checkpoint()const;
 
          bool push_block(const signed_block &b, uint32_t skip = skip_nothing, bool sync_mode = false );
+         bool push_block(const validated_block &b, uint32_t skip = skip_nothing, bool sync_mode = false );
          //bool ( const signed_block& b, uint32_t skip = skip_nothing );
          processed_transaction push_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
-         bool _push_block(const signed_block &b, bool sync_mode = false );
+         bool _push_block(const validated_block &b, bool sync_mode = false );
          processed_transaction _push_transaction( const signed_transaction& trx );
+         processed_transaction _push_transaction( const signed_transaction& trx, const transaction_id_type& trx_id );
 
          ///@throws fc::exception if the proposed transaction fails to apply.
          processed_transaction push_proposal( const proposal_object& proposal );
@@ -262,6 +304,7 @@ namespace graphene { namespace chain {
          const dynamic_global_property_object&  get_dynamic_global_properties()const;
          const node_property_object&            get_node_properties()const;
          const fee_schedule&                    current_fee_schedule()const;
+         const vote_tally_index&                get_vote_tally()const;
 
          time_point_sec   head_block_time()const;
          uint32_t         head_block_num()const;
@@ -394,7 +437,25 @@ namespace graphene { namespace chain {
          bool is_reward_switch_in_interval(uint64_t a, uint64_t b)const;
          uint64_t get_next_reward_switch_block(uint64_t start)const;
 
+         /// components of the core supply, kept up to date by the running_total_index secondary indexes
          real_supply get_real_supply()const;
+         /// the same as get_real_supply(), computed by walking the indexes
+         real_supply scan_real_supply()const;
+
+         /**
+          * @brief Verifies proofs of custody contained in a block in one batch. Proofs that pass are remembered
+          * so that proof_of_custody_evaluator does not verify them again. If the batch fails, nothing is remembered
+          * and every proof is verified separately by the evaluator.
+          * @param next_block Block about to be applied
+          */
+         void verify_custody_proofs( const signed_block& next_block );
+         /**
+          * @brief Tests whether the proof was already verified by verify_custody_proofs()
+          * @param o Proof of custody operation
+          * @param cd Custody data of the content the proof is for
+          * @return true if the proof is known to be valid
+          */
+         bool is_custody_proof_verified( const proof_of_custody_operation& o, const custody_data_type& cd )const;
 
          bool is_reward_switch_time() const;
          struct votes_gained{
@@ -427,6 +488,11 @@ namespace graphene { namespace chain {
          //Mark pop_undo() as protected -- we do not want outside calling pop_undo(); it should call pop_block() instead
          void pop_undo() { object_database::pop_undo(); }
          void notify_changed_objects();
+         /**
+          *  @return ids of the objects which existed before the head undo state and were modified or removed in it;
+          *  the ids of created objects are left out as they are handed out again once the state is undone
+          */
+         flat_set<object_id_type> get_head_undo_changes()const;
 
       private:
          optional<undo_database::session>       _pending_tx_session;
@@ -440,21 +506,29 @@ namespace graphene { namespace chain {
        public:
          // these were formerly private, but they have a fairly well-defined API, so let's make them public
          void                  apply_block( const signed_block& next_block, uint32_t skip = skip_nothing );
+         void                  apply_block( const validated_block& next_block, uint32_t skip = skip_nothing );
          processed_transaction apply_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
          operation_result      apply_operation( transaction_evaluation_state& eval_state, const operation& op );
       private:
-         void                  _apply_block( const signed_block& next_block );
+         void                  _apply_block( const validated_block& next_block );
          processed_transaction _apply_transaction( const signed_transaction& trx );
+         processed_transaction _apply_transaction( const signed_transaction& trx, const transaction_id_type& trx_id );
 
          ///Steps involved in applying a new block
          ///@{
 
-         const miner_object& validate_block_header( uint32_t skip, const signed_block& next_block )const;
+         const miner_object& validate_block_header( uint32_t skip, const validated_block& next_block )const;
+         fc::ecc::public_key get_block_signee( const validated_block& next_block )const;
          const miner_object& _validate_block_header( const signed_block& next_block )const;
-         void create_block_summary(const signed_block& next_block);
+         void create_block_summary(const validated_block& next_block);
+
+         //////////////////// db_management.cpp ////////////////////
+         void replay_blocks( uint32_t first_block_num, uint32_t skip );
+         void check_state_checkpoint();
+         void save_state_checkpoint();
 
          //////////////////// db_update.cpp ////////////////////
-         void update_global_dynamic_data( const signed_block& b );
+         void update_global_dynamic_data( const validated_block& b );
          void update_signing_miner(const miner_object& signing_miner, const signed_block& new_block);
          void update_last_irreversible_block();
          void clear_expired_transactions();
@@ -478,7 +552,7 @@ namespace graphene { namespace chain {
          ///@}
          ///@}
 
-         vector< processed_transaction >        _pending_tx;
+         pending_transaction_pool               _pending_tx;
          fork_database                          _fork_db;
 
          /**
@@ -500,6 +574,24 @@ namespace graphene { namespace chain {
           */
          vector<optional<operation_history_object> >  _applied_ops;
 
+         /**
+          * Proofs of custody of the block being applied that passed the batch verification,
+          * see verify_custody_proofs()
+          */
+         flat_set<digest_type>             _verified_custody_proofs;
+
+         /**
+          * Threads recovering the block signees requested by precompute_block_signee(), and the pending results
+          * indexed by block id
+          */
+         vector< std::unique_ptr<fc::thread> >                        _signature_threads;
+         size_t                                                       _next_signature_thread = 0;
+         mutable std::map< block_id_type, fc::future<fc::ecc::public_key> > _precomputed_signees;
+
+         uint32_t                          _state_checkpoint_interval = 0;
+         uint32_t                          _last_state_checkpoint_num = 0;
+         snapshot_info                     _last_state_checkpoint;
+
          uint32_t                          _current_block_num    = 0;
          uint16_t                          _current_trx_in_block = 0;
          uint16_t                          _current_op_in_trx    = 0;
@@ -68,7 +68,7 @@ struct skip_flags_restorer
  */
 struct pending_transactions_restorer
 {
-   pending_transactions_restorer( database& db, std::vector<processed_transaction>&& pending_transactions )
+   pending_transactions_restorer( database& db, pending_transaction_pool&& pending_transactions )
       : _db(db), _pending_transactions( std::move(pending_transactions) )
    {
       _db.clear_pending();
@@ -76,6 +76,9 @@ struct pending_transactions_restorer
 
    ~pending_transactions_restorer()
    {
+      // the popped transactions change the state the pending ones were applied to
+      if( !_db._popped_tx.empty() )
+         _changed_objects.reset();
       for( const auto& tx : _db._popped_tx )
       {
          try {
@@ -88,28 +91,43 @@ struct pending_transactions_restorer
          }
       }
       _db._popped_tx.clear();
-      for( const processed_transaction& tx : _pending_transactions )
+      for( const pending_transaction_pool::entry& tx : _pending_transactions.entries() )
       {
+         bool conflicts = pending_transaction_pool::conflicts( tx, _changed_objects );
          try
          {
-            if( !_db.is_known_transaction( tx.id() ) ) {
-               // since push_transaction() takes a signed_transaction,
-               // the operation_results field will be ignored.
-               _db._push_transaction( tx );
+            if( !_db.is_known_transaction( tx.id ) ) {
+               if( conflicts ) {
+                  _db._push_transaction( tx.trx, tx.id );
+               } else {
+                  // nothing the signatures depend on has changed since they were verified
+                  node_property_object& npo = _db.node_properties();
+                  skip_flags_restorer restorer( npo, npo.skip_flags );
+                  npo.skip_flags |= database::skip_transaction_signatures;
+                  _db._push_transaction( tx.trx, tx.id );
+               }
             }
          }
          catch( const fc::exception& e )
          {
+            // the objects it would have created are missing, so nothing is known about the following ones
+            _changed_objects.reset();
             /*
             wlog( "Pending transaction became invalid after switching to block ${b}  ${t}", ("b", _db.head_block_id())("t",_db.head_block_time()) );
             wlog( "The invalid pending transaction caused exception ${e}", ("e", e.to_detail_string() ) );
             */
          }
+         // the effects of the transaction may differ from the original ones, so the following
+         // transactions can't rely on them
+         if( conflicts && _changed_objects.valid() )
+            _changed_objects->insert( tx.touched_objects.begin(), tx.touched_objects.end() );
       }
    }
 
    database& _db;
-   std::vector< processed_transaction > _pending_transactions;
+   pending_transaction_pool _pending_transactions;
+   /** objects changed since the pending transactions were applied, none if not known */
+   optional< flat_set<object_id_type> > _changed_objects;
 };
 
 /**
@@ -134,16 +152,19 @@ void with_skip_flags(
  * Empty pending_transactions, call callback,
  * then reset pending_transactions after callback is done.
  *
- * Pending transactions which no longer validate will be culled.
+ * The callback is passed the set of objects it changed, to be filled
+ * when they are known.  Pending transactions not touching them are
+ * reapplied without verifying their signatures again, pending
+ * transactions which no longer validate will be culled.
  */
 template< typename Lambda >
 void without_pending_transactions(
    database& db,
-   std::vector<processed_transaction>&& pending_transactions,
+   pending_transaction_pool&& pending_transactions,
    Lambda callback )
 {
     pending_transactions_restorer restorer( db, std::move(pending_transactions) );
-    callback();
+    callback( restorer._changed_objects );
     return;
 }
 
@@ -7,8 +7,6 @@
 
 namespace graphene { namespace chain {
 
-   static decent::encrypt::CustodyUtils _custody_utils;
-
    class set_publishing_manager_evaluator : public evaluator<set_publishing_manager_evaluator>
    {
    public:
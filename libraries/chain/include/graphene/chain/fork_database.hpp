@@ -39,6 +39,8 @@ namespace graphene { namespace chain {
    {
       fork_item( signed_block d )
       :num(d.block_num()),id(d.id()),data( std::move(d) ){}
+      fork_item( const validated_block& b )
+      :num(b.block_num()),id(b.id()),data( b.block() ){}
 
       block_id_type previous_id()const { return data.previous; }
 
@@ -86,6 +88,7 @@ namespace graphene { namespace chain {
           *  @return the new head block ( the longest fork )
           */
          shared_ptr<fork_item>            push_block(const signed_block& b);
+         shared_ptr<fork_item>            push_block(const validated_block& b);
          shared_ptr<fork_item>            head()const { return _head; }
          void                             pop_block();
 
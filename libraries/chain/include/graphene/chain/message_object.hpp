@@ -55,18 +55,57 @@ namespace graphene {
       std::string text;// decrypted text
    };
 
+   struct by_receiver;
+   struct by_receiver_sender;
+
+   /**
+    *  Orders the messages by each of their receivers and their creation time, so the messages to an account,
+    *  optionally from a given sender, are found by a range scan.
+    */
    class message_receiver_index : public secondary_index
    {
    public:
+      struct entry
+      {
+         account_id_type    receiver;
+         account_id_type    sender;
+         fc::time_point_sec created;
+         object_id_type     message;
+      };
+
+      typedef multi_index_container<
+         entry,
+         indexed_by<
+            ordered_unique< tag<by_receiver>,
+               composite_key< entry,
+                  member< entry, account_id_type, &entry::receiver >,
+                  member< entry, fc::time_point_sec, &entry::created >,
+                  member< entry, object_id_type, &entry::message >
+               >
+            >,
+            ordered_unique< tag<by_receiver_sender>,
+               composite_key< entry,
+                  member< entry, account_id_type, &entry::receiver >,
+                  member< entry, account_id_type, &entry::sender >,
+                  member< entry, fc::time_point_sec, &entry::created >,
+                  member< entry, object_id_type, &entry::message >
+               >
+            >
+         >
+      > entry_multi_index_type;
+
       virtual void object_inserted(const object& obj) override;
       virtual void object_removed(const object& obj) override;
       virtual void about_to_modify(const object& before) override;
       virtual void object_modified(const object& after) override;
 
-      std::map< account_id_type, std::set<object_id_type> > message_to_receiver_memberships;
+      const entry_multi_index_type& entries()const { return _entries; }
 
    protected:
       std::set<account_id_type> get_key_recipients(const message_object& a)const;
+
+   private:
+      entry_multi_index_type _entries;
    };
 
 
@@ -82,7 +121,6 @@ namespace graphene {
    };
 
    struct by_sender;
-   struct by_receiver;
    struct by_created;
    
    typedef multi_index_container<
@@ -90,7 +128,13 @@ namespace graphene {
       indexed_by<
       ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
       ordered_non_unique< tag<by_created>, member< message_object, time_point_sec, &message_object::created > >,
-      ordered_non_unique< tag<by_sender>, member< message_object, account_id_type, &message_object::sender > >
+      ordered_unique< tag<by_sender>,
+         composite_key< message_object,
+            member< message_object, account_id_type, &message_object::sender >,
+            member< message_object, time_point_sec, &message_object::created >,
+            member< object, object_id_type, &object::id >
+         >
+      >
       >
    > message_multi_index_type;
 
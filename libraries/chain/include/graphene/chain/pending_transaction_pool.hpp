@@ -0,0 +1,48 @@
+/* (c) 2016, 2017 DECENT Services. For details refers to LICENSE.txt */
+#pragma once
+#include <graphene/chain/protocol/transaction.hpp>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @brief The transactions applied on top of the head block, in the order they were applied.
+    *
+    *  Along with every transaction the pool keeps its id, its packed size and the existing objects it modified or
+    *  removed. The running total of the packed sizes lets block production pick the transactions fitting into a
+    *  block without packing them again, and the touched objects let the pending state be rebuilt after a block
+    *  without verifying the signatures of the transactions the block did not interfere with.
+    */
+   class pending_transaction_pool
+   {
+      public:
+         struct entry
+         {
+            processed_transaction    trx;
+            transaction_id_type      id;
+            size_t                   packed_size = 0;
+            size_t                   total_size = 0;   ///< packed size of this and all preceding transactions
+            flat_set<object_id_type> touched_objects;
+         };
+
+         void push( processed_transaction trx, const transaction_id_type& id, flat_set<object_id_type> touched_objects );
+         void clear() { _entries.clear(); }
+
+         bool                 empty()const { return _entries.empty(); }
+         size_t               size()const { return _entries.size(); }
+         const vector<entry>& entries()const { return _entries; }
+
+         /** @return number of leading transactions whose packed sizes add up to less than @p max_size */
+         size_t fitting_prefix( size_t max_size )const;
+
+         /**
+          *  @param changed_objects objects changed by the block applied since @p e was, none if they are not known
+          *  @return true if the changes may affect the validity of the signatures of @p e, i.e. they touch
+          *          objects @p e touched, accounts, or the chain parameters
+          */
+         static bool conflicts( const entry& e, const optional< flat_set<object_id_type> >& changed_objects );
+
+      private:
+         vector<entry> _entries;
+   };
+
+} } // graphene::chain
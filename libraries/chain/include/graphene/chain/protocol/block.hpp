@@ -24,6 +24,9 @@
 #pragma once
 #include <graphene/chain/protocol/transaction.hpp>
 
+#include <memory>
+#include <mutex>
+
 namespace graphene { namespace chain {
 
    struct block_header
@@ -55,6 +58,43 @@ namespace graphene { namespace chain {
       vector<processed_transaction> transactions;
    };
 
+   /**
+    *  Immutable view of a signed_block which computes the values derived from it at most once: the block id
+    *  eagerly, the signee, the transaction merkle root, the transaction ids and the packed bytes on first use.
+    *  The block cannot be modified through the wrapper, so the cached values never go stale. The lazy values
+    *  may be requested from several threads, e.g. the signee is recovered ahead of time on a worker thread.
+    */
+   class validated_block
+   {
+      public:
+         explicit validated_block( signed_block b );
+         /** @param id has to be the id of @p b computed earlier, e.g. by the fork database */
+         validated_block( signed_block b, const block_id_type& id );
+
+         const signed_block&                 block()const { return _block; }
+         const block_id_type&                id()const { return _id; }
+         uint32_t                            block_num()const { return block_header::num_from_id( _id ); }
+
+         const fc::ecc::public_key&          signee()const;
+         const checksum_type&                merkle_root()const;
+         const vector<transaction_id_type>&  transaction_ids()const;
+         const vector<char>&                 packed()const;
+
+      private:
+         const signed_block                  _block;
+         const block_id_type                 _id;
+
+         mutable std::once_flag              _signee_once;
+         mutable fc::ecc::public_key         _signee;
+         mutable std::once_flag              _merkle_root_once;
+         mutable checksum_type               _merkle_root;
+         mutable std::once_flag              _transaction_ids_once;
+         mutable vector<transaction_id_type> _transaction_ids;
+         mutable std::once_flag              _packed_once;
+         mutable vector<char>                _packed;
+   };
+   typedef std::shared_ptr<const validated_block> validated_block_ptr;
+
 } } // graphene::chain
 
 FC_REFLECT( graphene::chain::block_header, (previous)(timestamp)(miner)(transaction_merkle_root)(extensions) )
@@ -0,0 +1,52 @@
+/* (c) 2016, 2017 DECENT Services. For details refers to LICENSE.txt */
+#pragma once
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/buying_object.hpp>
+#include <graphene/chain/content_object.hpp>
+#include <graphene/chain/vesting_balance_object.hpp>
+
+#include <graphene/db/index.hpp>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @brief keeps the sum of one amount over all objects of its primary index
+    *
+    *  Every insertion, removal and modification, including the ones made by undo and by loading the
+    *  object database, goes through the secondary index callbacks, so the total is always current and
+    *  the components of real_supply can be read without walking the indexes.
+    */
+   template<typename ObjectType, share_type (*Amount)(const ObjectType&)>
+   class running_total_index : public secondary_index
+   {
+      public:
+         virtual void object_inserted( const object& obj ) override { _total += amount( obj ); }
+         virtual void object_removed( const object& obj ) override { _total -= amount( obj ); }
+         virtual void about_to_modify( const object& before ) override { _total -= amount( before ); }
+         virtual void object_modified( const object& after ) override { _total += amount( after ); }
+
+         share_type total()const { return _total; }
+
+      private:
+         static share_type amount( const object& obj ) { return Amount( static_cast<const ObjectType&>( obj ) ); }
+
+         share_type _total;
+   };
+
+   namespace detail {
+      inline share_type core_balance( const account_balance_object& b )
+      { return b.asset_type == asset_id_type() ? b.balance : share_type(0); }
+      inline share_type vesting_amount( const vesting_balance_object& b ) { return b.balance.amount; }
+      inline share_type publishing_fee_escrow( const content_object& c ) { return c.publishing_fee_escrow.amount; }
+      inline share_type buying_escrow( const buying_object& b ) { return b.price.amount; }
+      inline share_type core_pool( const asset_dynamic_data_object& d ) { return d.core_pool; }
+   }
+
+   typedef running_total_index<account_balance_object,    &detail::core_balance>          account_balance_total_index;
+   typedef running_total_index<vesting_balance_object,    &detail::vesting_amount>        vesting_balance_total_index;
+   typedef running_total_index<content_object,            &detail::publishing_fee_escrow> content_escrow_total_index;
+   typedef running_total_index<buying_object,             &detail::buying_escrow>         buying_escrow_total_index;
+   typedef running_total_index<asset_dynamic_data_object, &detail::core_pool>             core_pool_total_index;
+
+} } // graphene::chain
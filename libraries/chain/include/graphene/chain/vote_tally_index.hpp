@@ -0,0 +1,94 @@
+/* (c) 2016, 2017 DECENT Services. For details refers to LICENSE.txt */
+#pragma once
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/vesting_balance_object.hpp>
+
+#include <graphene/db/index.hpp>
+
+#include <unordered_map>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @brief Keeps the stake voting for every vote id, the miner count histogram and the total voting stake
+    *  up to date, so maintenance does not have to walk all accounts.
+    *
+    *  The voting stake of an account is its core balance, the core it has in orders and its cashback vesting
+    *  balance; it is counted for the votes of its opinion account (itself or its voting_account). This index is
+    *  attached to the account index and is fed balance, statistics and vesting balance changes by the
+    *  vote_tally_observer indexes. It only works with the values it has been told about, so it stays consistent
+    *  whatever order undo applies the changes in.
+    */
+   class vote_tally_index : public secondary_index
+   {
+      public:
+         virtual void object_inserted( const object& obj ) override;
+         virtual void object_removed( const object& obj ) override;
+         virtual void object_modified( const object& after ) override;
+
+         void update( const account_balance_object& balance );
+         void remove( const account_balance_object& balance );
+         void update( const account_statistics_object& stats );
+         void remove( const account_statistics_object& stats );
+         void update( const vesting_balance_object& vesting );
+         void remove( const vesting_balance_object& vesting );
+
+         /** stake voting for the vote id with instance @p offset */
+         share_type votes( uint32_t offset )const;
+         /** stake of the opinion accounts voting for @p num_miner miners, by the number of miners */
+         const std::map<uint16_t, share_type>& miner_count_votes()const { return _miner_count_votes; }
+         share_type total_voting_stake()const { return _total_voting_stake; }
+
+      private:
+         struct voter
+         {
+            bool                              present = false; ///< the account object exists
+            account_id_type                   opinion_account;
+            share_type                        core_balance;
+            share_type                        core_in_orders;
+            optional<vesting_balance_id_type> cashback_vb;
+         };
+         struct opinion
+         {
+            bool                   present = false; ///< the account object exists
+            share_type             stake;           ///< stake of the voters whose opinion account this is
+            flat_set<vote_id_type> votes;
+            uint16_t               num_miner = 0;
+         };
+
+         share_type stake( const voter& v )const;
+         /** applies @p change to the voter of @p account and moves its stake accordingly */
+         template<typename Change>
+         void change_voter( account_id_type account, Change&& change );
+         void add_opinion_stake( account_id_type account, share_type delta );
+         void add_opinion_votes( const opinion& o, share_type delta );
+         void update_account( const account_object& a );
+
+         std::unordered_map<uint64_t, voter>             _voters;
+         std::unordered_map<uint64_t, opinion>           _opinions;
+         std::unordered_map<uint64_t, share_type>        _vesting_balances;
+         std::unordered_map<uint64_t, account_id_type>   _cashback_owners;
+
+         std::vector<share_type>                         _votes;
+         std::map<uint16_t, share_type>                  _miner_count_votes;
+         share_type                                      _total_voting_stake;
+   };
+
+   /**
+    *  @brief Forwards the changes of the objects a voting stake consists of to the vote_tally_index.
+    */
+   template<typename ObjectType>
+   class vote_tally_observer : public secondary_index
+   {
+      public:
+         explicit vote_tally_observer( vote_tally_index& tally ) : _tally( tally ) {}
+
+         virtual void object_inserted( const object& obj ) override { _tally.update( static_cast<const ObjectType&>( obj ) ); }
+         virtual void object_removed( const object& obj ) override { _tally.remove( static_cast<const ObjectType&>( obj ) ); }
+         virtual void object_modified( const object& after ) override { _tally.update( static_cast<const ObjectType&>( after ) ); }
+
+      private:
+         vote_tally_index& _tally;
+   };
+
+} } // graphene::chain
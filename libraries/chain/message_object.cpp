@@ -35,7 +35,7 @@ void message_receiver_index::object_inserted(const object &obj) {
    auto recipients = get_key_recipients(a);
 
    for( auto &item : recipients ) {
-      message_to_receiver_memberships[ item ].insert(obj.id);
+      _entries.insert( entry{ item, a.sender, a.created, obj.id } );
    }
 }
 
@@ -45,15 +45,20 @@ void message_receiver_index::object_removed(const object &obj) {
 
    auto recipients = get_key_recipients(a);
 
+   auto& idx = _entries.get<by_receiver>();
    for( auto &item : recipients ) {
-      message_to_receiver_memberships[ item ].erase(obj.id);
+      auto itr = idx.find( boost::make_tuple( item, a.created, obj.id ) );
+      if( itr != idx.end() )
+         idx.erase( itr );
    }
 }
 
 void message_receiver_index::about_to_modify(const object &before) {
+   object_removed( before );
 }
 
 void message_receiver_index::object_modified(const object &after) {
+   object_inserted( after );
 }
 
 set<account_id_type> message_receiver_index::get_key_recipients(const message_object &a) const {
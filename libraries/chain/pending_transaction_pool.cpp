@@ -0,0 +1,45 @@
+/* (c) 2016, 2017 DECENT Services. For details refers to LICENSE.txt */
+#include <graphene/chain/pending_transaction_pool.hpp>
+
+#include <fc/io/raw.hpp>
+
+#include <algorithm>
+
+namespace graphene { namespace chain {
+
+void pending_transaction_pool::push( processed_transaction trx, const transaction_id_type& id, flat_set<object_id_type> touched_objects )
+{
+   entry e;
+   e.packed_size = fc::raw::pack_size( trx );
+   e.total_size = e.packed_size + (_entries.empty() ? 0 : _entries.back().total_size);
+   e.trx = std::move( trx );
+   e.id = id;
+   e.touched_objects = std::move( touched_objects );
+   _entries.push_back( std::move( e ) );
+}
+
+size_t pending_transaction_pool::fitting_prefix( size_t max_size )const
+{
+   auto itr = std::lower_bound( _entries.begin(), _entries.end(), max_size,
+                                []( const entry& e, size_t size ) { return e.total_size < size; } );
+   return itr - _entries.begin();
+}
+
+bool pending_transaction_pool::conflicts( const entry& e, const optional< flat_set<object_id_type> >& changed_objects )
+{
+   if( !changed_objects.valid() )
+      return true;
+
+   for( const object_id_type& id : *changed_objects )
+   {
+      // authorities are resolved through account objects, their depth is limited by the chain parameters
+      if( (id.space() == protocol_ids && id.type() == account_object_type) ||
+          (id.space() == implementation_ids && id.type() == impl_global_property_object_type) )
+         return true;
+      if( e.touched_objects.count( id ) )
+         return true;
+   }
+   return false;
+}
+
+} } // graphene::chain
@@ -89,4 +89,42 @@ namespace graphene { namespace chain {
       return checksum_type::hash( ids[0] );
    }
 
+   validated_block::validated_block( signed_block b )
+      : _block( std::move( b ) ), _id( _block.id() )
+   {
+   }
+
+   validated_block::validated_block( signed_block b, const block_id_type& id )
+      : _block( std::move( b ) ), _id( id )
+   {
+   }
+
+   const fc::ecc::public_key& validated_block::signee()const
+   {
+      std::call_once( _signee_once, [this]() { _signee = _block.signee(); } );
+      return _signee;
+   }
+
+   const checksum_type& validated_block::merkle_root()const
+   {
+      std::call_once( _merkle_root_once, [this]() { _merkle_root = _block.calculate_merkle_root(); } );
+      return _merkle_root;
+   }
+
+   const vector<transaction_id_type>& validated_block::transaction_ids()const
+   {
+      std::call_once( _transaction_ids_once, [this]() {
+         _transaction_ids.reserve( _block.transactions.size() );
+         for( const processed_transaction& trx : _block.transactions )
+            _transaction_ids.push_back( trx.id() );
+      } );
+      return _transaction_ids;
+   }
+
+   const vector<char>& validated_block::packed()const
+   {
+      std::call_once( _packed_once, [this]() { _packed = fc::raw::pack( _block ); } );
+      return _packed;
+   }
+
 } }
@@ -0,0 +1,162 @@
+/* (c) 2016, 2017 DECENT Services. For details refers to LICENSE.txt */
+#include <graphene/chain/vote_tally_index.hpp>
+
+namespace graphene { namespace chain {
+
+share_type vote_tally_index::stake( const voter& v )const
+{
+   share_type result = v.core_balance + v.core_in_orders;
+   if( v.cashback_vb.valid() )
+   {
+      auto itr = _vesting_balances.find( v.cashback_vb->instance.value );
+      if( itr != _vesting_balances.end() )
+         result += itr->second;
+   }
+   return result;
+}
+
+template<typename Change>
+void vote_tally_index::change_voter( account_id_type account, Change&& change )
+{
+   voter& v = _voters[account.instance.value];
+   if( v.present )
+   {
+      add_opinion_stake( v.opinion_account, -stake( v ) );
+      _total_voting_stake -= stake( v );
+   }
+   change( v );
+   if( v.present )
+   {
+      add_opinion_stake( v.opinion_account, stake( v ) );
+      _total_voting_stake += stake( v );
+   }
+}
+
+void vote_tally_index::add_opinion_stake( account_id_type account, share_type delta )
+{
+   if( delta == 0 )
+      return;
+   opinion& o = _opinions[account.instance.value];
+   o.stake += delta;
+   add_opinion_votes( o, delta );
+}
+
+void vote_tally_index::add_opinion_votes( const opinion& o, share_type delta )
+{
+   if( !o.present || delta == 0 )
+      return;
+   for( vote_id_type id : o.votes )
+   {
+      if( id.instance() >= _votes.size() )
+         _votes.resize( id.instance() + 1 );
+      _votes[id.instance()] += delta;
+   }
+   _miner_count_votes[o.num_miner] += delta;
+}
+
+void vote_tally_index::update_account( const account_object& a )
+{
+   opinion& o = _opinions[a.id.instance()];
+   if( !o.present || o.votes != a.options.votes || o.num_miner != a.options.num_miner )
+   {
+      add_opinion_votes( o, -o.stake );
+      o.present = true;
+      o.votes = a.options.votes;
+      o.num_miner = a.options.num_miner;
+      add_opinion_votes( o, o.stake );
+   }
+
+   const voter& v = _voters[a.id.instance()];
+   const account_id_type opinion_account = a.options.voting_account == GRAPHENE_PROXY_TO_SELF_ACCOUNT ? a.get_id() : a.options.voting_account;
+   if( !v.present || v.opinion_account != opinion_account || v.cashback_vb != a.cashback_vb )
+   {
+      if( v.cashback_vb.valid() )
+         _cashback_owners.erase( v.cashback_vb->instance.value );
+      if( a.cashback_vb.valid() )
+         _cashback_owners[a.cashback_vb->instance.value] = a.get_id();
+      change_voter( a.get_id(), [&]( voter& changed ) {
+         changed.present = true;
+         changed.opinion_account = opinion_account;
+         changed.cashback_vb = a.cashback_vb;
+      });
+   }
+}
+
+void vote_tally_index::object_inserted( const object& obj )
+{
+   update_account( static_cast<const account_object&>( obj ) );
+}
+
+void vote_tally_index::object_modified( const object& after )
+{
+   update_account( static_cast<const account_object&>( after ) );
+}
+
+void vote_tally_index::object_removed( const object& obj )
+{
+   const account_object& a = static_cast<const account_object&>( obj );
+   opinion& o = _opinions[a.id.instance()];
+   add_opinion_votes( o, -o.stake );
+   o.present = false;
+
+   const voter& v = _voters[a.id.instance()];
+   if( v.cashback_vb.valid() )
+      _cashback_owners.erase( v.cashback_vb->instance.value );
+   change_voter( a.get_id(), []( voter& changed ) {
+      changed.present = false;
+      changed.cashback_vb.reset();
+   });
+}
+
+void vote_tally_index::update( const account_balance_object& balance )
+{
+   if( balance.asset_type != asset_id_type() )
+      return;
+   change_voter( balance.owner, [&]( voter& v ) { v.core_balance = balance.balance; } );
+}
+
+void vote_tally_index::remove( const account_balance_object& balance )
+{
+   if( balance.asset_type != asset_id_type() )
+      return;
+   change_voter( balance.owner, []( voter& v ) { v.core_balance = 0; } );
+}
+
+void vote_tally_index::update( const account_statistics_object& stats )
+{
+   change_voter( stats.owner, [&]( voter& v ) { v.core_in_orders = stats.total_core_in_orders; } );
+}
+
+void vote_tally_index::remove( const account_statistics_object& stats )
+{
+   change_voter( stats.owner, []( voter& v ) { v.core_in_orders = 0; } );
+}
+
+void vote_tally_index::update( const vesting_balance_object& vesting )
+{
+   auto owner = _cashback_owners.find( vesting.id.instance() );
+   if( owner == _cashback_owners.end() )
+   {
+      _vesting_balances[vesting.id.instance()] = vesting.balance.amount;
+      return;
+   }
+   change_voter( owner->second, [&]( voter& ) { _vesting_balances[vesting.id.instance()] = vesting.balance.amount; } );
+}
+
+void vote_tally_index::remove( const vesting_balance_object& vesting )
+{
+   auto owner = _cashback_owners.find( vesting.id.instance() );
+   if( owner == _cashback_owners.end() )
+   {
+      _vesting_balances.erase( vesting.id.instance() );
+      return;
+   }
+   change_voter( owner->second, [&]( voter& ) { _vesting_balances.erase( vesting.id.instance() ); } );
+}
+
+share_type vote_tally_index::votes( uint32_t offset )const
+{
+   return offset < _votes.size() ? _votes[offset] : share_type(0);
+}
+
+} } // graphene::chain
@@ -28,7 +28,13 @@
 #include <fc/io/raw.hpp>
 #include <fc/io/json.hpp>
 #include <fc/crypto/sha256.hpp>
+#include <fc/filesystem.hpp>
+
+#include <atomic>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <thread>
 
 namespace graphene { namespace db {
    class object_database;
@@ -95,8 +101,21 @@ namespace graphene { namespace db {
           *  Opens the index loading objects from a file
           */
          virtual void open( const fc::path& db ) = 0;
+
+         /**
+          *  Reads and decodes the objects saved in a file, using up to @ref threads threads. This doesn't touch
+          *  the index and may run on any thread, the returned function inserts the decoded objects and has to be
+          *  called where open() would be.
+          */
+         virtual std::function<void()> read( const fc::path& db, unsigned threads ) = 0;
          virtual void save( const fc::path& db ) = 0;
 
+         /**
+          * @return counter which changes whenever the content written by save() changes, so that unchanged
+          * indexes don't need to be saved again
+          */
+         virtual uint64_t get_revision()const = 0;
+
 
 
          /** @return the object with id or nullptr if not found */
@@ -165,10 +184,12 @@ namespace graphene { namespace db {
          /** called just after obj is modified */
          void on_modify( const object& obj );
 
-         template<typename T>
-         void add_secondary_index()
+         template<typename T, typename... Args>
+         T* add_secondary_index( Args&&... args )
          {
-            _sindex.emplace_back( new T() );
+            T* result = new T( std::forward<Args>(args)... );
+            _sindex.emplace_back( result );
+            return result;
          }
 
          template<typename T>
@@ -214,8 +235,10 @@ namespace graphene { namespace db {
          { return object_type::type_id; }
 
          virtual object_id_type get_next_id()const override              { return _next_id;    }
-         virtual void           use_next_id()override                    { ++_next_id.number;  }
-         virtual void           set_next_id( object_id_type id )override { _next_id = id;      }
+         virtual void           use_next_id()override                    { ++_next_id.number; ++_revision; }
+         virtual void           set_next_id( object_id_type id )override { _next_id = id; ++_revision; }
+
+         virtual uint64_t       get_revision()const override             { return _revision;   }
 
          fc::sha256 get_object_version()const
          {
@@ -224,52 +247,114 @@ namespace graphene { namespace db {
          }
 
          virtual void open( const path& db )override
+         {
+            read( db, 1 )();
+         }
+
+         virtual std::function<void()> read( const path& db, unsigned threads )override
          { try{
-            if( !fc::exists( db ) ) return;
+            if( !fc::exists( db ) ) return [](){};
             fc::file_mapping fm( db.generic_string().c_str(), fc::read_only );
             fc::mapped_region mr( fm, fc::read_only, 0, fc::file_size(db) );
             fc::datastream<const char*> ds( (const char*)mr.get_address(), mr.get_size() );
+            object_id_type next_id;
             fc::sha256 open_ver;
 
-            fc::raw::unpack(ds, _next_id);
+            fc::raw::unpack(ds, next_id);
             fc::raw::unpack(ds, open_ver);
             FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
+
+            // find where the objects are first, so that they can be decoded in parallel
+            std::vector< std::pair<const char*, uint32_t> > records;
             try {
-               vector<char> tmp;
-               while( true ) 
+               while( ds.remaining() > 0 )
                {
-                  fc::raw::unpack( ds, tmp );
-                  load( tmp );
+                  fc::unsigned_int size;
+                  fc::raw::unpack( ds, size );
+                  FC_ASSERT( ds.remaining() >= size.value );
+                  records.emplace_back( ds.pos(), size.value );
+                  ds.skip( size.value );
                }
             } catch ( const fc::exception&  ){}
+
+            auto objects = std::make_shared< std::vector<object_type> >( records.size() );
+            std::atomic<size_t> first_invalid( records.size() );
+            auto decode = [&]( size_t begin, size_t end )
+            {
+               for( size_t i = begin; i < end; ++i )
+               {
+                  try {
+                     fc::datastream<const char*> rs( records[i].first, records[i].second );
+                     fc::raw::unpack( rs, (*objects)[i] );
+                  } catch ( ... ) {
+                     // as with a truncated file, everything from the first broken object on is dropped
+                     size_t current = first_invalid.load();
+                     while( i < current && !first_invalid.compare_exchange_weak( current, i ) );
+                     return;
+                  }
+               }
+            };
+
+            threads = std::max<size_t>( 1, std::min<size_t>( threads, records.size() / 1024 ) );
+            const size_t chunk = ( records.size() + threads - 1 ) / threads;
+            std::vector<std::thread> workers;
+            for( unsigned t = 1; t < threads; ++t )
+               workers.emplace_back( decode, std::min( t * chunk, records.size() ), std::min( (t + 1) * chunk, records.size() ) );
+            decode( 0, std::min( chunk, records.size() ) );
+            for( auto& worker : workers )
+               worker.join();
+            objects->resize( first_invalid.load() );
+
+            return [this, next_id, objects]()
+            {
+               _next_id = next_id;
+               for( auto& obj : *objects )
+                  load_object( std::move(obj) );
+            };
          }FC_CAPTURE_AND_RETHROW((db))}
 
          virtual void save( const path& db ) override 
          {
-            std::ofstream out( db.generic_string(), 
-                               std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
-            FC_ASSERT( out );
-            auto ver  = get_object_version();
-            fc::raw::pack( out, _next_id );
-            fc::raw::pack( out, ver );
-            this->inspect_all_objects( [&]( const object& o ) {
-                auto vec = fc::raw::pack( static_cast<const object_type&>(o) );
-                auto packed_vec = fc::raw::pack( vec );
-                out.write( packed_vec.data(), packed_vec.size() );
-            });
+            // write a new file and rename it over the old one, the old one may be hard linked into a snapshot
+            const path tmp( db.generic_string() + ".tmp" );
+            {
+               std::ofstream out( tmp.generic_string(),
+                                  std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+               FC_ASSERT( out );
+               auto ver  = get_object_version();
+               fc::raw::pack( out, _next_id );
+               fc::raw::pack( out, ver );
+               this->inspect_all_objects( [&]( const object& o ) {
+                   // same layout as packing the packed object as a vector, without building it
+                   const auto& obj = static_cast<const object_type&>(o);
+                   fc::raw::pack( out, fc::unsigned_int( fc::raw::pack_size( obj ) ) );
+                   fc::raw::pack( out, obj );
+               });
+               out.flush();
+               FC_ASSERT( out, "Failed to write ${f}", ("f", tmp) );
+            }
+            fc::rename( tmp, db );
          }
 
          virtual const object&  load( const std::vector<char>& data )override
          {
-            const auto& result = DerivedIndex::insert( fc::raw::unpack<object_type>( data ) );
+            return load_object( fc::raw::unpack<object_type>( data ) );
+         }
+
+
+         virtual const object&  insert( object&& obj )override
+         {
+            ++_revision;
+            // objects are inserted when undoing their removal, the secondary indexes need them back too
+            const auto& result = DerivedIndex::insert( std::move(obj) );
             for( const auto& item : _sindex )
                item->object_inserted( result );
             return result;
          }
 
-
          virtual const object&  create(const std::function<void(object&)>& constructor )override
          {
+            ++_revision;
             const auto& result = DerivedIndex::create( constructor );
             for( const auto& item : _sindex )
                item->object_inserted( result );
@@ -279,6 +364,7 @@ namespace graphene { namespace db {
 
          virtual void  remove( const object& obj ) override
          {
+            ++_revision;
             for( const auto& item : _sindex )
                item->object_removed( obj );
             on_remove(obj);
@@ -287,6 +373,7 @@ namespace graphene { namespace db {
 
          virtual void modify( const object& obj, const std::function<void(object&)>& m )override
          {
+            ++_revision;
             save_undo( obj );
             for( const auto& item : _sindex )
                item->about_to_modify( obj );
@@ -320,7 +407,16 @@ namespace graphene { namespace db {
          }
 
       private:
+         const object& load_object( object_type&& obj )
+         {
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            for( const auto& item : _sindex )
+               item->object_inserted( result );
+            return result;
+         }
+
          object_id_type _next_id;
+         uint64_t       _revision = 0;
    };
 
 } } // graphene::db
@@ -26,6 +26,7 @@
 #include <graphene/db/index.hpp>
 #include <graphene/db/undo_database.hpp>
 
+#include <fc/crypto/sha256.hpp>
 #include <fc/log/logger.hpp>
 
 #include <map>
@@ -44,13 +45,43 @@ namespace graphene { namespace db {
 
          void reset_indexes() { _index.clear(); _index.resize(255); }
 
-         void open(const fc::path& data_dir );
+         /**
+          * @param snapshot_dir if set, the indexes are loaded from this directory written by save_snapshot()
+          * instead of from the object_database directory in @ref data_dir
+          */
+         void open(const fc::path& data_dir, const fc::path& snapshot_dir = fc::path() );
 
          /**
           * Saves the complete state of the object_database to disk, this could take a while
           */
          void flush();
-         void wipe(const fc::path& data_dir); // remove from disk
+
+         /**
+          * Describes the index files written into a directory by save_snapshot()
+          */
+         struct snapshot_info
+         {
+            fc::path dir;
+            /// revision and, once known, file hash of every saved index, keyed by space and type
+            std::map< std::pair<uint8_t,uint8_t>, std::pair<uint64_t, fc::optional<fc::sha256>> > indexes;
+
+            /** @return the same value as snapshot_checksum() of @ref dir */
+            fc::sha256 checksum();
+         };
+
+         /**
+          * Saves the complete state of the object_database into @ref dir, using the same layout as flush().
+          *
+          * Only the indexes changed since @ref previous was saved are written, the files of the others are
+          * kept if @ref previous is the same directory, or hard linked from it otherwise.
+          */
+         snapshot_info save_snapshot( const fc::path& dir, const snapshot_info& previous = snapshot_info() );
+
+         /**
+          * @return hash of the index files of all registered indexes saved in @ref dir
+          */
+         fc::sha256 snapshot_checksum( const fc::path& dir )const;
+         void wipe(const fc::path& data_dir); // remove from disk and from memory
          void close();
 
          template<typename T, typename F>
@@ -163,8 +194,12 @@ namespace graphene { namespace db {
          void save_undo( const object& obj );
          void save_undo_add( const object& obj );
          void save_undo_remove( const object& obj );
+         /// removes every object from the registered indexes and restarts their ids, the indexes themselves stay
+         void clear_indexes();
 
          fc::path                                                  _data_dir;
+         /// what the object_database directory in _data_dir contains, flush() only writes what changed since
+         snapshot_info                                             _flushed;
          vector< vector< unique_ptr<index> > >                     _index;
    };
 
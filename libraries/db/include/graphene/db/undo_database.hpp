@@ -145,11 +145,27 @@ namespace graphene { namespace db {
          void merge();
          void commit();
 
+         /**
+          *  Finished undo states and the object copies they held are kept for reuse, so recording the first change
+          *  of an object in a session assigns into an earlier copy of the same type instead of allocating a new one,
+          *  and the hash tables of a new state start with the buckets of a previous one.
+          */
+         undo_state&        push_state();
+         void               recycle_state( undo_state& state );
+         unique_ptr<object> copy_object( const object& obj );
+         void               recycle_object( unique_ptr<object>&& obj );
+
+         static const size_t max_pooled_objects_per_type = 1024;
+         static const size_t max_pooled_states = 16;
+
          uint32_t                _active_sessions = 0;
          bool                    _disabled = true;
          std::deque<undo_state>  _stack;
          object_database&        _db;
          size_t                  _max_size = 256;
+
+         unordered_map<uint16_t, std::vector< unique_ptr<object> > > _object_pool; ///< by space and type id
+         std::vector<undo_state>                                     _state_pool;
    };
 
 } } // graphene::db
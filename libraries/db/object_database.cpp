@@ -24,10 +24,19 @@
  */
 #include <graphene/db/object_database.hpp>
 
+#include <fc/io/fstream.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/container/flat.hpp>
 #include <fc/uint128.hpp>
 
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <numeric>
+#include <thread>
+
 namespace graphene { namespace db {
 
 object_database::object_database()
@@ -74,14 +83,96 @@ void object_database::flush()
  //  ilog("Save object_database in ${d}", ("d", _data_dir));
    if( _data_dir.generic_string().size() == 0 )
       return;
+   _flushed = save_snapshot( _data_dir / "object_database", _flushed );
+}
+
+namespace {
+
+   fc::sha256 hash_file( const fc::path& file )
+   {
+      std::string content;
+      fc::read_file_contents( file, content );
+      return fc::sha256::hash( content );
+   }
+
+   void combine_checksum( fc::sha256::encoder& enc, uint32_t space, uint32_t type, const fc::sha256& file_hash )
+   {
+      fc::raw::pack( enc, space );
+      fc::raw::pack( enc, type );
+      fc::raw::pack( enc, file_hash );
+   }
+
+}
+
+fc::sha256 object_database::snapshot_info::checksum()
+{
+   fc::sha256::encoder enc;
+   for( auto& item : indexes )
+   {
+      if( !item.second.second )
+         item.second.second = hash_file( dir / fc::to_string(item.first.first) / fc::to_string(item.first.second) );
+      combine_checksum( enc, item.first.first, item.first.second, *item.second.second );
+   }
+   return enc.result();
+}
+
+object_database::snapshot_info object_database::save_snapshot( const fc::path& dir, const snapshot_info& previous )
+{
+   snapshot_info result;
+   result.dir = dir;
+   const bool same_dir = previous.dir == dir;
    for( uint32_t space = 0; space < _index.size(); ++space )
    {
-      fc::create_directories( _data_dir / "object_database" / fc::to_string(space) );
+      fc::create_directories( dir / fc::to_string(space) );
       const auto types = _index[space].size();
       for( uint32_t type = 0; type  <  types; ++type )
-         if( _index[space][type] )
-            _index[space][type]->save( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+      {
+         if( !_index[space][type] )
+            continue;
+         const auto key = std::make_pair( uint8_t(space), uint8_t(type) );
+         const uint64_t revision = _index[space][type]->get_revision();
+         const fc::path file = dir / fc::to_string(space)/fc::to_string(type);
+
+         auto prev = previous.indexes.find( key );
+         if( prev != previous.indexes.end() && prev->second.first == revision )
+         {
+            const fc::path prev_file = previous.dir / fc::to_string(space)/fc::to_string(type);
+            if( same_dir && fc::exists( file ) )
+            {
+               result.indexes[key] = prev->second;
+               continue;
+            }
+            if( !same_dir && fc::exists( prev_file ) )
+            {
+               boost::system::error_code ec;
+               boost::filesystem::create_hard_link( prev_file, file, ec );
+               if( ec )
+                  fc::copy( prev_file, file );
+               result.indexes[key] = prev->second;
+               continue;
+            }
+         }
+
+         _index[space][type]->save( file );
+         result.indexes[key] = std::make_pair( revision, fc::optional<fc::sha256>() );
+      }
    }
+   return result;
+}
+
+fc::sha256 object_database::snapshot_checksum( const fc::path& dir )const
+{
+   fc::sha256::encoder enc;
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+      {
+         if( !_index[space][type] )
+            continue;
+         const fc::path file = dir / fc::to_string(space)/fc::to_string(type);
+         FC_ASSERT( fc::exists( file ), "Missing index file ${f}", ("f", file) );
+         combine_checksum( enc, space, type, hash_file( file ) );
+      }
+   return enc.result();
 }
 
 void object_database::wipe(const fc::path& data_dir)
@@ -89,21 +180,122 @@ void object_database::wipe(const fc::path& data_dir)
    close();
    ilog("Wiping object database...");
    fc::remove_all(data_dir / "object_database");
+   _flushed = snapshot_info();
+   clear_indexes();
    ilog("Done wiping object databse.");
 }
 
+void object_database::clear_indexes()
+{
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type < _index[space].size(); ++type )
+      {
+         const auto& idx = _index[space][type];
+         if( !idx )
+            continue;
+         // objects are removed one by one, so that the secondary indexes forget them as well
+         std::vector<object_id_type> ids;
+         idx->inspect_all_objects( [&ids]( const object& obj ) { ids.push_back( obj.id ); } );
+         for( const object_id_type& id : ids )
+            idx->remove( *idx->find( id ) );
+         idx->set_next_id( object_id_type( space, type, 0 ) );
+      }
+}
+
 
-void object_database::open(const fc::path& data_dir)
+void object_database::open(const fc::path& data_dir, const fc::path& snapshot_dir)
 { try {
-   ilog("Opening object database from ${d} ...", ("d", data_dir));
+   const fc::path dir = snapshot_dir.generic_string().size() ? snapshot_dir : data_dir / "object_database";
+   ilog("Opening object database from ${d} ...", ("d", dir));
    _data_dir = data_dir;
+
+   struct index_load
+   {
+      uint32_t              space;
+      uint32_t              type;
+      fc::path              file;
+      uint64_t              size = 0;
+      std::function<void()> insert;
+      std::exception_ptr    error;
+      fc::microseconds      read_time;
+      fc::microseconds      insert_time;
+   };
+   std::vector<index_load> loads;
+   uint64_t total_size = 0;
    for( uint32_t space = 0; space < _index.size(); ++space )
       for( uint32_t type = 0; type  < _index[space].size(); ++type )
          if( _index[space][type] )
-            _index[space][type]->open( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+         {
+            index_load load;
+            load.space = space;
+            load.type = type;
+            load.file = dir / fc::to_string(space)/fc::to_string(type);
+            load.size = fc::exists( load.file ) ? fc::file_size( load.file ) : 0;
+            total_size += load.size;
+            loads.push_back( std::move( load ) );
+         }
+
+   // the files are read and decoded concurrently, biggest first, and the big ones are also decoded by
+   // several threads; the objects are then inserted one index after another, in the same order as before
+   std::vector<size_t> order( loads.size() );
+   std::iota( order.begin(), order.end(), 0 );
+   std::sort( order.begin(), order.end(), [&]( size_t a, size_t b ) { return loads[a].size > loads[b].size; } );
+
+   const unsigned worker_count = std::max( 1u, std::thread::hardware_concurrency() );
+   std::atomic<size_t> next_load( 0 );
+   auto read_indexes = [&]()
+   {
+      for( size_t n = next_load++; n < order.size(); n = next_load++ )
+      {
+         index_load& load = loads[ order[n] ];
+         const auto start = fc::time_point::now();
+         try {
+            const unsigned threads = load.size * worker_count >= total_size ? worker_count : 1;
+            load.insert = _index[load.space][load.type]->read( load.file, threads );
+         } catch( ... ) {
+            load.error = std::current_exception();
+         }
+         load.read_time = fc::time_point::now() - start;
+      }
+   };
+   std::vector<std::thread> workers;
+   for( unsigned i = 1; i < worker_count; ++i )
+      workers.emplace_back( read_indexes );
+   read_indexes();
+   for( auto& worker : workers )
+      worker.join();
+
+   for( index_load& load : loads )
+   {
+      if( load.error )
+         std::rethrow_exception( load.error );
+      const auto start = fc::time_point::now();
+      load.insert();
+      load.insert_time = fc::time_point::now() - start;
+   }
+
+   std::sort( loads.begin(), loads.end(), []( const index_load& a, const index_load& b ) {
+      return a.read_time + a.insert_time > b.read_time + b.insert_time;
+   });
+   for( size_t i = 0; i < loads.size() && i < 10 && loads[i].size > 0; ++i )
+      ilog( "Loaded index ${s}.${t}: ${b} bytes, read ${r} ms, insert ${i} ms",
+            ("s", loads[i].space)("t", loads[i].type)("b", loads[i].size)
+            ("r", loads[i].read_time.count() / 1000)("i", loads[i].insert_time.count() / 1000) );
+
+   // the files loaded from the object_database directory don't need to be written again until they change
+   _flushed = snapshot_info();
+   if( dir == data_dir / "object_database" )
+   {
+      _flushed.dir = dir;
+      for( uint32_t space = 0; space < _index.size(); ++space )
+         for( uint32_t type = 0; type  < _index[space].size(); ++type )
+            if( _index[space][type] )
+               _flushed.indexes[ std::make_pair( uint8_t(space), uint8_t(type) ) ] =
+                  std::make_pair( _index[space][type]->get_revision(), fc::optional<fc::sha256>() );
+   }
    ilog( "Done opening object database." );
 
-} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+} FC_CAPTURE_AND_RETHROW( (data_dir)(snapshot_dir) ) }
 
 
 void object_database::pop_undo()
@@ -38,9 +38,12 @@ undo_database::session undo_database::start_undo_session( bool force_enable )
       _disabled = false;
 
    while( size() > max_size() )
+   {
+      recycle_state( _stack.front() );
       _stack.pop_front();
+   }
 
-   _stack.emplace_back();
+   push_state();
    ++_active_sessions;
    return session(*this, disable_on_exit );
 }
@@ -49,7 +52,7 @@ void undo_database::on_create( const object& obj )
    if( _disabled ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      push_state();
    auto& state = _stack.back();
    auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
    auto itr = state.old_index_next_ids.find( index_id );
@@ -62,20 +65,20 @@ void undo_database::on_modify( const object& obj )
    if( _disabled ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      push_state();
    auto& state = _stack.back();
    if( state.new_ids.find(obj.id) != state.new_ids.end() )
       return;
    auto itr =  state.old_values.find(obj.id);
    if( itr != state.old_values.end() ) return;
-   state.old_values[obj.id] = obj.clone();
+   state.old_values[obj.id] = copy_object(obj);
 }
 void undo_database::on_remove( const object& obj )
 {
    if( _disabled ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      push_state();
    undo_state& state = _stack.back();
    if( state.new_ids.count(obj.id) )
    {
@@ -89,7 +92,7 @@ void undo_database::on_remove( const object& obj )
       return;
    }
    if( state.removed.count(obj.id) ) return;
-   state.removed[obj.id] = obj.clone();
+   state.removed[obj.id] = copy_object(obj);
 }
 
 void undo_database::undo()
@@ -117,9 +120,10 @@ void undo_database::undo()
    for( auto& item : state.removed )
       _db.insert( std::move(*item.second) );
 
+   recycle_state( state );
    _stack.pop_back();
    if( _stack.empty() )
-      _stack.emplace_back();
+      push_state();
    enable();
    --_active_sessions;
 } FC_CAPTURE_AND_RETHROW() }
@@ -235,6 +239,8 @@ void undo_database::merge()
       // nop + del(was=Y) -> del(was=Y)
       prev_state.removed[obj.second->id] = std::move(obj.second);
    }
+   // what was not taken over by prev_state (type A) is not needed anymore
+   recycle_state( state );
    _stack.pop_back();
    --_active_sessions;
 }
@@ -271,6 +277,7 @@ void undo_database::pop_commit()
       for( auto& item : state.removed )
          _db.insert( std::move(*item.second) );
 
+      recycle_state( state );
       _stack.pop_back();
    }
    catch ( const fc::exception& e )
@@ -281,6 +288,59 @@ void undo_database::pop_commit()
    }
    enable();
 }
+undo_state& undo_database::push_state()
+{
+   if( _state_pool.empty() )
+      _stack.emplace_back();
+   else
+   {
+      _stack.push_back( std::move( _state_pool.back() ) );
+      _state_pool.pop_back();
+   }
+   return _stack.back();
+}
+
+void undo_database::recycle_state( undo_state& state )
+{
+   for( auto& item : state.old_values )
+      recycle_object( std::move( item.second ) );
+   for( auto& item : state.removed )
+      recycle_object( std::move( item.second ) );
+
+   // clear() keeps the bucket arrays, so they are reused by the next state
+   state.old_values.clear();
+   state.old_index_next_ids.clear();
+   state.new_ids.clear();
+   state.removed.clear();
+   if( _state_pool.size() < max_pooled_states )
+      _state_pool.push_back( std::move( state ) );
+}
+
+unique_ptr<object> undo_database::copy_object( const object& obj )
+{
+   auto& pool = _object_pool[ (uint16_t(obj.id.space()) << 8) | obj.id.type() ];
+   if( pool.empty() )
+      return obj.clone();
+
+   unique_ptr<object> result = std::move( pool.back() );
+   pool.pop_back();
+   result->copy_from( obj );
+   return result;
+}
+
+void undo_database::recycle_object( unique_ptr<object>&& obj )
+{
+   // entries moved into another state, or objects moved back into the database by undo, leave a null pointer
+   // or an empty shell behind; the shell is still good for copy_from
+   if( !obj )
+      return;
+   auto& pool = _object_pool[ (uint16_t(obj->id.space()) << 8) | obj->id.type() ];
+   if( pool.size() < max_pooled_objects_per_type )
+      pool.push_back( std::move( obj ) );
+   else
+      obj.reset();
+}
+
 const undo_state& undo_database::head()const
 {
    FC_ASSERT( !_stack.empty() );
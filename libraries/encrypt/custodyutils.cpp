@@ -8,10 +8,17 @@
 #include <fc/crypto/sha256.hpp>
 #include <sstream>
 #include <iomanip>
-#include <fc/thread/thread.hpp>
+#include <fc/interprocess/file_mapping.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 
-#define DECENT_CUSTODY_THREADS 4
 //#define _CUSTODY_STATS
 namespace decent {
 namespace encrypt {
@@ -27,7 +34,7 @@ std::string bytes_to_string(unsigned char *data, int len) {
    return ss.str();
 }
 
-void string_to_bytes(std::string &in, unsigned char data[], int len) {
+void string_to_bytes(const std::string &in, unsigned char data[], int len) {
 
    const char *s = in.c_str();
    for( int i = 0; i < len && i * 2 < in.size(); ++i ) {
@@ -38,6 +45,61 @@ void string_to_bytes(std::string &in, unsigned char data[], int len) {
       data[i] = res;
    }
 }
+/*
+ * Range of work items owned by one worker of WorkerPool::run
+ */
+struct WorkRange {
+   std::mutex mutex;
+   uint64_t begin = 0;
+   uint64_t end = 0;
+};
+
+unsigned get_number_of_workers() {
+   unsigned workers = std::thread::hardware_concurrency();
+   return workers ? workers : DECENT_CUSTODY_THREADS;
+}
+
+bool take_work(WorkRange &range, uint64_t grain, uint64_t &begin, uint64_t &end) {
+   std::lock_guard<std::mutex> guard(range.mutex);
+   if( range.begin == range.end )
+      return false;
+   begin = range.begin;
+   end = std::min(range.end, range.begin + grain);
+   range.begin = end;
+   return true;
+}
+
+bool steal_work(WorkRange ranges[], unsigned workers, unsigned thief, uint64_t grain) {
+   //pick the worker with the most remaining work and take the upper half of its range
+   unsigned victim = thief;
+   uint64_t most = grain;
+   for( unsigned w = 0; w < workers; ++w ) {
+      if( w == thief )
+         continue;
+      std::lock_guard<std::mutex> guard(ranges[w].mutex);
+      if( ranges[w].end - ranges[w].begin > most ) {
+         most = ranges[w].end - ranges[w].begin;
+         victim = w;
+      }
+   }
+   if( victim == thief )
+      return false;
+
+   uint64_t begin, end;
+   {
+      std::lock_guard<std::mutex> guard(ranges[victim].mutex);
+      if( ranges[victim].end - ranges[victim].begin <= grain )
+         return true; //someone was faster, look again
+      begin = ranges[victim].begin + (ranges[victim].end - ranges[victim].begin) / 2;
+      end = ranges[victim].end;
+      ranges[victim].end = begin;
+   }
+   std::lock_guard<std::mutex> guard(ranges[thief].mutex);
+   ranges[thief].begin = begin;
+   ranges[thief].end = end;
+   return true;
+}
+
 #ifdef _CUSTODY_STATS
 int mul = 0;
 int pow = 0;
@@ -46,7 +108,149 @@ int add = 0;
 #endif
 }
 
-CustodyUtils::CustodyUtils() {
+/*
+ * Persistent threads running work stealing loops. A loop is split among the calling thread and the pool threads
+ * that are idle, the calling thread takes over the shares no pool thread picked up.
+ */
+class WorkerPool {
+public:
+   explicit WorkerPool(unsigned threads) {
+      for( unsigned i = 0; i < threads; ++i )
+         _threads.emplace_back([this]() { thread_main(); });
+   }
+
+   ~WorkerPool() {
+      {
+         std::lock_guard<std::mutex> guard(_mutex);
+         _stop = true;
+      }
+      _wake.notify_all();
+      for( auto &t : _threads )
+         t.join();
+   }
+
+   /*
+    * Maximal number of workers of a loop, the calling thread included
+    */
+   unsigned size() const { return _threads.size() + 1; }
+
+   /*
+    * Calls task(worker, begin, end) for consecutive sub-ranges of [0, count) on up to workers threads. Every worker
+    * starts with an equal share and steals from the busiest one when it runs out.
+    */
+   void run(uint64_t count, unsigned workers, uint64_t grain, const std::function<void(unsigned, uint64_t, uint64_t)> &task) {
+      if( count == 0 )
+         return;
+      workers = (unsigned) std::max<uint64_t>(1, std::min<uint64_t>(std::min(workers, size()), (count + grain - 1) / grain));
+
+      std::unique_ptr<WorkRange[]> ranges(new WorkRange[workers]);
+      for( unsigned w = 0; w < workers; ++w ) {
+         ranges[w].begin = count * w / workers;
+         ranges[w].end = count * (w + 1) / workers;
+      }
+
+      std::mutex error_mutex;
+      std::exception_ptr error;
+
+      Job job;
+      job.slots = workers;
+      job.work = [&](unsigned w) {
+         try {
+            uint64_t begin, end;
+            while( true ) {
+               if( take_work(ranges[w], grain, begin, end))
+                  task(w, begin, end);
+               else if( !steal_work(ranges.get(), workers, w, grain))
+                  break;
+            }
+         } catch( ... ) {
+            std::lock_guard<std::mutex> guard(error_mutex);
+            if( !error )
+               error = std::current_exception();
+         }
+      };
+
+      if( workers > 1 ) {
+         {
+            std::lock_guard<std::mutex> guard(_mutex);
+            _jobs.push_back(&job);
+         }
+         _wake.notify_all();
+      }
+      job.work(0);
+
+      //a share nobody started may still hold up to grain items
+      unsigned slot;
+      while( claim_slot(job, slot) ) {
+         job.work(slot);
+         finish_slot(job);
+      }
+      {
+         std::unique_lock<std::mutex> lock(_mutex);
+         _done.wait(lock, [&job]() { return job.active == 0; });
+      }
+
+      if( error )
+         std::rethrow_exception(error);
+   }
+
+private:
+   struct Job {
+      std::function<void(unsigned)> work;
+      unsigned slots = 1;
+      unsigned next_slot = 1; //slot 0 belongs to the calling thread
+      unsigned active = 0;
+   };
+
+   bool claim_slot(Job &job, unsigned &slot) {
+      std::lock_guard<std::mutex> guard(_mutex);
+      if( job.next_slot == job.slots )
+         return false;
+      slot = job.next_slot++;
+      ++job.active;
+      if( job.next_slot == job.slots )
+         _jobs.erase(std::find(_jobs.begin(), _jobs.end(), &job));
+      return true;
+   }
+
+   void finish_slot(Job &job) {
+      {
+         std::lock_guard<std::mutex> guard(_mutex);
+         --job.active;
+      }
+      _done.notify_all();
+   }
+
+   void thread_main() {
+      while( true ) {
+         Job *job;
+         unsigned slot;
+         {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+            if( _stop )
+               return;
+            job = _jobs.front();
+            slot = job->next_slot++;
+            ++job->active;
+            if( job->next_slot == job->slots )
+               _jobs.pop_front();
+         }
+         job->work(slot);
+         finish_slot(*job);
+      }
+   }
+
+   std::mutex               _mutex;
+   std::condition_variable  _wake;
+   std::condition_variable  _done;
+   std::deque<Job*>         _jobs;
+   bool                     _stop = false;
+   std::vector<std::thread> _threads;
+};
+
+CustodyUtils::CustodyUtils() : _workers(new WorkerPool(get_number_of_workers() - 1)), _cache_capacity(DECENT_CUSTODY_CACHE_CAPACITY),
+                               _cache_hits(0), _cache_misses(0) {
    pairing_init_set_str(pairing, _DECENT_PAIRING_PARAM_);
 
    element_init_G1(generator, pairing);
@@ -55,6 +259,8 @@ CustodyUtils::CustodyUtils() {
 }
 
 CustodyUtils::~CustodyUtils() {
+   _cache_index.clear();
+   _cache.clear();
    element_clear(generator);
    pairing_clear(pairing);
 #ifdef _CUSTODY_STATS
@@ -63,6 +269,91 @@ CustodyUtils::~CustodyUtils() {
 }
 
 
+CustodyUtils::CacheEntry::CacheEntry(CustodyUtils &cu, const char *u_seed, const unsigned char *pubKey, uint32_t sectors)
+   : sectors(sectors) {
+   char buf_str[32 + 1];
+   char *buf_ptr = buf_str;
+   for( int i = 0; i < 16; i++ ) {
+      buf_ptr += sprintf(buf_ptr, "%X", (unsigned char) u_seed[i]);
+   }
+   buf_str[32] = 0;
+
+   mpz_t seedForU;
+   mpz_init_set_str(seedForU, buf_str, 16);
+   u = new element_t[sectors];
+   cu.get_u_from_seed(seedForU, u, sectors);
+   mpz_clear(seedForU);
+
+   u_pp = new element_pp_t[sectors];
+   cu.init_u_pp(u, u_pp, sectors);
+
+   element_init_G1(public_key, cu.pairing);
+   element_from_bytes_compressed(public_key, (unsigned char *) pubKey);
+   pairing_pp_init(public_key_pp, public_key, cu.pairing);
+}
+
+CustodyUtils::CacheEntry::~CacheEntry() {
+   pairing_pp_clear(public_key_pp);
+   element_clear(public_key);
+   for( int k = 0; k < sectors; k++ ) {
+      element_pp_clear(u_pp[k]);
+      element_clear(u[k]);
+   }
+   delete[] u_pp;
+   delete[] u;
+}
+
+bool CustodyUtils::is_valid_sectors(uint32_t sectors) {
+   return sectors == DECENT_SECTORS || sectors == DECENT_SECTORS_BIG;
+}
+
+std::shared_ptr<CustodyUtils::CacheEntry> CustodyUtils::get_cache_entry(const char *u_seed, const unsigned char *pubKey, uint32_t sectors) {
+   //the number of sectors comes from the proof, never build (or cache) tables for arbitrary ones
+   FC_ASSERT( is_valid_sectors(sectors), "Invalid number of sectors ${s}", ("s", sectors) );
+   std::string key(u_seed, 16);
+   key.append((const char *) pubKey, DECENT_SIZE_OF_POINT_ON_CURVE_COMPRESSED);
+   key.append((const char *) &sectors, sizeof(sectors));
+
+   {
+      std::lock_guard<std::mutex> guard(_cache_mutex);
+      auto it = _cache_index.find(key);
+      if( it != _cache_index.end() ) {
+         _cache.splice(_cache.begin(), _cache, it->second);
+         ++_cache_hits;
+         return it->second->second;
+      }
+   }
+
+   ++_cache_misses;
+   //entries in use stay alive through the shared pointer even if they get evicted meanwhile
+   std::shared_ptr<CacheEntry> entry = std::make_shared<CacheEntry>(*this, u_seed, pubKey, sectors);
+
+   std::lock_guard<std::mutex> guard(_cache_mutex);
+   if( _cache_capacity == 0 || _cache_index.count(key) )
+      return entry;
+   _cache.emplace_front(key, entry);
+   _cache_index[key] = _cache.begin();
+   while( _cache.size() > _cache_capacity ) {
+      _cache_index.erase(_cache.back().first);
+      _cache.pop_back();
+   }
+   return entry;
+}
+
+CustodyUtils::CacheStats CustodyUtils::get_cache_stats() const {
+   std::lock_guard<std::mutex> guard(_cache_mutex);
+   return CacheStats{ _cache_hits, _cache_misses, _cache.size(), _cache_capacity };
+}
+
+void CustodyUtils::set_cache_capacity(size_t capacity) {
+   std::lock_guard<std::mutex> guard(_cache_mutex);
+   _cache_capacity = capacity;
+   while( _cache.size() > _cache_capacity ) {
+      _cache_index.erase(_cache.back().first);
+      _cache.pop_back();
+   }
+}
+
 int CustodyUtils::get_u_from_seed(const mpz_t &seedU, element_t out[], uint32_t sectors) {
    mpz_t seed;
    mpz_t seed_tmp;
@@ -101,28 +392,6 @@ int CustodyUtils::get_n(std::fstream &file, uint32_t sectors) {
    return n;
 }
 
-inline int CustodyUtils::get_data(std::fstream &file, uint32_t i, char buffer[], uint32_t sectors) {
-   uint64_t position = DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * sectors * i;
-
-   file.seekg(0, file.end);
-   uint64_t realLen = file.tellg();
-   file.seekg(std::min(position, realLen), file.beg);
-
-   if( realLen > ((long long) (file.tellg()) + DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * sectors))
-      file.read(buffer, DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * sectors);
-   else {
-      if( file.eof())
-         memset(buffer, 0, DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * sectors);
-      else {
-         int left = realLen - (long long) (file.tellg());
-         file.read(buffer, left);
-         memset(buffer + left, 0, (DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * sectors) - left);
-      }
-   }
-   return 0;
-}
-
-
 inline int CustodyUtils::get_m(std::fstream &file, uint32_t i, uint32_t j, mpz_t &out, uint32_t sectors) {
    mpz_init2(out, DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * 8);
    uint64_t position = DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * (j + sectors * i);
@@ -149,32 +418,44 @@ inline int CustodyUtils::get_m(std::fstream &file, uint32_t i, uint32_t j, mpz_t
    return 1;
 }
 
-int CustodyUtils::get_sigma(uint64_t idx, mpz_t mi[], element_pp_t u_pp[], element_t pk, element_t out[], uint32_t sectors) {
-   element_t temp;
+CustodyUtils::SigmaScratch::SigmaScratch(pairing_t pairing, uint32_t sectors) : sectors(sectors) {
+   m = new mpz_t[sectors];
+   for( int i = 0; i < sectors; ++i )
+      mpz_init2(m[i], DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * 8);
    element_init_G1(temp, pairing);
-   element_init_G1(out[idx], pairing);
-   {
-      int j=0;
-      element_pp_pow(out[idx], mi[j], u_pp[j]);
+   element_init_G1(hash, pairing);
+}
+
+CustodyUtils::SigmaScratch::~SigmaScratch() {
+   for( int i = 0; i < sectors; ++i )
+      mpz_clear(m[i]);
+   delete[] m;
+   element_clear(temp);
+   element_clear(hash);
+}
+
+void CustodyUtils::SigmaScratch::load(const char *block) {
+   for( int i = 0; i < sectors; ++i ) {
+      //mpz_import is too slow for our purposes - since we don't care about the exact parameters as much as about the uniqueness of the import, let's replace it with memcpy
+      memcpy((char *) m[i]->_mp_d, block + i * DECENT_SIZE_OF_NUMBER_IN_THE_FIELD, DECENT_SIZE_OF_NUMBER_IN_THE_FIELD);
+      m[i]->_mp_size = DECENT_MP_SIZE_OF_NUMBER_IN_THE_FIELD;
+   }
+}
+
+int CustodyUtils::get_sigma(uint64_t idx, SigmaScratch &scratch, element_pp_t u_pp[], element_t pk, element_t out, uint32_t sectors) {
+   element_init_G1(out, pairing);
+   element_pp_pow(out, scratch.m[0], u_pp[0]);
 #ifdef _CUSTODY_STATS
-      pow_pp++;
+   pow_pp++;
 #endif
-   }
    for( int j = 1; j < sectors; j++ ) {
-      element_pp_pow(temp, mi[j], u_pp[j]);
+      element_pp_pow(scratch.temp, scratch.m[j], u_pp[j]);
+      element_mul(out, out, scratch.temp);
 #ifdef _CUSTODY_STATS
       pow_pp++;
-#endif
-      mpz_clear(mi[j]);
-      element_mul(out[idx], out[idx], temp);
-#ifdef _CUSTODY_STATS
       mul++;
 #endif
    }
-   element_clear(temp);
-
-   element_t hash;
-   element_init_G1(hash, pairing);
 
    char index[16];
    memset(index, 0, 16);
@@ -185,72 +466,49 @@ int CustodyUtils::get_sigma(uint64_t idx, mpz_t mi[], element_pp_t u_pp[], eleme
    fc::sha256 stemp = fc::sha256::hash(index, 16);
    memcpy(buf, stemp._hash, (4 * sizeof(uint64_t)));
 
-   element_from_hash(hash, buf, 32);
-   element_mul(out[idx], out[idx], hash);
-   element_pow_zn(out[idx], out[idx], pk);
+   element_from_hash(scratch.hash, buf, 32);
+   element_mul(out, out, scratch.hash);
+   element_pow_zn(out, out, pk);
 #ifdef _CUSTODY_STATS
    pow++;
    mul++;
 #endif
-   element_clear(hash);
    return 1;
 }
 
-int
-CustodyUtils::get_sigmas(std::fstream &file, const unsigned int n, element_t *u, element_t pk, element_t **sigmas, uint32_t sectors) {
-   element_t *ret = new element_t[n];
-   //start threads
-   fc::thread t[DECENT_CUSTODY_THREADS];
-   fc::future<int> fut[DECENT_CUSTODY_THREADS];
-   fc::future<void> fut_pp[DECENT_CUSTODY_THREADS];
-
-   element_pp_t *u_pp = new element_pp_t[sectors];
-   for( int k = 0; k < sectors; k++ ) {
-      int idx = k % DECENT_CUSTODY_THREADS;
-      fut_pp[idx] = t[idx].async([=](){ element_pp_init(u_pp[k], u[k]); return; });
-   }
-   //wait for the threads...
-   for( int k = 0; k < DECENT_CUSTODY_THREADS; ++k )
-      fut_pp[k].wait();
-
-//   std::cout<<"get_sigmas: n = "<<n<<" , cycles = " << cycles <<"\n";
-   int total_thread_to_wait_for = std::min( n, (const unsigned int) DECENT_CUSTODY_THREADS );
-
-   for( uint64_t i = 0; i < n; i += DECENT_CUSTODY_THREADS ) {
-      int iterations = std::min ((uint64_t) DECENT_CUSTODY_THREADS, n - i ); 
-      for( int k = 0; k < iterations ; ++k ) {
-         uint64_t idx = i + k;
-
-         //we read the file in the main thread...
-         char *buffer = new char[(DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * sectors)];
-         get_data(file, idx, buffer, sectors);
-         //and distribute the tasks
-         fut[k] = t[k].async([=]() {
-              mpz_t *m = new mpz_t[sectors];
-              for( int i = 0; i < sectors; ++i ) {
-                 mpz_init2(m[i], DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * 8);
-                 //mpz_import is too slow for our purposes - since we don't care about the exact parameters as much as about the uniqueness of the import, let's replace it with memcpy
-                 memcpy((char *) m[i]->_mp_d, buffer + i * DECENT_SIZE_OF_NUMBER_IN_THE_FIELD,
-                        DECENT_SIZE_OF_NUMBER_IN_THE_FIELD);
-                 m[i]->_mp_size = DECENT_MP_SIZE_OF_NUMBER_IN_THE_FIELD;
-                 //mpz_import(m[i], DECENT_SIZE_OF_NUMBER_IN_THE_FIELD, 1, 1, 1, 0, buffer + i * DECENT_SIZE_OF_NUMBER_IN_THE_FIELD);
-              }
-              delete[] buffer;
-              auto res = get_sigma(idx, m, u_pp, pk, ret, sectors);
-              delete[](m);
-              return res;
-
-         });
-      }
-   }
-   //wait for the threads...
-   for( int k = 0; k < total_thread_to_wait_for; ++k )
-      fut[k].wait();
+void CustodyUtils::init_u_pp(element_t *u, element_pp_t *u_pp, uint32_t sectors) {
+   _workers->run(sectors, _workers->size(), 1, [=](unsigned, uint64_t begin, uint64_t end) {
+      for( uint64_t k = begin; k < end; ++k )
+         element_pp_init(u_pp[k], u[k]);
+   });
+}
 
-   *sigmas = ret;
-   for( int k = 0; k < sectors; k++ )
-      element_pp_clear(u_pp[k]);
-   delete[] u_pp;
+int CustodyUtils::get_sigmas(const char *data, uint64_t size, uint64_t first_idx, element_pp_t u_pp[], element_t pk,
+                             element_t sigmas[], uint32_t sectors) {
+   const uint64_t block_size = DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * sectors;
+   const uint64_t n = (size + block_size - 1) / block_size;
+   const unsigned workers = _workers->size();
+
+   //every worker reuses its own big numbers and temporaries for all the blocks it signs
+   std::vector<std::unique_ptr<SigmaScratch>> scratch(workers);
+
+   _workers->run(n, workers, 16, [&](unsigned w, uint64_t begin, uint64_t end) {
+      if( !scratch[w] )
+         scratch[w].reset(new SigmaScratch(pairing, sectors));
+
+      for( uint64_t i = begin; i < end; ++i ) {
+         const uint64_t position = i * block_size;
+         if( position + block_size <= size ) {
+            scratch[w]->load(data + position);
+         } else {
+            //the last block is padded with zeros
+            std::vector<char> buffer(block_size, 0);
+            memcpy(buffer.data(), data + position, size - position);
+            scratch[w]->load(buffer.data());
+         }
+         get_sigma(first_idx + i, *scratch[w], u_pp, pk, sigmas[i], sectors);
+      }
+   });
    return 0;
 }
 
@@ -322,6 +580,21 @@ int CustodyUtils::verify(element_t sigma, unsigned int q, uint64_t *indices, ele
    element_init_GT(res1, pairing);
    element_pairing(res1, sigma, generator);
 
+   element_t res2;
+   element_init_GT(res2, pairing);
+   element_t left2;
+   compute_left_side(left2, q, indices, v, u, mu, sectors);
+   element_pairing(res2, left2, pubk);
+
+   int res = element_cmp(res1, res2);
+   element_clear(res1);
+   element_clear(res2);
+   element_clear(left2);
+   return res;
+}
+
+int CustodyUtils::compute_left_side(element_t left, unsigned int q, uint64_t *indices, element_t *v, element_t *u,
+                                     element_t *mu, uint32_t sectors, element_pp_t *u_pp) {
    element_t multi1;
    element_init_G1(multi1, pairing);
 
@@ -355,11 +628,21 @@ int CustodyUtils::verify(element_t sigma, unsigned int q, uint64_t *indices, ele
    element_t multi2;
    element_init_G1(multi2, pairing);
 
+   mpz_t exponent;
+   mpz_init(exponent);
    for( int i = 0; i < sectors; i++ ) {
-      element_pow_zn(temp, u[i], mu[i]);
+      if( u_pp ) {
+         element_to_mpz(exponent, mu[i]);
+         element_pp_pow(temp, exponent, u_pp[i]);
 #ifdef _CUSTODY_STATS
-      pow++;
+         pow_pp++;
+#endif
+      } else {
+         element_pow_zn(temp, u[i], mu[i]);
+#ifdef _CUSTODY_STATS
+         pow++;
 #endif
+      }
       if( i ) {
          element_mul(multi2, multi2, temp);
 #ifdef _CUSTODY_STATS
@@ -368,27 +651,18 @@ int CustodyUtils::verify(element_t sigma, unsigned int q, uint64_t *indices, ele
       }else
          element_set(multi2, temp);
    }
+   mpz_clear(exponent);
    element_clear(temp);
 
-   element_t res2;
-   element_init_GT(res2, pairing);
-   element_t left2;
-   element_init_G1(left2, pairing);
-
-   element_mul(left2, multi1, multi2);
+   element_init_G1(left, pairing);
+   element_mul(left, multi1, multi2);
 #ifdef _CUSTODY_STATS
    mul++;
 #endif
-   element_pairing(res2, left2, pubk);
-
-   int res = element_cmp(res1, res2);
    element_clear(hash);
-   element_clear(res1);
-   element_clear(res2);
    element_clear(multi1);
    element_clear(multi2);
-   element_clear(left2);
-   return res;
+   return 0;
 }
 
 
@@ -431,35 +705,16 @@ int CustodyUtils::get_number_of_query(int blocks) {
 }
 
 
-int CustodyUtils::verify_by_miner(const uint32_t &n, const char *u_seed, unsigned char *pubKey, unsigned char sigma[],
-                                   std::vector<std::string> mus, mpz_t seed) {
-   uint32_t sectors = mus.size();
-   //prepate public_key and u
-   element_t public_key;
-   element_init_G1(public_key, pairing);
-   element_from_bytes_compressed(public_key, pubKey);
-   element_t *u = new element_t[sectors];
-
-   mpz_t seedForU;
-
-   char *buf_str = (char *) malloc(32 + 1);
-   char *buf_ptr = buf_str;
-
-   for( int i = 0; i < 16; i++ ) {
-      buf_ptr += sprintf(buf_ptr, "%X", (unsigned char) u_seed[i]);
-   }
-
-   mpz_init_set_str(seedForU, buf_str, 16);
-   free(buf_str);
-   get_u_from_seed(seedForU, u, sectors);
-
+int CustodyUtils::prepare_verification(const uint32_t &n, CacheEntry &content, const unsigned char sigma[],
+                                       const std::vector<std::string> &mus, mpz_t seed, element_t _sigma, element_t left) {
+   //the cache entry was looked up by mus.size(), which has been checked by the caller
+   uint32_t sectors = content.sectors;
 
    //prepare sigma and mu
-   element_t _sigma;
    element_t *mu = new element_t[sectors];
 
    element_init_G1(_sigma, pairing);
-   element_from_bytes_compressed(_sigma, sigma);
+   element_from_bytes_compressed(_sigma, (unsigned char *) sigma);
 
    for( int i = 0; i < sectors; i++ ) {
       element_init_Zr(mu[i], pairing);
@@ -474,26 +729,105 @@ int CustodyUtils::verify_by_miner(const uint32_t &n, const char *u_seed, unsigne
 
    generate_query_from_seed(seed, q, n, indices, &v);
 
-   int res = verify(_sigma, q, indices, v, u, mu, public_key, sectors);
+   compute_left_side(left, q, indices, v, content.u, mu, sectors, content.u_pp);
 
-   clear_elements(u, sectors);
    clear_elements(mu, sectors);
    clear_elements(v, q);
-   element_clear(public_key);
-   mpz_clear(seedForU);
-   element_clear(_sigma);
    delete[](v);
-   delete[](u);
    delete[](mu);
    delete[](indices);
+   return 0;
+}
+
+int CustodyUtils::verify_by_miner(const uint32_t &n, const char *u_seed, unsigned char *pubKey, unsigned char sigma[],
+                                   std::vector<std::string> mus, mpz_t seed) {
+   if( !is_valid_sectors(mus.size()) )
+      return -1;
+   std::shared_ptr<CacheEntry> content = get_cache_entry(u_seed, pubKey, mus.size());
+
+   element_t _sigma, left;
+   prepare_verification(n, *content, sigma, mus, seed, _sigma, left);
+
+   element_t res1, res2;
+   element_init_GT(res1, pairing);
+   element_init_GT(res2, pairing);
+   element_pairing(res1, _sigma, generator);
+   pairing_pp_apply(res2, left, content->public_key_pp);
+
+   int res = element_cmp(res1, res2);
+
+   element_clear(res1);
+   element_clear(res2);
+   element_clear(_sigma);
+   element_clear(left);
    return res;
 }
 
+int CustodyUtils::verify_by_miner(const std::vector<CustodyData> &cds, const std::vector<CustodyProof> &proofs) {
+   FC_ASSERT( cds.size() == proofs.size() );
+   const size_t count = proofs.size();
+   if( count == 0 )
+      return 0;
+   for( const CustodyProof& proof : proofs )
+      if( !is_valid_sectors(proof.mus.size()) )
+         return 1;
+
+   //every proof satisfies e(sigma_k, g) == e(left_k, pk_k). With random weights r_k all of them hold (with
+   //overwhelming probability) iff e(prod sigma_k^r_k, g) * prod e(left_k^-r_k, pk_k) == 1, which is a single
+   //multi-pairing sharing one final exponentiation
+   element_t *in1 = new element_t[count + 1];
+   element_t *in2 = new element_t[count + 1];
+
+   element_init_G1(in1[0], pairing);
+   element_set1(in1[0]);
+   element_init_G1(in2[0], pairing);
+   element_set(in2[0], generator);
+
+   element_t r, _sigma, left;
+   element_init_Zr(r, pairing);
+
+   for( size_t k = 0; k < count; ++k ) {
+      mpz_t s;
+      mpz_init(s);
+      mpz_import(s, 5, 1, sizeof(uint32_t), 0, 0, proofs[k].seed.data);
+      std::shared_ptr<CacheEntry> content = get_cache_entry((const char *) cds[k].u_seed.data, cds[k].pubKey.data,
+                                                            proofs[k].mus.size());
+      prepare_verification(cds[k].n, *content, proofs[k].sigma.data, proofs[k].mus, s, _sigma, left);
+      mpz_clear(s);
+
+      element_init_G1(in2[k + 1], pairing);
+      element_set(in2[k + 1], content->public_key);
+
+      element_random(r);
+
+      element_pow_zn(_sigma, _sigma, r);
+      element_mul(in1[0], in1[0], _sigma);
+
+      element_init_G1(in1[k + 1], pairing);
+      element_pow_zn(in1[k + 1], left, r);
+      element_invert(in1[k + 1], in1[k + 1]);
+
+      element_clear(_sigma);
+      element_clear(left);
+   }
+
+   element_t res;
+   element_init_GT(res, pairing);
+   element_prod_pairing(res, in1, in2, count + 1);
+   int ret = element_is1(res) ? 0 : 1;
+
+   element_clear(res);
+   element_clear(r);
+   clear_elements(in1, count + 1);
+   clear_elements(in2, count + 1);
+   delete[] in1;
+   delete[] in2;
+   return ret;
+}
+
 int CustodyUtils::create_custody_data(path content, uint32_t &n, char u_seed[], unsigned char pubKey[], uint32_t sectors) {
    //prepare the files
-   std::fstream infile(content.c_str(), std::fstream::binary | std::fstream::in);
    std::ofstream outfile((content.parent_path() / "content.cus").c_str(), std::fstream::binary | std::ios_base::trunc);
-   infile.seekg(0, infile.beg);
    outfile.seekp(0);
 
    //prepare elements _u, m, seedForU and keys
@@ -531,11 +865,24 @@ int CustodyUtils::create_custody_data(path content, uint32_t &n, char u_seed[],
 #endif
 
    //create the actual signatures in sigmas
-
-   //split_file(infile, n, &m);
-   n = get_n(infile, sectors);
-
-   get_sigmas(infile, n, u, private_key, &sigmas, sectors);
+   const uint64_t block_size = DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * sectors;
+   const uint64_t size = boost::filesystem::file_size(content);
+   n = (size + block_size - 1) / block_size;
+   sigmas = new element_t[n];
+
+   if( size ) {
+      element_pp_t *u_pp = new element_pp_t[sectors];
+      init_u_pp(u, u_pp, sectors);
+
+      //workers read the blocks directly from the mapped file
+      fc::file_mapping fm(content.string().c_str(), fc::read_only);
+      fc::mapped_region mr(fm, fc::read_only, 0, size);
+      get_sigmas((const char *) mr.get_address(), size, 0, u_pp, private_key, sigmas, sectors);
+
+      for( int k = 0; k < sectors; k++ )
+         element_pp_clear(u_pp[k]);
+      delete[] u_pp;
+   }
 
    //save the values to u_seed and pubKey
    element_to_bytes_compressed(pubKey, public_key);
@@ -555,10 +902,107 @@ int CustodyUtils::create_custody_data(path content, uint32_t &n, char u_seed[],
    delete[](sigmas);
    mpz_clear(seedForU);
    outfile.close();
-   infile.close();
    return 0;
 }
 
+CustodyUtils::CustodyDataStream::CustodyDataStream(const boost::filesystem::path& cus_file, uint32_t sectors)
+   : _utils(CustodyUtils::instance())
+   , _sectors(sectors)
+   , _block_size(DECENT_SIZE_OF_NUMBER_IN_THE_FIELD * sectors)
+   , _outfile(cus_file.c_str(), std::fstream::binary | std::ios_base::trunc)
+   , _n(0)
+{
+   if( !_outfile.is_open() ) {
+      FC_THROW("Unable to open file ${fn} for writing", ("fn", cus_file.string()) );
+   }
+
+   if( RAND_bytes((unsigned char *) _u_seed, 16) != 1 ) {
+      FC_THROW("Error creating random data");
+   }
+
+   char buf_str[32 + 1];
+   char *buf_ptr = buf_str;
+   for( int i = 0; i < 16; i++ ) {
+      buf_ptr += sprintf(buf_ptr, "%X", (unsigned char) _u_seed[i]);
+   }
+   buf_str[32] = 0;
+
+   mpz_t seedForU;
+   mpz_init_set_str(seedForU, buf_str, 16);
+   _u = new element_t[sectors];
+   _utils.get_u_from_seed(seedForU, _u, sectors);
+   mpz_clear(seedForU);
+
+   element_init_Zr(_private_key, _utils.pairing);
+   element_init_G1(_public_key, _utils.pairing);
+   element_random(_private_key);
+   element_pow_zn(_public_key, _utils.generator, _private_key);
+
+   _u_pp = new element_pp_t[sectors];
+   _utils.init_u_pp(_u, _u_pp, sectors);
+
+   _batch_blocks = get_number_of_workers() * 256;
+   _pending.reserve(_block_size * _batch_blocks);
+}
+
+CustodyUtils::CustodyDataStream::~CustodyDataStream()
+{
+   for( int k = 0; k < _sectors; k++ )
+      element_pp_clear(_u_pp[k]);
+   delete[] _u_pp;
+   _utils.clear_elements(_u, _sectors);
+   delete[] _u;
+   element_clear(_private_key);
+   element_clear(_public_key);
+}
+
+void CustodyUtils::CustodyDataStream::write(const char* data, size_t size)
+{
+   _pending.insert(_pending.end(), data, data + size);
+
+   //sign in batches so that every worker gets a reasonable amount of blocks
+   const uint64_t blocks = _pending.size() / _block_size;
+   if( blocks >= _batch_blocks ) {
+      sign_blocks(_pending.data(), blocks);
+      _pending.erase(_pending.begin(), _pending.begin() + blocks * _block_size);
+   }
+}
+
+void CustodyUtils::CustodyDataStream::finish(CustodyData& cd)
+{
+   const uint64_t blocks = _pending.size() / _block_size;
+   if( blocks ) {
+      sign_blocks(_pending.data(), blocks);
+      _pending.erase(_pending.begin(), _pending.begin() + blocks * _block_size);
+   }
+   if( !_pending.empty() ) {
+      _pending.resize(_block_size, 0);
+      sign_blocks(_pending.data(), 1);
+      _pending.clear();
+   }
+
+   cd.n = _n;
+   memcpy(cd.u_seed.data, _u_seed, 16);
+   element_to_bytes_compressed(cd.pubKey.data, _public_key);
+   _outfile.close();
+}
+
+void CustodyUtils::CustodyDataStream::sign_blocks(const char* data, uint64_t count)
+{
+   element_t *sigmas = new element_t[count];
+   _utils.get_sigmas(data, count * _block_size, _n, _u_pp, _private_key, sigmas, _sectors);
+
+   char buffer[DECENT_SIZE_OF_POINT_ON_CURVE_COMPRESSED];
+   for( uint64_t b = 0; b < count; b++ ) {
+      element_to_bytes_compressed((unsigned char *) buffer, sigmas[b]);
+      _outfile.write(buffer, DECENT_SIZE_OF_POINT_ON_CURVE_COMPRESSED);
+   }
+
+   _utils.clear_elements(sigmas, count);
+   delete[] sigmas;
+   _n += count;
+}
+
 int CustodyUtils::create_proof_of_custody(path content, const uint32_t n, const char u_seed[], unsigned char pubKey[],
                                            unsigned char sigma[], std::vector<std::string> &mus, mpz_t seed) {
    //open files
@@ -583,26 +1027,7 @@ int CustodyUtils::create_proof_of_custody(path content, const uint32_t n, const
    }else
       return -7;
 
-   //prepate public_key and u
-   element_t public_key;
-   element_init_G1(public_key, pairing);
-   element_from_bytes_compressed(public_key, pubKey);
-   element_t *u = new element_t[sectors];
-
-   char *buf_str = (char *) malloc(32 + 1);
-   char *buf_ptr = buf_str;
-
-   for( int i = 0; i < 16; i++ ) {
-      buf_ptr += sprintf(buf_ptr, "%X", (unsigned char) u_seed[i]);
-   }
-   buf_str[32] = 0;
-
-   mpz_t seedForU;
-
-   mpz_init_set_str(seedForU, buf_str, 16);
-   free(buf_str);
-   get_u_from_seed(seedForU, u, sectors);
-
+   //u's and public key are needed only for the verification, which takes them from the cache
 
    //read sigmas
    element_t* sigmas = new element_t[n];
@@ -655,15 +1080,11 @@ int CustodyUtils::create_proof_of_custody(path content, const uint32_t n, const
    clear_elements(sigmas, n);
    element_clear(_sigma);
 
-   element_clear(public_key);
-   mpz_clear(seedForU);
-   clear_elements(u, sectors);
    clear_elements(mu, sectors);
    clear_elements(v, q);
    delete[] (sigmas);
    delete[](v);
    delete[](mu);
-   delete[](u);
    return res;
 }
 
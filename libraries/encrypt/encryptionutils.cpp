@@ -82,6 +82,32 @@ encryption_results AES_encrypt_file(const std::string &fileIn, const std::string
     return ok;
 }
 
+AesEncryptStream::AesEncryptStream(const AesKey &key)
+{
+   byte iv[CryptoPP::AES::BLOCKSIZE];
+   memset(iv, 0, sizeof(iv));
+   _encryption.SetKeyWithIV(key.key_byte, CryptoPP::AES::MAX_KEYLENGTH, iv);
+   _filter.reset(new CryptoPP::StreamTransformationFilter(_encryption, new CryptoPP::StringSink(_ciphertext)));
+}
+
+AesEncryptStream::~AesEncryptStream()
+{
+}
+
+void AesEncryptStream::process(const char *data, size_t size, std::string &out)
+{
+   _filter->Put((const byte *) data, size);
+   out.append(_ciphertext);
+   _ciphertext.clear();
+}
+
+void AesEncryptStream::finish(std::string &out)
+{
+   _filter->MessageEnd();
+   out.append(_ciphertext);
+   _ciphertext.clear();
+}
+
 encryption_results AES_decrypt_file(const std::string &fileIn, const std::string &fileOut, const AesKey &key) {
     try {
        byte iv[CryptoPP::AES::BLOCKSIZE];
@@ -106,6 +132,32 @@ encryption_results AES_decrypt_file(const std::string &fileIn, const std::string
     return ok;
 }
 
+AesDecryptStream::AesDecryptStream(const AesKey &key)
+{
+   byte iv[CryptoPP::AES::BLOCKSIZE];
+   memset(iv, 0, sizeof(iv));
+   _decryption.SetKeyWithIV(key.key_byte, CryptoPP::AES::MAX_KEYLENGTH, iv);
+   _filter.reset(new CryptoPP::StreamTransformationFilter(_decryption, new CryptoPP::StringSink(_plaintext)));
+}
+
+AesDecryptStream::~AesDecryptStream()
+{
+}
+
+void AesDecryptStream::process(const char *data, size_t size, std::string &out)
+{
+   _filter->Put((const byte *) data, size);
+   out.append(_plaintext);
+   _plaintext.clear();
+}
+
+void AesDecryptStream::finish(std::string &out)
+{
+   _filter->MessageEnd();
+   out.append(_plaintext);
+   _plaintext.clear();
+}
+
 DInteger generate_private_el_gamal_key()
 {
     CryptoPP::Integer im (rng, CryptoPP::Integer::One(), DECENT_EL_GAMAL_MODULUS_512 -1);
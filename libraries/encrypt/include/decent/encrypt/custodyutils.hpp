@@ -13,8 +13,13 @@
 #include <pbc/pbc.h>
 #endif
 
+#include <atomic>
 #include <fstream>
-
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 #include <decent/encrypt/crypto_types.hpp>
 #include <boost/filesystem.hpp>
@@ -52,6 +57,9 @@ sign0 -1"
 
 #define DECENT_MP_SIZE_OF_NUMBER_IN_THE_FIELD ( DECENT_SIZE_OF_NUMBER_IN_THE_FIELD / sizeof(long long) )
 
+#define DECENT_CUSTODY_THREADS 4
+#define DECENT_CUSTODY_CACHE_CAPACITY 32
+
 
 
 
@@ -60,6 +68,7 @@ namespace encrypt{
 
 using namespace boost::filesystem;
 
+class WorkerPool;
 
 
 
@@ -68,6 +77,59 @@ class CustodyUtils
 private:
 
 public:
+   /**
+    * Incremental custody data generator. Content is fed in chunks of arbitrary size and the custody signatures
+    * are appended to the content.cus file as soon as the corresponding blocks are complete, so the content
+    * does not have to be read again once it has been written.
+    */
+   class CustodyDataStream
+   {
+   public:
+      /**
+       * @param cus_file Path to the content.cus file to be created
+       * @param sectors Number of sectors per block
+       */
+      CustodyDataStream(const boost::filesystem::path& cus_file, uint32_t sectors);
+      ~CustodyDataStream();
+
+      /**
+       * Feed next chunk of the encrypted content
+       */
+      void write(const char* data, size_t size);
+      /**
+       * Sign the trailing (zero padded) block, close content.cus and fill in the custody data
+       * @param cd Generated custody data
+       */
+      void finish(CustodyData& cd);
+
+   private:
+      void sign_blocks(const char* data, uint64_t count);
+
+      CustodyUtils&     _utils;
+      const uint32_t    _sectors;
+      const size_t      _block_size;
+      uint64_t          _batch_blocks;
+      std::ofstream     _outfile;
+      std::vector<char> _pending;
+      uint64_t          _n;
+      char              _u_seed[16];
+      element_t*        _u;
+      element_pp_t*     _u_pp;
+      element_t         _private_key;
+      element_t         _public_key;
+   };
+
+   /**
+    * Statistics of the cache of per-content verification data
+    */
+   struct CacheStats
+   {
+      uint64_t hits;
+      uint64_t misses;
+      size_t   size;
+      size_t   capacity;
+   };
+
    CustodyUtils();
    static CustodyUtils& instance(){
       static CustodyUtils cu;
@@ -90,6 +152,14 @@ public:
       mpz_clear(s);
       return ret;
    }
+   /**
+    * Verifies several received PoCs at once. The verification equations are combined with random weights,
+    * so all the proofs are checked with a single multi-pairing
+    * @param cds Custody data from the auhtors
+    * @param proofs Proofs of Custody from the seeders, proofs[i] belongs to cds[i]
+    * @return 0 if all the proofs are valid; non-zero if at least one of them is not
+    */
+   int verify_by_miner(const std::vector<CustodyData>& cds, const std::vector<CustodyProof>& proofs);
    /**
     * Create custody data for a given content. Creates custody data and custody signatures in file content.cus
     * @param content Path to conent.aes.zip file
@@ -150,15 +220,84 @@ public:
    int create_proof_of_custody(boost::filesystem::path content, const uint32_t n, const char u_seed[], unsigned char pubKey[],
                                unsigned char sigma[], std::vector<std::string> &mus, mpz_t seed);
 
+   /**
+    * Returns hit/miss counters of the cache of per-content verification data
+    */
+   CacheStats get_cache_stats() const;
+   /**
+    * Sets the maximal number of contents kept in the cache. Each entry holds fixed-base tables for all the u's,
+    * so it takes about sectors * 50kB of memory
+    * @param capacity Number of entries, 0 disables the cache
+    */
+   void set_cache_capacity(size_t capacity);
+
 private:
    element_t generator;
    pairing_t pairing;
 
    /*
-    * Calculate sigmas based on formula
-    * TODO_DECENT rework to stram version
+    * Per content data needed to verify proofs: u's derived from u_seed, decoded public key and their precomputed tables
+    */
+   struct CacheEntry {
+      CacheEntry(CustodyUtils& cu, const char* u_seed, const unsigned char* pubKey, uint32_t sectors);
+      ~CacheEntry();
+
+      const uint32_t sectors;
+      element_t*     u;
+      element_pp_t*  u_pp;
+      element_t      public_key;
+      pairing_pp_t   public_key_pp;
+   };
+
+   typedef std::pair<std::string, std::shared_ptr<CacheEntry>> cache_item;
+
+   /*
+    * Threads shared by all the parallel loops over sectors and blocks, started once with the utils
+    */
+   std::unique_ptr<WorkerPool>                                  _workers;
+
+   mutable std::mutex                                           _cache_mutex;
+   std::list<cache_item>                                        _cache;
+   std::map<std::string, std::list<cache_item>::iterator>       _cache_index;
+   size_t                                                       _cache_capacity;
+   std::atomic<uint64_t>                                        _cache_hits;
+   std::atomic<uint64_t>                                        _cache_misses;
+
+   /*
+    * Only DECENT_SECTORS and DECENT_SECTORS_BIG are used by contents, proofs with any other number of mu's are invalid
+    */
+   static bool is_valid_sectors(uint32_t sectors);
+   /*
+    * Returns the (possibly cached) verification data for the content, keyed by u_seed, pubKey and sectors
     */
-   int get_sigmas(std::fstream &file, const unsigned int n, element_t *u, element_t pk, element_t **sigmas, uint32_t sectors);
+   std::shared_ptr<CacheEntry> get_cache_entry(const char* u_seed, const unsigned char* pubKey, uint32_t sectors);
+
+   /*
+    * Per worker temporaries for get_sigma, allocated once and reused for every block
+    */
+   struct SigmaScratch {
+      SigmaScratch(pairing_t pairing, uint32_t sectors);
+      ~SigmaScratch();
+      /*
+       * Load the sectors of one block into m
+       */
+      void load(const char* block);
+
+      mpz_t*         m;
+      element_t      temp;
+      element_t      hash;
+      const uint32_t sectors;
+   };
+
+   /*
+    * Calculate sigmas of all the blocks in data (the last one zero padded) in parallel.
+    * first_idx is the index of the first block within the content; sigmas must have room for all the blocks
+    */
+   int get_sigmas(const char* data, uint64_t size, uint64_t first_idx, element_pp_t u_pp[], element_t pk, element_t sigmas[], uint32_t sectors);
+   /*
+    * Precompute the fixed-base tables of u's
+    */
+   void init_u_pp(element_t* u, element_pp_t* u_pp, uint32_t sectors);
    /*
     * Generates u from seed seedU. The array must be initalized to at least DECENT_SIZE_OF_POINT_ON_CURVE_COMPRESSED elements
     */
@@ -166,13 +305,22 @@ private:
    int generate_query_from_seed(mpz_t seed, unsigned int q, unsigned int n, uint64_t indices[], element_t* v[]);
    int compute_mu(std::fstream& file, unsigned int q, uint64_t indices[], element_t v[], element_t mu[], uint32_t sectors);
    int compute_sigma(element_t *sigmas, unsigned int q, uint64_t *indices, element_t *v, element_t &sigma);
-   int get_sigma( uint64_t pidx, mpz_t mi[], element_pp_t u_pp[], element_t pk, element_t out[], uint32_t sectors);
+   int get_sigma( uint64_t idx, SigmaScratch& scratch, element_pp_t u_pp[], element_t pk, element_t out, uint32_t sectors);
    int verify(element_t sigma, unsigned int q, uint64_t *indices, element_t *v, element_t *u, element_t *mu, element_t pubk, uint32_t sectors);
+   /*
+    * Computes prod H(i)^v_i * prod u_j^mu_j, the value paired with the public key during verification. Initializes left
+    */
+   int compute_left_side(element_t left, unsigned int q, uint64_t *indices, element_t *v, element_t *u, element_t *mu, uint32_t sectors,
+                         element_pp_t *u_pp = nullptr);
+   /*
+    * Decodes a proof and computes both sides of its verification equation. Initializes _sigma and left
+    */
+   int prepare_verification(const uint32_t &n, CacheEntry &content, const unsigned char sigma[],
+                            const std::vector<std::string> &mus, mpz_t seed, element_t _sigma, element_t left);
    int clear_elements(element_t *array, int size);
    int get_number_of_query(int blocks);
    int get_n(std::fstream &file, uint32_t sectors);
    inline int get_m(std::fstream &file, uint32_t i, uint32_t j, mpz_t& out, uint32_t sectors);
-   inline int get_data(std::fstream &file, uint32_t i, char buffer[], uint32_t sectors);
 };
 
 
@@ -36,8 +36,12 @@ using CryptoPP::PublicKey;
 using CryptoPP::ModularArithmetic;
 
 #include <cryptopp/pubkey.h>
+#include <cryptopp/modes.h>
+#include <cryptopp/filters.h>
 #include <fc/crypto/sha256.hpp>
 
+#include <memory>
+
 
 #define DECENT_EL_GAMAL_GROUP_ELEMENT_SIZE 64 //bytes
 #define DECENT_EL_GAMAL_CIPHERTEXT_SIZE (2 * DECENT_EL_GAMAL_GROUP_ELEMENT_SIZE) //bytes
@@ -117,6 +121,35 @@ private:
  */
 encryption_results AES_encrypt_file(const std::string &fileIn, const std::string &fileOut, const AesKey &key);
 
+/**
+ * Incremental AES encryptor. Produces the same output as AES_encrypt_file, but accepts the plaintext in chunks
+ * so that the data can be encrypted while it is being produced.
+ */
+class AesEncryptStream
+{
+public:
+   explicit AesEncryptStream(const AesKey &key);
+   ~AesEncryptStream();
+
+   /**
+    * Encrypt next chunk of plaintext
+    * @param data Plaintext chunk
+    * @param size Size of the chunk
+    * @param out Ciphertext ready so far is appended here
+    */
+   void process(const char *data, size_t size, std::string &out);
+   /**
+    * Pad and encrypt the rest of the buffered plaintext
+    * @param out Remaining ciphertext is appended here
+    */
+   void finish(std::string &out);
+
+private:
+   CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption _encryption;
+   std::string _ciphertext;
+   std::unique_ptr<CryptoPP::StreamTransformationFilter> _filter;
+};
+
 /*********************************************************
  *  Decrypt file wit key
  *********************************************************/
@@ -130,6 +163,36 @@ encryption_results AES_encrypt_file(const std::string &fileIn, const std::string
  */
 encryption_results AES_decrypt_file(const std::string &fileIn, const std::string &fileOut, const AesKey &key);
 
+/**
+ * Incremental AES decryptor. Produces the same output as AES_decrypt_file, but accepts the ciphertext in chunks
+ * so that the plaintext can be consumed while the encrypted file is being read.
+ * Errors are reported by throwing CryptoPP::Exception, a wrong key is typically detected by finish().
+ */
+class AesDecryptStream
+{
+public:
+   explicit AesDecryptStream(const AesKey &key);
+   ~AesDecryptStream();
+
+   /**
+    * Decrypt next chunk of ciphertext
+    * @param data Ciphertext chunk
+    * @param size Size of the chunk
+    * @param out Plaintext ready so far is appended here
+    */
+   void process(const char *data, size_t size, std::string &out);
+   /**
+    * Decrypt the last block and remove the padding
+    * @param out Remaining plaintext is appended here
+    */
+   void finish(std::string &out);
+
+private:
+   CryptoPP::CBC_Mode<CryptoPP::AES>::Decryption _decryption;
+   std::string _plaintext;
+   std::unique_ptr<CryptoPP::StreamTransformationFilter> _filter;
+};
+
 /**
  * Generate new el-gamal private key
  * @return New private key
@@ -57,6 +57,20 @@
 
 #define GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES        (1024 * 1024)
 
+/**
+ * Size of the buffers each connection uses to encrypt/decrypt and frame
+ * its traffic.  A single socket read or write (and a single AES call) covers
+ * up to this many bytes, so many small messages are received in one read and
+ * most blocks fit in one.  Must be a multiple of 16.
+ */
+#define GRAPHENE_NET_DEFAULT_SOCKET_BUFFER_SIZE              (64 * 1024)
+
+/**
+ * When several messages are waiting in a peer's send queue, they are
+ * coalesced into a single write until their total size reaches this limit.
+ */
+#define GRAPHENE_NET_MAX_COALESCED_SEND_SIZE                 (64 * 1024)
+
 /**
  * When we receive a message from the network, we advertise it to
  * our peers and save a copy in a cache were we will find it if
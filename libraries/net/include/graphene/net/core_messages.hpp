@@ -110,6 +110,8 @@ namespace graphene { namespace net {
       block_message(){}
       block_message(const signed_block& blk )
       :block(blk),block_id(blk.id()){}
+      block_message(const validated_block& blk )
+      :block(blk.block()),block_id(blk.id()){}
 
       signed_block    block;
       block_id_type   block_id;
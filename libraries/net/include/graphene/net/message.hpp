@@ -24,6 +24,7 @@
  */
 #pragma once
 #include <fc/array.hpp>
+#include <memory>
 #include <fc/io/varint.hpp>
 #include <fc/network/ip.hpp>
 #include <decent/encrypt/crypto_types.hpp>
@@ -47,13 +48,37 @@ namespace graphene { namespace net {
 
   typedef fc::uint160_t message_hash_type;
 
+  /**
+   *  Immutable, reference counted message payload.  Copies of a message (the one in the
+   *  message cache and the ones queued for each peer) share a single buffer.
+   */
+  class message_data
+  {
+  public:
+     message_data(){}
+     message_data( std::vector<char>&& bytes )
+     :_bytes( std::make_shared<const std::vector<char>>( std::move(bytes) ) ){}
+     message_data( const char* begin, const char* end )
+     :_bytes( std::make_shared<const std::vector<char>>( begin, end ) ){}
+
+     const char*              data()const  { return _bytes ? _bytes->data() : nullptr; }
+     size_t                   size()const  { return _bytes ? _bytes->size() : 0; }
+     bool                     empty()const { return size() == 0; }
+     const char*              begin()const { return data(); }
+     const char*              end()const   { return data() + size(); }
+     const std::vector<char>& bytes()const { static const std::vector<char> none; return _bytes ? *_bytes : none; }
+
+  private:
+     std::shared_ptr<const std::vector<char>> _bytes;
+  };
+
   /**
    *  Abstracts the process of packing/unpacking a message for a 
    *  particular channel.
    */
   struct message : public message_header
   {
-     std::vector<char> data;
+     message_data data;
 
      message(){}
 
@@ -115,5 +140,27 @@ namespace graphene { namespace net {
 
 } } // graphene::net
 
+namespace fc {
+   inline void to_variant( const graphene::net::message_data& d, variant& v ) { to_variant( d.bytes(), v ); }
+   inline void from_variant( const variant& v, graphene::net::message_data& d )
+   {
+      std::vector<char> bytes;
+      from_variant( v, bytes );
+      d = graphene::net::message_data( std::move(bytes) );
+   }
+
+   namespace raw {
+      template<typename Stream>
+      inline void pack( Stream& s, const graphene::net::message_data& d ) { fc::raw::pack( s, d.bytes() ); }
+      template<typename Stream>
+      inline void unpack( Stream& s, graphene::net::message_data& d )
+      {
+         std::vector<char> bytes;
+         fc::raw::unpack( s, bytes );
+         d = graphene::net::message_data( std::move(bytes) );
+      }
+   }
+}
+
 FC_REFLECT( graphene::net::message_header, (size)(msg_type) )
 FC_REFLECT_DERIVED( graphene::net::message, (graphene::net::message_header), (data) )
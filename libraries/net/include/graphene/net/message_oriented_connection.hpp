@@ -24,6 +24,7 @@
 #pragma once
 #include <fc/network/tcp_socket.hpp>
 #include <graphene/net/message.hpp>
+#include <graphene/net/config.hpp>
 
 namespace graphene { namespace net {
 
@@ -43,7 +44,12 @@ namespace graphene { namespace net {
   class message_oriented_connection
   {
      public:
-       message_oriented_connection(message_oriented_connection_delegate* delegate = nullptr);
+       /**
+        *  @param buffer_size size of the socket's encryption buffers and of the initial receive
+        *         buffer; a single read may deliver any number of messages that fit in it
+        */
+       message_oriented_connection(message_oriented_connection_delegate* delegate = nullptr,
+                                   size_t buffer_size = GRAPHENE_NET_DEFAULT_SOCKET_BUFFER_SIZE);
        ~message_oriented_connection();
        fc::tcp_socket& get_socket();
 
@@ -52,6 +58,8 @@ namespace graphene { namespace net {
        void connect_to(const fc::ip::endpoint& remote_endpoint);
 
        void send_message(const message& message_to_send);
+       /** sends all messages with a single encrypted write and flush, in order */
+       void send_messages(const std::vector<message>& messages_to_send);
        void close_connection();
        void destroy_connection();
 
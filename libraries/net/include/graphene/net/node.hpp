@@ -80,6 +80,12 @@ namespace graphene { namespace net {
           */
          virtual bool handle_block( const graphene::net::block_message& blk_msg, bool sync_mode, 
                                     std::vector<fc::uint160_t>& contained_transaction_message_ids ) = 0;
+
+         /**
+          *  @brief Called as soon as a block is fetched through the sync process, possibly long before
+          *  it is passed to handle_block(), so the client can start checks which don't depend on chain state
+          */
+         virtual void prefetch_block( const graphene::net::block_message& blk_msg ) {}
          
          /**
           *  @brief Called when a new transaction comes in from the network
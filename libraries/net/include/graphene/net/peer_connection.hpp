@@ -40,6 +40,7 @@
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 
+#include <list>
 #include <queue>
 #include <boost/container/deque.hpp>
 #include <fc/thread/future.hpp>
@@ -131,8 +132,9 @@ namespace graphene { namespace net
         virtual ~queued_message() {}
       };
 
-      /* when you queue up a 'real_queued_message', a full copy of the message is
-       * stored on the heap until it is sent
+      /* when you queue up a 'real_queued_message', the message is kept until it is sent.
+       * Its payload is shared with the message cache and the other peers' queues, so
+       * the only per-peer state is the offset of the send time to patch in
        */
       struct real_queued_message : queued_message
       {
@@ -167,7 +169,7 @@ namespace graphene { namespace net
 
 
       size_t _total_queued_messages_size;
-      std::queue<std::unique_ptr<queued_message>, std::list<std::unique_ptr<queued_message> > > _queued_messages;
+      std::list<std::unique_ptr<queued_message> > _queued_messages;
       fc::future<void> _send_queued_messages_done;
     public:
       fc::time_point connection_initiation_time;
@@ -25,6 +25,7 @@
 #include <fc/network/tcp_socket.hpp>
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/elliptic.hpp>
+#include <graphene/net/config.hpp>
 
 namespace graphene { namespace net {
 
@@ -35,8 +36,13 @@ namespace graphene { namespace net {
 class stcp_socket : public virtual fc::iostream
 {
   public:
-    stcp_socket();
+    /**
+     *  @param buffer_size upper bound on the bytes moved (and run through AES) by a
+     *         single readsome()/writesome() call; rounded down to a multiple of 16
+     */
+    stcp_socket( size_t buffer_size = GRAPHENE_NET_DEFAULT_SOCKET_BUFFER_SIZE );
     ~stcp_socket();
+    size_t           get_buffer_size()const { return _buffer_size; }
     fc::tcp_socket&  get_socket() { return _sock; }
     void             accept();
 
@@ -66,6 +72,7 @@ class stcp_socket : public virtual fc::iostream
     fc::tcp_socket       _sock;
     fc::aes_encoder      _send_aes;
     fc::aes_decoder      _recv_aes;
+    size_t               _buffer_size;
     std::shared_ptr<char> _read_buffer;
     std::shared_ptr<char> _write_buffer;
 #ifndef NDEBUG
@@ -21,6 +21,8 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#include <algorithm>
+
 #include <fc/thread/thread.hpp>
 #include <fc/thread/mutex.hpp>
 #include <fc/thread/scoped_lock.hpp>
@@ -53,6 +55,7 @@ namespace graphene { namespace net {
       message_oriented_connection_delegate *_delegate;
       stcp_socket _sock;
       fc::future<void> _read_loop_done;
+      std::vector<char> _send_buffer;
       uint64_t _bytes_received;
       uint64_t _bytes_sent;
 
@@ -68,6 +71,7 @@ namespace graphene { namespace net {
 
       void read_loop();
       void start_read_loop();
+      void send_frames(const message* begin, const message* end);
     public:
       fc::tcp_socket& get_socket();
       void accept();
@@ -75,10 +79,12 @@ namespace graphene { namespace net {
       void bind(const fc::ip::endpoint& local_endpoint);
 
       message_oriented_connection_impl(message_oriented_connection* self,
-                                       message_oriented_connection_delegate* delegate = nullptr);
+                                       message_oriented_connection_delegate* delegate = nullptr,
+                                       size_t buffer_size = GRAPHENE_NET_DEFAULT_SOCKET_BUFFER_SIZE);
       ~message_oriented_connection_impl();
 
       void send_message(const message& message_to_send);
+      void send_messages(const std::vector<message>& messages_to_send);
       void close_connection();
       void destroy_connection();
 
@@ -92,9 +98,11 @@ namespace graphene { namespace net {
     };
 
     message_oriented_connection_impl::message_oriented_connection_impl(message_oriented_connection* self,
-                                                                       message_oriented_connection_delegate* delegate)
+                                                                       message_oriented_connection_delegate* delegate,
+                                                                       size_t buffer_size)
     : _self(self),
       _delegate(delegate),
+      _sock(buffer_size),
       _bytes_received(0),
       _bytes_sent(0),
       _send_message_in_progress(false)
@@ -138,13 +146,14 @@ namespace graphene { namespace net {
     }
 
 
+    /**
+     *  Frames are read into a buffer of (at least) the socket's buffer size, so a single read
+     *  and AES call may deliver many messages at once.  Every complete frame in the buffer is
+     *  dispatched before the next read; a frame larger than the buffer grows it to fit.
+     */
     void message_oriented_connection_impl::read_loop()
     {
       VERIFY_CORRECT_THREAD();
-      const int BUFFER_SIZE = 16;
-      const int LEFTOVER = BUFFER_SIZE - sizeof(message_header);
-      static_assert(BUFFER_SIZE >= sizeof(message_header), "insufficient buffer");
-
       _connected_time = fc::time_point::now();
 
       fc::oexception exception_to_rethrow;
@@ -152,42 +161,66 @@ namespace graphene { namespace net {
 
       try
       {
-        message m;
+        std::vector<char> buffer(_sock.get_buffer_size());
+        size_t begin = 0; // first byte of the oldest frame not dispatched yet
+        size_t end = 0;   // one past the last decrypted byte
         while( true )
         {
-          char buffer[BUFFER_SIZE];
-          _sock.read(buffer, BUFFER_SIZE);
-          _bytes_received += BUFFER_SIZE;
-          memcpy((char*)&m, buffer, sizeof(message_header));
-
-          FC_ASSERT( m.size <= MAX_MESSAGE_SIZE, "", ("m.size",m.size)("MAX_MESSAGE_SIZE",MAX_MESSAGE_SIZE) );
-
-          size_t remaining_bytes_with_padding = 16 * ((m.size - LEFTOVER + 15) / 16);
-          m.data.resize(LEFTOVER + remaining_bytes_with_padding); //give extra 16 bytes to allow for padding added in send call
-          std::copy(buffer + sizeof(message_header), buffer + sizeof(buffer), m.data.begin());
-          if (remaining_bytes_with_padding)
+          while( end - begin >= sizeof(message_header) )
           {
-            _sock.read(&m.data[LEFTOVER], remaining_bytes_with_padding);
-            _bytes_received += remaining_bytes_with_padding;
+            message m;
+            memcpy((char*)&m, buffer.data() + begin, sizeof(message_header));
+
+            FC_ASSERT( m.size <= MAX_MESSAGE_SIZE, "", ("m.size",m.size)("MAX_MESSAGE_SIZE",MAX_MESSAGE_SIZE) );
+
+            size_t frame_size = 16 * ((sizeof(message_header) + m.size + 15) / 16);
+            if( end - begin < frame_size )
+            {
+              if( frame_size > buffer.size() )
+              {
+                std::move(buffer.begin() + begin, buffer.begin() + end, buffer.begin());
+                end -= begin;
+                begin = 0;
+                buffer.resize(frame_size);
+              }
+              break;
+            }
+
+            const char* payload = buffer.data() + begin + sizeof(message_header);
+            m.data = message_data(payload, payload + m.size);
+            begin += frame_size;
+
+            _last_message_received_time = fc::time_point::now();
+
+            try
+            {
+              // message handling errors are warnings...
+              _delegate->on_message(_self, m);
+            }
+            /// Dedicated catches needed to distinguish from general fc::exception
+            catch ( const fc::canceled_exception& e ) { throw e; }
+            catch ( const fc::eof_exception& e ) { throw e; }
+            catch ( const fc::exception& e)
+            {
+              /// Here loop should be continued so exception should be just caught locally.
+              wlog( "message transmission failed ${er}", ("er", e.to_detail_string() ) );
+              throw;
+            }
           }
-          m.data.resize(m.size); // truncate off the padding bytes
-
-          _last_message_received_time = fc::time_point::now();
 
-          try
-          {
-            // message handling errors are warnings...
-            _delegate->on_message(_self, m);
-          }
-          /// Dedicated catches needed to distinguish from general fc::exception
-          catch ( const fc::canceled_exception& e ) { throw e; }
-          catch ( const fc::eof_exception& e ) { throw e; }
-          catch ( const fc::exception& e)
+          if( begin == end )
+            begin = end = 0;
+          else if( buffer.size() - end < buffer.size() / 2 )
           {
-            /// Here loop should be continued so exception should be just caught locally.
-            wlog( "message transmission failed ${er}", ("er", e.to_detail_string() ) );
-            throw;
+            std::move(buffer.begin() + begin, buffer.begin() + end, buffer.begin());
+            end -= begin;
+            begin = 0;
           }
+
+          // begin, end and the buffer size are all multiples of 16, as the socket requires
+          size_t bytes_read = _sock.readsome(buffer.data() + end, buffer.size() - end);
+          end += bytes_read;
+          _bytes_received += bytes_read;
         }
       }
       catch ( const fc::canceled_exception& e )
@@ -227,6 +260,16 @@ namespace graphene { namespace net {
     }
 
     void message_oriented_connection_impl::send_message(const message& message_to_send)
+    {
+      send_frames(&message_to_send, &message_to_send + 1);
+    }
+
+    void message_oriented_connection_impl::send_messages(const std::vector<message>& messages_to_send)
+    {
+      send_frames(messages_to_send.data(), messages_to_send.data() + messages_to_send.size());
+    }
+
+    void message_oriented_connection_impl::send_frames(const message* begin, const message* end)
     {
       VERIFY_CORRECT_THREAD();
 #if 0 // this gets too verbose
@@ -255,17 +298,50 @@ namespace graphene { namespace net {
 
       try
       {
-        size_t size_of_message_and_header = sizeof(message_header) + message_to_send.size;
-        if( message_to_send.size > MAX_MESSAGE_SIZE )
-           elog("Trying to send a message larger than MAX_MESSAGE_SIZE. This probably won't work...");
-        //pad the message we send to a multiple of 16 bytes
-        size_t size_with_padding = 16 * ((size_of_message_and_header + 15) / 16);
-        std::unique_ptr<char[]> padded_message(new char[size_with_padding]);
-        memcpy(padded_message.get(), (char*)&message_to_send, sizeof(message_header));
-        memcpy(padded_message.get() + sizeof(message_header), message_to_send.data.data(), message_to_send.size );
-        _sock.write(padded_message.get(), size_with_padding);
+        // frames are laid out back to back in the send buffer, which goes through one AES pass and one write
+        // each time it fills up; everything is flushed once.  Payloads are copied straight out of the shared
+        // message data, so a large block never needs a second full-size copy per peer
+        const size_t send_buffer_size = _sock.get_buffer_size();
+        _send_buffer.resize(send_buffer_size);
+        size_t buffered_bytes = 0;
+        size_t bytes_written = 0;
+        auto append = [&](const char* bytes, size_t length) {
+          while (length)
+          {
+            size_t chunk = std::min(length, send_buffer_size - buffered_bytes);
+            memcpy(_send_buffer.data() + buffered_bytes, bytes, chunk);
+            buffered_bytes += chunk;
+            bytes += chunk;
+            length -= chunk;
+            if (buffered_bytes == send_buffer_size)
+            {
+              _sock.write(_send_buffer.data(), buffered_bytes);
+              bytes_written += buffered_bytes;
+              buffered_bytes = 0;
+            }
+          }
+        };
+
+        static const char padding[16] = {};
+        for( const message* message_to_send = begin; message_to_send != end; ++message_to_send )
+        {
+          if( message_to_send->size > MAX_MESSAGE_SIZE )
+             elog("Trying to send a message larger than MAX_MESSAGE_SIZE. This probably won't work...");
+          size_t size_of_message_and_header = sizeof(message_header) + message_to_send->size;
+          append((const char*)message_to_send, sizeof(message_header));
+          append(message_to_send->data.data(), message_to_send->size);
+          //pad the message we send to a multiple of 16 bytes
+          append(padding, 16 * ((size_of_message_and_header + 15) / 16) - size_of_message_and_header);
+        }
+        if (buffered_bytes)
+        {
+          _sock.write(_send_buffer.data(), buffered_bytes);
+          bytes_written += buffered_bytes;
+        }
+        if (!bytes_written)
+          return;
         _sock.flush();
-        _bytes_sent += size_with_padding;
+        _bytes_sent += bytes_written;
         _last_message_sent_time = fc::time_point::now();
       } FC_RETHROW_EXCEPTIONS( warn, "unable to send message" );
     }
@@ -337,8 +413,8 @@ namespace graphene { namespace net {
   } // end namespace graphene::net::detail
 
 
-  message_oriented_connection::message_oriented_connection(message_oriented_connection_delegate* delegate) :
-    my(new detail::message_oriented_connection_impl(this, delegate))
+  message_oriented_connection::message_oriented_connection(message_oriented_connection_delegate* delegate, size_t buffer_size) :
+    my(new detail::message_oriented_connection_impl(this, delegate, buffer_size))
   {
   }
 
@@ -371,6 +447,11 @@ namespace graphene { namespace net {
     my->send_message(message_to_send);
   }
 
+  void message_oriented_connection::send_messages(const std::vector<message>& messages_to_send)
+  {
+    my->send_messages(messages_to_send);
+  }
+
   void message_oriented_connection::close_connection()
   {
     my->close_connection();
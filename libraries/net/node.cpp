@@ -396,6 +396,7 @@ namespace graphene { namespace net { namespace detail {
       bool has_item( const net::item_id& id ) override;
       void handle_message( const message& ) override;
       bool handle_block( const graphene::net::block_message& block_message, bool sync_mode, std::vector<fc::uint160_t>& contained_transaction_message_ids ) override;
+      void prefetch_block( const graphene::net::block_message& block_message ) override;
       void handle_transaction( const graphene::net::trx_message& transaction_message ) override;
       std::vector<item_hash_t> get_block_ids(const std::vector<item_hash_t>& blockchain_synopsis,
                                              uint32_t& remaining_item_count,
@@ -3321,6 +3322,8 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       dlog( "received a sync block from peer ${endpoint}", ("endpoint", originating_peer->get_remote_endpoint() ) );
 
+      _delegate->prefetch_block( block_message_to_process );
+
       // add it to the front of _received_sync_items, then process _received_sync_items to try to
       // pass as many messages as possible to the client.
       _new_received_sync_items.push_front( block_message_to_process );
@@ -5416,6 +5419,12 @@ namespace graphene { namespace net { namespace detail {
       INVOKE_AND_COLLECT_STATISTICS(handle_block, block_message, sync_mode, contained_transaction_message_ids);
     }
 
+    void statistics_gathering_node_delegate_wrapper::prefetch_block( const graphene::net::block_message& block_message )
+    {
+      // fire and forget, the p2p thread must not wait while the delegate's thread is busy applying blocks
+      _thread->async( [this, block_message](){ _node_delegate->prefetch_block( block_message ); }, "prefetch_block" );
+    }
+
     void statistics_gathering_node_delegate_wrapper::handle_transaction( const graphene::net::trx_message& transaction_message )
     {
       INVOKE_AND_COLLECT_STATISTICS(handle_transaction, transaction_message);
@@ -47,11 +47,16 @@ namespace graphene { namespace net
       if (message_send_time_field_offset != (size_t)-1)
       {
         // patch the current time into the message.  Since this operates on the packed version of the structure,
-        // it won't work for anything after a variable-length field
+        // it won't work for anything after a variable-length field.  The payload is shared, so the patch goes
+        // into a private copy; only the small time request/reply messages are sent this way
         std::vector<char> packed_current_time = fc::raw::pack(fc::time_point::now());
         assert(message_send_time_field_offset + packed_current_time.size() <= message_to_send.data.size());
-        memcpy(message_to_send.data.data() + message_send_time_field_offset,
+        std::vector<char> patched_data(message_to_send.data.begin(), message_to_send.data.end());
+        memcpy(patched_data.data() + message_send_time_field_offset,
                packed_current_time.data(), packed_current_time.size());
+        message patched_message(message_to_send);
+        patched_message.data = message_data(std::move(patched_data));
+        return patched_message;
       }
       return message_to_send;
     }
@@ -287,14 +292,24 @@ namespace graphene { namespace net
 #endif
       while (!_queued_messages.empty())
       {
-        _queued_messages.front()->transmission_start_time = fc::time_point::now();
-        message message_to_send = _queued_messages.front()->get_message(_node);
+        // coalesce the messages at the front of the queue into a single write.  Anything queued
+        // while the write is in progress goes out with the next batch
+        std::vector<message> messages_to_send;
+        size_t bytes_to_send = 0;
+        fc::time_point transmission_start_time = fc::time_point::now();
+        for (auto iter = _queued_messages.begin();
+             iter != _queued_messages.end() && bytes_to_send < GRAPHENE_NET_MAX_COALESCED_SEND_SIZE; ++iter)
+        {
+          (*iter)->transmission_start_time = transmission_start_time;
+          messages_to_send.push_back((*iter)->get_message(_node));
+          bytes_to_send += messages_to_send.back().size;
+        }
         try
         {
-          //dlog("peer_connection::send_queued_messages_task() calling message_oriented_connection::send_message() "
-          //     "to send message of type ${type} for peer ${endpoint}",
-          //     ("type", message_to_send.msg_type)("endpoint", get_remote_endpoint()));
-          _message_connection.send_message(message_to_send);
+          //dlog("peer_connection::send_queued_messages_task() calling message_oriented_connection::send_messages() "
+          //     "to send ${count} messages for peer ${endpoint}",
+          //     ("count", messages_to_send.size())("endpoint", get_remote_endpoint()));
+          _message_connection.send_messages(messages_to_send);
           //dlog("peer_connection::send_queued_messages_task()'s call to message_oriented_connection::send_message() completed normally for peer ${endpoint}",
           //     ("endpoint", get_remote_endpoint()));
         }
@@ -324,9 +339,13 @@ namespace graphene { namespace net
         {
           elog("message_oriented_exception::send_message() threw an unhandled exception");
         }
-        _queued_messages.front()->transmission_finish_time = fc::time_point::now();
-        _total_queued_messages_size -= _queued_messages.front()->get_size_in_queue();
-        _queued_messages.pop();
+        fc::time_point transmission_finish_time = fc::time_point::now();
+        for (size_t i = 0; i < messages_to_send.size(); ++i)
+        {
+          _queued_messages.front()->transmission_finish_time = transmission_finish_time;
+          _total_queued_messages_size -= _queued_messages.front()->get_size_in_queue();
+          _queued_messages.pop_front();
+        }
       }
       //dlog("leaving peer_connection::send_queued_messages_task() due to queue exhaustion");
     }
@@ -335,7 +354,7 @@ namespace graphene { namespace net
     {
       VERIFY_CORRECT_THREAD();
       _total_queued_messages_size += message_to_send->get_size_in_queue();
-      _queued_messages.emplace(std::move(message_to_send));
+      _queued_messages.emplace_back(std::move(message_to_send));
       if (_total_queued_messages_size > GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES)
       {
         elog("send queue exceeded maximum size of ${max} bytes (current size ${current} bytes)",
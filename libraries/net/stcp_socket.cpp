@@ -36,10 +36,11 @@
 
 namespace graphene { namespace net {
 
-stcp_socket::stcp_socket()
+stcp_socket::stcp_socket( size_t buffer_size )
 //:_buf_len(0)
+   : _buffer_size(std::max<size_t>(16, buffer_size & ~size_t(15)))
 #ifndef NDEBUG
-   : _read_buffer_in_use(false),
+   , _read_buffer_in_use(false),
      _write_buffer_in_use(false)
 #endif
 {
@@ -100,11 +101,10 @@ size_t stcp_socket::readsome( char* buffer, size_t len )
     } buffer_in_use_checker(_read_buffer_in_use);
 #endif
 
-    const size_t read_buffer_length = 4096;
     if (!_read_buffer)
-      _read_buffer.reset(new char[read_buffer_length], [](char* p){ delete[] p; });
+      _read_buffer.reset(new char[_buffer_size], [](char* p){ delete[] p; });
 
-    len = std::min<size_t>(read_buffer_length, len);
+    len = std::min<size_t>(_buffer_size, len);
 
     size_t s = _sock.readsome( _read_buffer, len, 0 );
     if( s % 16 ) 
@@ -141,10 +141,9 @@ size_t stcp_socket::writesome( const char* buffer, size_t len )
     } buffer_in_use_checker(_write_buffer_in_use);
 #endif
 
-    const std::size_t write_buffer_length = 4096;
     if (!_write_buffer)
-      _write_buffer.reset(new char[write_buffer_length], [](char* p){ delete[] p; });
-    len = std::min<size_t>(write_buffer_length, len);
+      _write_buffer.reset(new char[_buffer_size], [](char* p){ delete[] p; });
+    len = std::min<size_t>(_buffer_size, len);
     memset(_write_buffer.get(), 0, len); // just in case aes.encode screws up
     /**
      * every sizeof(crypt_buf) bytes the aes channel
@@ -10,6 +10,8 @@
 #include <boost/interprocess/sync/scoped_lock.hpp>
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <chrono>
 #include <mutex>
@@ -38,6 +40,55 @@ namespace detail {
     fc::ripemd160 calculate_hash(const boost::filesystem::path& file_path);
 
 
+    /**
+     * Blocking FIFO queue with limited capacity, used to pass data between stages running on different threads.
+     * Closing the queue wakes up both sides: producers are refused from then on, consumers drain what is left.
+     */
+    template <typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity) : _capacity(capacity), _closed(false) {}
+
+        bool push(T&& item) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_full.wait(lock, [this]() { return _closed || _items.size() < _capacity; });
+            if (_closed) {
+                return false;
+            }
+            _items.push_back(std::move(item));
+            _not_empty.notify_one();
+            return true;
+        }
+
+        bool pop(T& item) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_empty.wait(lock, [this]() { return _closed || !_items.empty(); });
+            if (_items.empty()) {
+                return false;
+            }
+            item = std::move(_items.front());
+            _items.pop_front();
+            _not_full.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> guard(_mutex);
+            _closed = true;
+            _not_full.notify_all();
+            _not_empty.notify_all();
+        }
+
+    private:
+        const size_t            _capacity;
+        bool                    _closed;
+        std::deque<T>           _items;
+        std::mutex              _mutex;
+        std::condition_variable _not_full;
+        std::condition_variable _not_empty;
+    };
+
+
     class PackageTask {
     public:
 
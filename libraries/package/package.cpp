@@ -5,6 +5,7 @@
 #include "local.hpp"
 
 #include <decent/encrypt/encryptionutils.hpp>
+#include <decent/encrypt/custodyutils.hpp>
 #include <decent/package/package.hpp>
 
 #include <fc/log/logger.hpp>
@@ -15,11 +16,15 @@
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/device/file.hpp>
 #include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/categories.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
 #include <atomic>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <thread>
 #include <vector>
 
@@ -165,6 +170,339 @@ namespace decent { namespace package {
         };
 
 
+        typedef std::vector<char>   Chunk;
+        typedef BoundedQueue<Chunk> ChunkQueue;
+
+        const size_t PIPELINE_CHUNK_SIZE = 1024 * 1024; // 1Mb
+        const size_t PIPELINE_QUEUE_CAPACITY = 8;
+
+
+        /**
+         * boost::iostreams sink feeding the first stage of the package creation pipeline.
+         */
+        class ChunkQueueSink {
+        public:
+            typedef char char_type;
+            typedef boost::iostreams::sink_tag category;
+
+            explicit ChunkQueueSink(ChunkQueue& queue)
+                : _queue(&queue)
+            {
+            }
+
+            std::streamsize write(const char* s, std::streamsize n) {
+                // refused chunks mean the pipeline has been aborted, the error is reported by CreatePackagePipeline::finish()
+                _queue->push(Chunk(s, s + n));
+                return n;
+            }
+
+        private:
+            ChunkQueue* _queue;
+        };
+
+
+        /**
+         * Produces content.zip.aes and content.cus in a single pass over the archived content.
+         * The archive stream (already gzipped) goes through AES encryption, then it is stored and hashed
+         * and finally the custody signatures are computed. Each stage runs on its own thread and the stages
+         * are connected by bounded queues, so the memory usage does not depend on the content size.
+         */
+        class CreatePackagePipeline {
+        public:
+            CreatePackagePipeline(const boost::filesystem::path& aes_file_path,
+                                  const boost::filesystem::path& cus_file_path,
+                                  const decent::encrypt::AesKey& key,
+                                  const uint32_t sectors)
+                : _archived(PIPELINE_QUEUE_CAPACITY)
+                , _encrypted(PIPELINE_QUEUE_CAPACITY)
+                , _stored(PIPELINE_QUEUE_CAPACITY)
+                , _aes_file_path(aes_file_path)
+                , _cus_file_path(cus_file_path)
+                , _key(key)
+                , _sectors(sectors)
+                , _failed(false)
+            {
+                _threads.emplace_back([this]() { run_stage([this]() { encrypt_stage(); }); });
+                _threads.emplace_back([this]() { run_stage([this]() { store_stage(); }); });
+                _threads.emplace_back([this]() { run_stage([this]() { custody_stage(); }); });
+            }
+
+            ~CreatePackagePipeline() {
+                _failed = true;
+                abort();
+                join();
+            }
+
+            ChunkQueue& input() { return _archived; }
+
+            void check() const {
+                if (_failed) {
+                    FC_THROW("Package creation pipeline failed");
+                }
+            }
+
+            void finish(fc::ripemd160& hash, decent::encrypt::CustodyData& cd) {
+                _archived.close();
+                join();
+
+                if (_error) {
+                    std::rethrow_exception(_error);
+                }
+
+                hash = _hash;
+                cd = _custody_data;
+            }
+
+        private:
+            void run_stage(const std::function<void()>& stage) {
+                try {
+                    stage();
+                }
+                catch (...) {
+                    {
+                        std::lock_guard<std::mutex> guard(_error_mutex);
+                        if (!_error) {
+                            _error = std::current_exception();
+                        }
+                    }
+                    _failed = true;
+                    abort();
+                }
+            }
+
+            void abort() {
+                _archived.close();
+                _encrypted.close();
+                _stored.close();
+            }
+
+            void join() {
+                for (auto& thread : _threads) {
+                    if (thread.joinable()) {
+                        thread.join();
+                    }
+                }
+            }
+
+            void encrypt_stage() {
+                decent::encrypt::AesEncryptStream encryptor(_key);
+                std::string ciphertext;
+                Chunk chunk;
+
+                while (_archived.pop(chunk)) {
+                    encryptor.process(chunk.data(), chunk.size(), ciphertext);
+                    if (!ciphertext.empty()) {
+                        if (!_encrypted.push(Chunk(ciphertext.begin(), ciphertext.end()))) {
+                            return;
+                        }
+                        ciphertext.clear();
+                    }
+                }
+
+                if (_failed) {
+                    return;
+                }
+
+                encryptor.finish(ciphertext);
+                _encrypted.push(Chunk(ciphertext.begin(), ciphertext.end()));
+                _encrypted.close();
+            }
+
+            void store_stage() {
+                std::ofstream out(_aes_file_path.string(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+                if (!out.is_open()) {
+                    FC_THROW("Unable to open file ${fn} for writing", ("fn", _aes_file_path.string()) );
+                }
+
+                fc::ripemd160::encoder ripe_calc;
+                Chunk chunk;
+
+                while (_encrypted.pop(chunk)) {
+                    out.write(chunk.data(), chunk.size());
+                    if (!out) {
+                        FC_THROW("Unable to write to file ${fn}", ("fn", _aes_file_path.string()) );
+                    }
+                    ripe_calc.write(chunk.data(), chunk.size());
+                    if (!_stored.push(std::move(chunk))) {
+                        return;
+                    }
+                }
+
+                out.close();
+                _hash = ripe_calc.result();
+                _stored.close();
+            }
+
+            void custody_stage() {
+                decent::encrypt::CustodyUtils::CustodyDataStream custody(_cus_file_path, _sectors);
+                Chunk chunk;
+
+                while (_stored.pop(chunk)) {
+                    custody.write(chunk.data(), chunk.size());
+                }
+
+                if (!_failed) {
+                    custody.finish(_custody_data);
+                }
+            }
+
+            ChunkQueue                      _archived;
+            ChunkQueue                      _encrypted;
+            ChunkQueue                      _stored;
+            const boost::filesystem::path   _aes_file_path;
+            const boost::filesystem::path   _cus_file_path;
+            const decent::encrypt::AesKey   _key;
+            const uint32_t                  _sectors;
+            std::atomic<bool>               _failed;
+            std::mutex                      _error_mutex;
+            std::exception_ptr              _error;
+            fc::ripemd160                   _hash;
+            decent::encrypt::CustodyData    _custody_data;
+            std::vector<std::thread>        _threads;
+        };
+
+
+        /**
+         * boost::iostreams source reading the output of the package extraction pipeline.
+         */
+        class ChunkQueueSource {
+        public:
+            typedef char char_type;
+            typedef boost::iostreams::source_tag category;
+
+            ChunkQueueSource(ChunkQueue& queue, const std::function<void()>& on_chunk)
+                : _queue(&queue)
+                , _on_chunk(on_chunk)
+                , _offset(0)
+            {
+            }
+
+            std::streamsize read(char* s, std::streamsize n) {
+                while (_offset == _chunk.size()) {
+                    if (!_queue->pop(_chunk)) {
+                        return -1;
+                    }
+                    _offset = 0;
+                    _on_chunk();
+                }
+
+                const std::streamsize count = std::min<std::streamsize>(n, _chunk.size() - _offset);
+                std::memcpy(s, _chunk.data() + _offset, count);
+                _offset += count;
+                return count;
+            }
+
+        private:
+            ChunkQueue*             _queue;
+            std::function<void()>   _on_chunk;
+            Chunk                   _chunk;
+            size_t                  _offset;
+        };
+
+
+        /**
+         * Reads and decrypts content.zip.aes on its own thread, the plaintext is consumed through output()
+         * by gunzip and the dearchiver, so no decrypted copy of the archive is stored.
+         */
+        class ExtractPackagePipeline {
+        public:
+            ExtractPackagePipeline(const boost::filesystem::path& aes_file_path,
+                                   const decent::encrypt::AesKey& key)
+                : _decrypted(PIPELINE_QUEUE_CAPACITY)
+                , _aes_file_path(aes_file_path)
+                , _key(key)
+            {
+                _thread = std::thread([this]() {
+                    try {
+                        decrypt_stage();
+                    }
+                    catch (...) {
+                        _error = std::current_exception();
+                    }
+                    _decrypted.close();
+                });
+            }
+
+            ~ExtractPackagePipeline() {
+                _decrypted.close();
+                join();
+            }
+
+            ChunkQueue& output() { return _decrypted; }
+
+            /**
+             * Rethrows the error of the decryption, if any; a failure to decompress is usually caused by it.
+             */
+            void check() {
+                _decrypted.close();
+                join();
+
+                if (_error) {
+                    std::rethrow_exception(_error);
+                }
+            }
+
+            /**
+             * Consumes what is left after the archive end, so that the padding gets verified, and reports errors.
+             */
+            void finish() {
+                Chunk chunk;
+                while (_decrypted.pop(chunk)) {
+                }
+                check();
+            }
+
+        private:
+            void join() {
+                if (_thread.joinable()) {
+                    _thread.join();
+                }
+            }
+
+            void decrypt_stage() {
+                std::ifstream in(_aes_file_path.string(), std::ios::in | std::ios::binary);
+
+                if (!in.is_open()) {
+                    FC_THROW("Unable to open file ${fn} for reading", ("fn", _aes_file_path.string()) );
+                }
+
+                try {
+                    decent::encrypt::AesDecryptStream decryptor(_key);
+                    std::string plaintext;
+                    Chunk chunk(PIPELINE_CHUNK_SIZE);
+
+                    while (in) {
+                        in.read(chunk.data(), chunk.size());
+                        decryptor.process(chunk.data(), in.gcount(), plaintext);
+                        if (!plaintext.empty()) {
+                            if (!_decrypted.push(Chunk(plaintext.begin(), plaintext.end()))) {
+                                return;
+                            }
+                            plaintext.clear();
+                        }
+                    }
+
+                    if (in.bad()) {
+                        FC_THROW("Unable to read file ${fn}", ("fn", _aes_file_path.string()) );
+                    }
+
+                    decryptor.finish(plaintext);
+                    _decrypted.push(Chunk(plaintext.begin(), plaintext.end()));
+                }
+                catch (const CryptoPP::Exception& ex) {
+                    FC_THROW("Error decrypting file: ${error}", ("error", ex.GetWhat()) );
+                }
+            }
+
+            ChunkQueue                      _decrypted;
+            const boost::filesystem::path   _aes_file_path;
+            const decent::encrypt::AesKey   _key;
+            std::exception_ptr              _error;
+            std::thread                     _thread;
+        };
+
+
     } // namespace detail
 
 
@@ -228,16 +566,44 @@ namespace decent { namespace package {
                     remove_all(temp_dir_path);
                     create_directories(temp_dir_path);
 
+                    uint64_t content_size = 0;
+                    std::vector<path> all_files;
+
+                    if (is_regular_file(_content_dir_path)) {
+                        content_size = file_size(_content_dir_path);
+                    } else {
+                        detail::get_files_recursive(_content_dir_path, all_files);
+                        for (auto& file : all_files) {
+                            content_size += file_size(file);
+                        }
+                    }
+
+                    // content.zip.aes is at most about the size of the content, content.cus adds roughly another 10%
+                    if (space(temp_dir_path).available < content_size * 1.2) { // Safety margin.
+                        FC_THROW("Not enough storage space in ${path} to create package", ("path", temp_dir_path.string()) );
+                    }
+
                     PACKAGE_INFO_CHANGE_MANIPULATION_STATE(PACKING);
 
-                    const auto zip_file_path = temp_dir_path / "content.zip";
+                    const auto aes_file_path = temp_dir_path / "content.zip.aes";
+                    const auto cus_file_path = temp_dir_path / "content.cus";
+
+                    decent::encrypt::AesKey k;
+                    for (int i = 0; i < CryptoPP::AES::MAX_KEYLENGTH; i++) {
+                       k.key_byte[i] = _key.data()[i];
+                    }
+
+                    elog("the encryption key is: ${k}", ("k", _key));
+
+                    // archive -> gzip -> AES -> hash -> custody, the content is read only once
+                    detail::CreatePackagePipeline pipeline(aes_file_path, cus_file_path, k, _sectors);
 
                     {
                         using namespace boost::iostreams;
 
                         filtering_ostream out;
-                        out.push(gzip_compressor());
-                        out.push(file_sink(zip_file_path.string(), std::ios::out | std::ios::binary));
+                        out.push(gzip_compressor(), detail::PIPELINE_CHUNK_SIZE);
+                        out.push(detail::ChunkQueueSink(pipeline.input()), detail::PIPELINE_CHUNK_SIZE);
 
                         detail::Archiver archiver(out);
 
@@ -245,46 +611,20 @@ namespace decent { namespace package {
                             PACKAGE_TASK_EXIT_IF_REQUESTED;
                             archiver.put(_content_dir_path.filename().string(), _content_dir_path);
                         } else {
-                            std::vector<path> all_files;
-                            detail::get_files_recursive(_content_dir_path, all_files);
                             for (auto& file : all_files) {
                                 PACKAGE_TASK_EXIT_IF_REQUESTED;
+                                pipeline.check();
                                 archiver.put(detail::get_relative(_content_dir_path, file).string(), file);
                             }
                         }
                     }
 
                     PACKAGE_TASK_EXIT_IF_REQUESTED;
+                    PACKAGE_INFO_CHANGE_MANIPULATION_STATE(ENCRYPTING);
 
-                    if (space(temp_dir_path).available < file_size(zip_file_path) * 1.5) { // Safety margin.
-                        FC_THROW("Not enough storage space in ${path} to create package", ("path", temp_dir_path.string()) );
-                    }
-
-                   uint64_t size = 0;
+                    pipeline.finish(_package._hash, _package._custody_data);
 
-                    {
-                        PACKAGE_INFO_CHANGE_MANIPULATION_STATE(ENCRYPTING);
-
-                        const auto aes_file_path = temp_dir_path / "content.zip.aes";
-
-                        decent::encrypt::AesKey k;
-                        for (int i = 0; i < CryptoPP::AES::MAX_KEYLENGTH; i++) {
-                           k.key_byte[i] = _key.data()[i];
-                        }
-
-                        elog("the encryption key is: ${k}", ("k", _key));
-
-                        PACKAGE_TASK_EXIT_IF_REQUESTED;
-                        AES_encrypt_file(zip_file_path.string(), aes_file_path.string(), k);
-                        PACKAGE_TASK_EXIT_IF_REQUESTED;
-                        _package._hash = detail::calculate_hash(aes_file_path);
-                        PACKAGE_TASK_EXIT_IF_REQUESTED;
-                        //calculate custody...
-                        decent::encrypt::CustodyUtils::instance().create_custody_data(aes_file_path, _package._custody_data, _sectors);
-                        size += file_size( aes_file_path );
-                        const auto cus_file_path = temp_dir_path / "content.cus";
-                        size += file_size( cus_file_path );
-                    }
+                    uint64_t size = file_size(aes_file_path) + file_size(cus_file_path);
 
                     if( samples ){
                         const auto temp_samples_dir_path = temp_dir_path / "Samples";
@@ -331,7 +671,6 @@ namespace decent { namespace package {
                     paths_to_skip.clear();
                     paths_to_skip.insert(_package.get_package_state_dir(temp_dir_path));
                     paths_to_skip.insert(_package.get_lock_file_path(temp_dir_path));
-                    paths_to_skip.insert(zip_file_path);
                     detail::move_all_except(temp_dir_path, package_dir, paths_to_skip);
                     _package._size = size;
 
@@ -416,8 +755,6 @@ namespace decent { namespace package {
 
                 using namespace boost::filesystem;
 
-                const auto temp_dir_path = unique_path(graphene::utilities::decent_path_finder::instance().get_decent_temp() / "%%%%-%%%%-%%%%-%%%%");
-
                 try {
                     PACKAGE_TASK_EXIT_IF_REQUESTED;
 
@@ -433,10 +770,6 @@ namespace decent { namespace package {
 //                  PACKAGE_INFO_GENERATE_EVENT(package_extraction_progress, ( ) );
 
 
-                    create_directories(temp_dir_path);
-                    remove_all(temp_dir_path);
-                    create_directories(temp_dir_path);
-
                     if (!exists(_target_dir) || !is_directory(_target_dir)) {
                         try {
                             if (!create_directories(_target_dir) && !is_directory(_target_dir)) {
@@ -451,7 +784,6 @@ namespace decent { namespace package {
                     }
 
                     const auto aes_file_path = _package.get_content_file();
-                    const auto archive_file_path = temp_dir_path / "content.zip";
 
                     {
                         PACKAGE_INFO_CHANGE_MANIPULATION_STATE(DECRYPTING);
@@ -465,50 +797,49 @@ namespace decent { namespace package {
 
                         elog("the decryption key is: ${k}", ("k", _key));
 
-                        if (space(temp_dir_path).available < file_size(aes_file_path) * 1.5) { // Safety margin
-                            FC_THROW("Not enough storage space to create package in ${tmp_dir}", ("tmp_dir", temp_dir_path.string()) );
-                        }
-
-                        if( AES_decrypt_file(aes_file_path.string(), archive_file_path.string(), k) != decent::encrypt::ok ) {
-                           FC_THROW("Error decrypting file");
-
-                        };
-
                         PACKAGE_TASK_EXIT_IF_REQUESTED;
                         PACKAGE_INFO_CHANGE_MANIPULATION_STATE(UNPACKING);
 
+                        // AES -> gunzip -> dearchive, the content file is read only once and nothing is staged on disk
+                        detail::ExtractPackagePipeline pipeline(aes_file_path, k);
+
                         using namespace boost::iostreams;
 
                         boost::iostreams::filtering_istream istr;
-                        istr.push(gzip_decompressor());
-                        istr.push(file_source(archive_file_path.string(), std::ios::in | std::ios::binary));
+                        istr.push(gzip_decompressor(), detail::PIPELINE_CHUNK_SIZE);
+                        istr.push(detail::ChunkQueueSource(pipeline.output(), [this]() {
+                            PACKAGE_INFO_GENERATE_EVENT(package_extraction_progress, ( ) );
+                        }), detail::PIPELINE_CHUNK_SIZE);
 
-                        detail::Dearchiver dearchiver(istr);
-                        dearchiver.extract(_target_dir);
-                    }
+                        try {
+                            detail::Dearchiver dearchiver(istr);
+                            dearchiver.extract(_target_dir);
+                        }
+                        catch (...) {
+                            pipeline.check();
+                            throw;
+                        }
 
-                    remove_all(temp_dir_path);
+                        pipeline.finish();
+                    }
 
                     PACKAGE_INFO_CHANGE_DATA_STATE(CHECKED);
                     PACKAGE_INFO_CHANGE_MANIPULATION_STATE(MS_IDLE);
                     PACKAGE_INFO_GENERATE_EVENT(package_extraction_complete, ( ) );
                 }
                 catch ( const fc::exception& ex ) {
-                    remove_all(temp_dir_path);
 //                  PACKAGE_INFO_CHANGE_DATA_STATE(INVALID);
                     PACKAGE_INFO_CHANGE_MANIPULATION_STATE(MS_IDLE);
                     PACKAGE_INFO_GENERATE_EVENT(package_extraction_error, ( ex.to_detail_string() ) );
                     throw;
                 }
                 catch ( const std::exception& ex ) {
-                    remove_all(temp_dir_path);
 //                  PACKAGE_INFO_CHANGE_DATA_STATE(INVALID);
                     PACKAGE_INFO_CHANGE_MANIPULATION_STATE(MS_IDLE);
                     PACKAGE_INFO_GENERATE_EVENT(package_extraction_error, ( ex.what() ) );
                     throw;
                 }
                 catch ( ... ) {
-                    remove_all(temp_dir_path);
 //                  PACKAGE_INFO_CHANGE_DATA_STATE(INVALID);
                     PACKAGE_INFO_CHANGE_MANIPULATION_STATE(MS_IDLE);
                     PACKAGE_INFO_GENERATE_EVENT(package_extraction_error, ( "unknown" ) );
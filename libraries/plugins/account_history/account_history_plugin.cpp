@@ -23,6 +23,7 @@
  */
 
 #include <graphene/account_history/account_history_plugin.hpp>
+#include <graphene/account_history/history_store.hpp>
 
 #include <graphene/app/impacted.hpp>
 
@@ -36,6 +37,7 @@
 
 #include <fc/smart_ref_impl.hpp>
 #include <fc/thread/thread.hpp>
+#include <fc/crypto/sha256.hpp>
 
 namespace graphene { namespace account_history {
 
@@ -57,13 +59,27 @@ class account_history_plugin_impl
        */
       void update_account_histories( const signed_block& b );
 
-      graphene::chain::database& database()
+      /** links the operation into the history of the account */
+      void add_account_history( account_id_type account_id, const operation_history_object& op );
+
+      /** moves the history of irreversible blocks from the object database to _store */
+      void archive_irreversible_history();
+
+      /** @return highest sequence of @p account whose operation is not newer than @p op, 0 if there is none */
+      uint32_t find_sequence( account_id_type account, operation_history_id_type op )const;
+      optional<operation_history_object> get_operation( account_id_type account, uint32_t sequence )const;
+      /** @return operations of @p account with stop < sequence <= start, most recent first */
+      vector<operation_history_object> get_operations( account_id_type account, uint32_t stop, unsigned limit, uint32_t start )const;
+
+      graphene::chain::database& database()const
       {
          return _self.database();
       }
 
       account_history_plugin& _self;
       flat_set<account_id_type> _tracked_accounts;
+      bool _history_on_disk = false;
+      history_store _store;
 };
 
 account_history_plugin_impl::~account_history_plugin_impl()
@@ -108,46 +124,143 @@ void account_history_plugin_impl::update_account_histories( const signed_block&
             impacted.insert( item.first );
 
       // for each operation this account applies to that is in the config link it into the history
-      if( _tracked_accounts.size() == 0 )
+      bool linked = false;
+      for( auto& account_id : impacted )
       {
-         for( auto& account_id : impacted )
+         // we don't do index_account_keys here anymore, because
+         // that indexing now happens in observers' post_evaluate()
+         if( _tracked_accounts.size() == 0 || _tracked_accounts.find( account_id ) != _tracked_accounts.end() )
          {
-            // we don't do index_account_keys here anymore, because
-            // that indexing now happens in observers' post_evaluate()
-
-            // add history
-            const auto& stats_obj = account_id(db).statistics(db);
-            const auto& ath = db.create<account_transaction_history_object>( [&]( account_transaction_history_object& obj ){
-                obj.operation_id = oho.id;
-                obj.account = account_id;
-                obj.sequence = stats_obj.total_ops+1;
-                obj.next = stats_obj.most_recent_op;
-            });
-            db.modify( stats_obj, [&]( account_statistics_object& obj ){
-                obj.most_recent_op = ath.id;
-                obj.total_ops = ath.sequence;
-            });
+            add_account_history( account_id, oho );
+            linked = true;
          }
       }
-      else
+
+      // nothing can reach an operation no account history links to, don't keep it around
+      if( _history_on_disk && !linked )
+         db.remove( oho );
+   }
+
+   if( _history_on_disk )
+   {
+      // the block is valid whatever happens to the store, an exception here would reject it
+      try
+      {
+         archive_irreversible_history();
+      }
+      catch( const fc::exception& e )
       {
-         for( auto account_id : _tracked_accounts )
+         elog( "Archiving the account history failed, the histories stay in memory until restart: ${e}", ("e", e.to_detail_string()) );
+         _history_on_disk = false;
+      }
+      catch( const std::exception& e )
+      {
+         elog( "Archiving the account history failed, the histories stay in memory until restart: ${e}", ("e", e.what()) );
+         _history_on_disk = false;
+      }
+   }
+}
+
+void account_history_plugin_impl::add_account_history( account_id_type account_id, const operation_history_object& op )
+{
+   graphene::chain::database& db = database();
+   const auto& stats_obj = account_id(db).statistics(db);
+   const auto& ath = db.create<account_transaction_history_object>( [&]( account_transaction_history_object& obj ){
+       obj.operation_id = op.id;
+       obj.account = account_id;
+       obj.sequence = stats_obj.total_ops+1;
+       obj.next = stats_obj.most_recent_op;
+   });
+   db.modify( stats_obj, [&]( account_statistics_object& obj ){
+       obj.most_recent_op = ath.id;
+       obj.total_ops = ath.sequence;
+   });
+}
+
+void account_history_plugin_impl::archive_irreversible_history()
+{
+   graphene::chain::database& db = database();
+   const uint32_t last_irreversible_block = db.get_dynamic_global_properties().last_irreversible_block_num;
+   const auto& by_id_idx = db.get_index_type<account_transaction_history_index>().indices().get<by_id>();
+
+   // histories are linked in operation order, so everything irreversible is at the front of the index.
+   // Objects that reappear because a block which archived them was popped are stored already and only
+   // get removed again
+   vector<const account_transaction_history_object*> archived;
+   optional<operation_history_id_type> stored_operation;
+   uint64_t stored_position = 0;
+   for( const account_transaction_history_object& ath : by_id_idx )
+   {
+      const operation_history_object* op = db.find( ath.operation_id );
+      if( op != nullptr && op->block_num > last_irreversible_block )
+         break;
+
+      if( op != nullptr )
+      {
+         if( !_store.contains( op->id ) )
          {
-            if( impacted.find( account_id ) != impacted.end() )
-            {
-               // add history
-               const auto& stats_obj = account_id(db).statistics(db);
-               const auto& ath = db.create<account_transaction_history_object>( [&]( account_transaction_history_object& obj ){
-                   obj.operation_id = oho.id;
-                   obj.next = stats_obj.most_recent_op;
-               });
-               db.modify( stats_obj, [&]( account_statistics_object& obj ){
-                   obj.most_recent_op = ath.id;
-               });
-            }
+            stored_position = _store.store_operation( *op );
+            stored_operation = op->id;
          }
+         if( stored_operation.valid() && *stored_operation == op->id )
+            _store.store_account_entry( ath.account, ath.sequence, op->id, stored_position );
       }
+      archived.push_back( &ath );
+   }
+
+   if( archived.empty() )
+      return;
+
+   // nothing leaves the database before the store holds it, a failing store keeps the histories in memory
+   _store.commit();
+
+   for( const account_transaction_history_object* ath : archived )
+   {
+      const operation_history_id_type op_id = ath->operation_id;
+      db.remove( *ath );
+      const operation_history_object* op = db.find( op_id );
+      if( op != nullptr && (by_id_idx.empty() || by_id_idx.begin()->operation_id != op_id) )
+         db.remove( *op );
+   }
+}
+
+uint32_t account_history_plugin_impl::find_sequence( account_id_type account, operation_history_id_type op )const
+{
+   const auto& by_op_idx = database().get_index_type<account_transaction_history_index>().indices().get<by_op>();
+   auto itr = by_op_idx.upper_bound( boost::make_tuple( account, op ) );
+   if( itr != by_op_idx.begin() )
+   {
+      --itr;
+      if( itr->account == account && itr->sequence > _store.last_sequence( account ) )
+         return itr->sequence;
+   }
+   return _store.find_sequence( account, op );
+}
+
+optional<operation_history_object> account_history_plugin_impl::get_operation( account_id_type account, uint32_t sequence )const
+{
+   if( sequence <= _store.last_sequence( account ) )
+      return _store.get_operation( account, sequence );
+
+   const graphene::chain::database& db = database();
+   const auto& by_seq_idx = db.get_index_type<account_transaction_history_index>().indices().get<by_seq>();
+   auto itr = by_seq_idx.find( boost::make_tuple( account, sequence ) );
+   if( itr == by_seq_idx.end() )
+      return optional<operation_history_object>();
+   return itr->operation_id(db);
+}
+
+vector<operation_history_object> account_history_plugin_impl::get_operations( account_id_type account, uint32_t stop,
+                                                                               unsigned limit, uint32_t start )const
+{
+   vector<operation_history_object> result;
+   for( uint32_t sequence = start; sequence > stop && result.size() < limit; --sequence )
+   {
+      optional<operation_history_object> op = get_operation( account, sequence );
+      if( op.valid() )
+         result.push_back( std::move( *op ) );
    }
+   return result;
 }
 } // end namespace detail
 
@@ -177,6 +290,7 @@ void account_history_plugin::plugin_set_program_options(
 {
    cli.add_options()
          ("track-account", boost::program_options::value<std::vector<std::string>>()->composing()->multitoken(), "Account ID to track history for (may specify multiple times)")
+         ("history-on-disk", boost::program_options::bool_switch()->default_value(false), "Move the account history of irreversible blocks out of memory into an append-only store in the data directory")
          ;
    cfg.add(cli);
 }
@@ -188,15 +302,60 @@ void account_history_plugin::plugin_initialize(const boost::program_options::var
    database().add_index< primary_index< account_transaction_history_index > >();
 
    LOAD_VALUE_SET(options, "tracked-accounts", my->_tracked_accounts, graphene::chain::account_id_type);
+
+   // replay and resync rebuild the whole chain state, so the store is refilled along with it
+   const bool rebuild = options.count("replay-blockchain") || options.count("resync-blockchain");
+   const fc::path store_dir = app().data_dir() / "account_history";
+   if( options.count("history-on-disk") && options["history-on-disk"].as<bool>() )
+   {
+      my->_history_on_disk = true;
+      my->_store.open( store_dir, fc::sha256::hash( fc::raw::pack( my->_tracked_accounts ) ), rebuild );
+   }
+   else if( fc::exists( store_dir ) )
+   {
+      // the chain state does not hold the archived histories, they would be lost without a replay
+      FC_ASSERT( rebuild, "The account history store in ${dir} holds archived histories, restart with --history-on-disk "
+                          "or rebuild them in memory with --replay-blockchain", ("dir", store_dir) );
+      ilog( "Removing the account history store in ${dir}, the histories are rebuilt in memory", ("dir", store_dir) );
+      fc::remove_all( store_dir );
+   }
 }
 
 void account_history_plugin::plugin_startup()
 {
 }
 
+void account_history_plugin::plugin_shutdown()
+{
+   my->_store.close();
+}
+
 flat_set<account_id_type> account_history_plugin::tracked_accounts() const
 {
    return my->_tracked_accounts;
 }
 
+vector<operation_history_object> account_history_plugin::get_account_history( account_id_type account,
+                                                                              operation_history_id_type stop,
+                                                                              unsigned limit,
+                                                                              operation_history_id_type start )const
+{
+   FC_ASSERT( limit <= 100 );
+   const auto& db = *app().chain_database();
+   uint32_t first = start == operation_history_id_type() ? account(db).statistics(db).total_ops
+                                                         : my->find_sequence( account, start );
+   return my->get_operations( account, my->find_sequence( account, stop ), limit, first );
+}
+
+vector<operation_history_object> account_history_plugin::get_relative_account_history( account_id_type account,
+                                                                                       uint32_t stop,
+                                                                                       unsigned limit,
+                                                                                       uint32_t start )const
+{
+   FC_ASSERT( limit <= 100 );
+   const auto& db = *app().chain_database();
+   uint32_t total_ops = account(db).statistics(db).total_ops;
+   return my->get_operations( account, stop, limit, start == 0 ? total_ops : std::min( total_ops, start ) );
+}
+
 } }
@@ -0,0 +1,309 @@
+/* (c) 2016, 2017 DECENT Services. For details refers to LICENSE.txt */
+/*
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/account_history/history_store.hpp>
+
+#include <graphene/chain/protocol/fee_schedule.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/filesystem.hpp>
+
+namespace graphene { namespace account_history {
+
+history_store::mapped_file::mapped_file( const fc::path& file, uint64_t size )
+   : mapping( file.generic_string().c_str(), fc::read_only ),
+     region( mapping, fc::read_only, 0, size ),
+     data( (const char*)region.get_address() ),
+     size( size )
+{
+}
+
+fc::path history_store::segment_path( uint32_t segment )const
+{
+   return _dir / ("operations." + fc::to_string( uint64_t(segment) ));
+}
+
+const history_store::mapped_file& history_store::map_file( mapped_file_ptr& current, const fc::path& file, uint64_t min_size )const
+{
+   if( !current || current->size < min_size )
+   {
+      uint64_t file_size = fc::file_size( file );
+      FC_ASSERT( file_size >= min_size, "account history store is truncated", ("file", file)("size", file_size)("needed", min_size) );
+      current = std::make_shared<const mapped_file>( file, file_size );
+   }
+   return *current;
+}
+
+void history_store::open( const fc::path& dir, const fc::sha256& accounts_digest, bool rebuild )
+{ try {
+   _dir = dir;
+   fc::create_directories( _dir );
+
+   const fc::path state_file = _dir / "state.json";
+   _state = state();
+   if( fc::exists( state_file ) )
+   {
+      _state = fc::json::from_file( state_file ).as<state>();
+      // the archived histories are gone from the chain state, only a replay can bring them back
+      FC_ASSERT( rebuild || _state.accounts_digest == accounts_digest,
+                 "Tracked accounts changed since the account history store in ${dir} was built, restart with --replay-blockchain",
+                 ("dir", _dir) );
+   }
+   if( rebuild || _state.accounts_digest != accounts_digest )
+   {
+      if( fc::exists( state_file ) )
+         ilog( "Rebuilding the account history store in ${dir}", ("dir", _dir) );
+      fc::remove_all( _dir );
+      fc::create_directories( _dir );
+      _state = state();
+      _state.accounts_digest = accounts_digest;
+   }
+
+   // drop whatever was written after the last commit
+   for( uint32_t segment = _state.segment + 1; fc::exists( segment_path( segment ) ); ++segment )
+      fc::remove( segment_path( segment ) );
+   const fc::path pages_file = _dir / "account_pages";
+   if( fc::exists( pages_file ) )
+      boost::filesystem::resize_file( pages_file, _state.page_count * page_size );
+
+   _pages.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+   _pages.open( pages_file.generic_string().c_str(),
+                std::fstream::binary | std::fstream::in | std::fstream::out | (fc::exists( pages_file ) ? std::fstream::openmode() : std::fstream::trunc) );
+   _page_count = _state.page_count;
+   open_segment( false );
+   load_pages();
+   commit();
+} FC_CAPTURE_AND_RETHROW( (dir) ) }
+
+void history_store::open_segment( bool truncate )
+{
+   const fc::path file = segment_path( _state.segment );
+   if( _segment.is_open() )
+      _segment.close();
+   if( truncate || !fc::exists( file ) )
+   {
+      _state.segment_size = 0;
+      std::ofstream( file.generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
+   }
+   boost::filesystem::resize_file( file, _state.segment_size );
+
+   _segment.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+   _segment.open( file.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+   _segment.seekp( 0, std::fstream::end );
+   if( _segment_maps.size() <= _state.segment )
+      _segment_maps.resize( _state.segment + 1 );
+   _segment_maps[_state.segment].reset();
+}
+
+void history_store::load_pages()
+{
+   _accounts.clear();
+   _pages_map.reset();
+   if( _page_count == 0 )
+      return;
+
+   const mapped_file& pages = map_file( _pages_map, _dir / "account_pages", _page_count * page_size );
+   for( uint64_t page = 0; page < _page_count; ++page )
+   {
+      page_header header;
+      memcpy( &header, pages.data + page * page_size, sizeof(header) );
+      const page_entry* entries = (const page_entry*)(pages.data + page * page_size + sizeof(header));
+
+      // entries appended after the last commit refer to operations that were discarded
+      uint32_t count = header.count;
+      while( count > 0 && (_state.empty || entries[count - 1].operation > _state.last_operation) )
+         --count;
+      if( count != header.count )
+      {
+         header.count = count;
+         _pages.seekp( page * page_size );
+         _pages.write( (const char*)&header, sizeof(header) );
+      }
+      if( count == 0 )
+         continue;
+
+      account_pages& account = _accounts[header.account];
+      if( account.pages.empty() )
+         account.first_sequence = header.first_sequence;
+      account.pages.push_back( page );
+      account.count += count;
+   }
+   _pages.flush();
+}
+
+void history_store::commit()
+{
+   _segment.flush();
+   _pages.flush();
+   _state.segment_size = _segment.tellp();
+   _state.page_count = _page_count;
+
+   const fc::path state_file = _dir / "state.json";
+   fc::json::save_to_file( _state, _dir / "state.json.tmp" );
+   fc::rename( _dir / "state.json.tmp", state_file );
+}
+
+void history_store::close()
+{
+   if( !is_open() )
+      return;
+   commit();
+   _segment.close();
+   _pages.close();
+   _segment_maps.clear();
+   _pages_map.reset();
+   _accounts.clear();
+}
+
+bool history_store::contains( operation_history_id_type op )const
+{
+   return !_state.empty && op.instance.value <= _state.last_operation;
+}
+
+uint64_t history_store::store_operation( const operation_history_object& op )
+{
+   FC_ASSERT( !contains( op.id ), "operation is stored already", ("id", op.id)("last", _state.last_operation) );
+
+   std::vector<char> record = fc::raw::pack( op );
+   uint32_t record_size = record.size();
+   uint64_t offset = _segment.tellp();
+   if( offset > 0 && offset + sizeof(record_size) + record_size > _segment_size_limit )
+   {
+      _segment.flush();
+      ++_state.segment;
+      open_segment( true );
+      offset = 0;
+   }
+   _segment.write( (const char*)&record_size, sizeof(record_size) );
+   _segment.write( record.data(), record.size() );
+
+   _state.last_operation = op.id.instance();
+   _state.empty = false;
+   return (uint64_t(_state.segment) << 32) | offset;
+}
+
+void history_store::store_account_entry( account_id_type account, uint32_t sequence, operation_history_id_type op, uint64_t position )
+{
+   account_pages& pages = _accounts[account.instance.value];
+   if( pages.count > 0 )
+   {
+      if( sequence < pages.first_sequence + pages.count )
+         return;
+      FC_ASSERT( sequence == pages.first_sequence + pages.count, "gap in account history",
+                 ("account", account)("sequence", sequence)("expected", pages.first_sequence + pages.count) );
+   }
+   else
+      pages.first_sequence = sequence;
+
+   uint32_t slot = pages.count % entries_per_page;
+   if( slot == 0 )
+      pages.pages.push_back( _page_count++ );
+
+   page_header header;
+   header.account = account.instance.value;
+   header.first_sequence = sequence - slot;
+   header.count = slot + 1;
+   page_entry entry;
+   entry.operation = op.instance.value;
+   entry.position = position;
+
+   const uint64_t page_pos = pages.pages.back() * page_size;
+   _pages.seekp( page_pos );
+   _pages.write( (const char*)&header, sizeof(header) );
+   _pages.seekp( page_pos + sizeof(header) + slot * sizeof(page_entry) );
+   _pages.write( (const char*)&entry, sizeof(entry) );
+   if( slot == 0 )
+   {
+      // keep the file a whole number of pages
+      static const char padding[page_size] = {};
+      _pages.write( padding, page_size - sizeof(header) - sizeof(entry) );
+   }
+   ++pages.count;
+}
+
+uint32_t history_store::last_sequence( account_id_type account )const
+{
+   auto itr = _accounts.find( account.instance.value );
+   if( itr == _accounts.end() )
+      return 0;
+   return itr->second.first_sequence + itr->second.count - 1;
+}
+
+history_store::page_entry history_store::read_entry( const account_pages& pages, uint32_t index )const
+{
+   const uint64_t page = pages.pages[index / entries_per_page];
+   const uint64_t pos = page * page_size + sizeof(page_header) + (index % entries_per_page) * sizeof(page_entry);
+   const mapped_file& file = map_file( _pages_map, _dir / "account_pages", pos + sizeof(page_entry) );
+   page_entry entry;
+   memcpy( &entry, file.data + pos, sizeof(entry) );
+   return entry;
+}
+
+uint32_t history_store::find_sequence( account_id_type account, operation_history_id_type op )const
+{
+   auto itr = _accounts.find( account.instance.value );
+   if( itr == _accounts.end() )
+      return 0;
+   const account_pages& pages = itr->second;
+
+   // first index whose operation is newer than op
+   uint32_t low = 0, high = pages.count;
+   while( low < high )
+   {
+      uint32_t mid = low + (high - low) / 2;
+      if( read_entry( pages, mid ).operation <= op.instance.value )
+         low = mid + 1;
+      else
+         high = mid;
+   }
+   return low == 0 ? 0 : pages.first_sequence + low - 1;
+}
+
+optional<operation_history_object> history_store::get_operation( account_id_type account, uint32_t sequence )const
+{ try {
+   auto itr = _accounts.find( account.instance.value );
+   if( itr == _accounts.end() )
+      return optional<operation_history_object>();
+   const account_pages& pages = itr->second;
+   if( sequence < pages.first_sequence || sequence >= pages.first_sequence + pages.count )
+      return optional<operation_history_object>();
+
+   const page_entry entry = read_entry( pages, sequence - pages.first_sequence );
+   const uint32_t segment = entry.position >> 32;
+   const uint64_t offset = entry.position & 0xffffffff;
+
+   FC_ASSERT( segment < _segment_maps.size() );
+   uint32_t record_size;
+   const mapped_file* file = &map_file( _segment_maps[segment], segment_path( segment ), offset + sizeof(record_size) );
+   memcpy( &record_size, file->data + offset, sizeof(record_size) );
+   file = &map_file( _segment_maps[segment], segment_path( segment ), offset + sizeof(record_size) + record_size );
+
+   operation_history_object result;
+   fc::datastream<const char*> ds( file->data + offset + sizeof(record_size), record_size );
+   fc::raw::unpack( ds, result );
+   return result;
+} FC_CAPTURE_AND_RETHROW( (account)(sequence) ) }
+
+} } // graphene::account_history
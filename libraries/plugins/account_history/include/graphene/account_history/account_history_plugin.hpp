@@ -74,9 +74,21 @@ class account_history_plugin : public graphene::app::plugin
          boost::program_options::options_description& cfg) override;
       virtual void plugin_initialize(const boost::program_options::variables_map& options) override;
       virtual void plugin_startup() override;
+      virtual void plugin_shutdown() override;
 
       flat_set<account_id_type> tracked_accounts()const;
 
+      /** @see graphene::app::history_api::get_account_history */
+      vector<operation_history_object> get_account_history( account_id_type account,
+                                                            operation_history_id_type stop,
+                                                            unsigned limit,
+                                                            operation_history_id_type start )const;
+      /** @see graphene::app::history_api::get_relative_account_history */
+      vector<operation_history_object> get_relative_account_history( account_id_type account,
+                                                                     uint32_t stop,
+                                                                     unsigned limit,
+                                                                     uint32_t start )const;
+
       friend class detail::account_history_plugin_impl;
       std::unique_ptr<detail::account_history_plugin_impl> my;
 };
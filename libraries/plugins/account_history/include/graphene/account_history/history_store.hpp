@@ -0,0 +1,147 @@
+/* (c) 2016, 2017 DECENT Services. For details refers to LICENSE.txt */
+/*
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/operation_history_object.hpp>
+
+#include <fc/filesystem.hpp>
+#include <fc/interprocess/file_mapping.hpp>
+
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+
+namespace graphene { namespace account_history {
+   using namespace chain;
+
+   /**
+    *  Append-only on-disk store for the account histories of irreversible blocks.
+    *
+    *  Operations are appended to segment files ("operations.<n>"), each record being the size of the packed
+    *  operation_history_object followed by the object itself.  Every account owns a chain of fixed size pages
+    *  in the "account_pages" file listing the id and record position of its operations in sequence order, so
+    *  the n-th operation of an account takes one lookup and the one nearest to an operation id a binary search.
+    *  Reads go through memory mappings of those files.
+    *
+    *  Writes become durable on commit(), which records the committed sizes in "state.json"; anything written
+    *  after the last commit is discarded when the store is opened again.
+    */
+   class history_store
+   {
+      public:
+         static const uint64_t default_segment_size_limit = 256 * 1024 * 1024;
+
+         /** @param segment_size_limit size a segment file may reach before the next one is started */
+         explicit history_store( uint64_t segment_size_limit = default_segment_size_limit )
+            : _segment_size_limit( segment_size_limit ) {}
+
+         struct state
+         {
+            uint64_t   last_operation = 0; ///< instance of the newest stored operation
+            bool       empty = true;
+            uint32_t   segment = 0;        ///< segment currently appended to
+            uint64_t   segment_size = 0;   ///< committed size of that segment
+            uint64_t   page_count = 0;     ///< committed number of pages
+            fc::sha256 accounts_digest;    ///< identifies the set of tracked accounts the store was built for
+         };
+
+         /**
+          *  @param accounts_digest identifies the set of tracked accounts; a store built for a different set
+          *         cannot be reused
+          *  @param rebuild true if the chain state is rebuilt from scratch (replay or resync), in which case
+          *         an existing store is discarded and refilled, otherwise a store that cannot be reused is an error
+          */
+         void open( const fc::path& dir, const fc::sha256& accounts_digest, bool rebuild );
+         bool is_open()const { return _pages.is_open(); }
+         void commit();
+         void close();
+
+         /** @return true if @p op has been stored already and must not be appended again */
+         bool contains( operation_history_id_type op )const;
+         /** appends the record of @p op, which must be newer than any stored operation, and returns its position */
+         uint64_t store_operation( const operation_history_object& op );
+         /** adds the operation at @p position as operation @p sequence of @p account, unless it is stored already */
+         void store_account_entry( account_id_type account, uint32_t sequence, operation_history_id_type op, uint64_t position );
+
+         /** @return sequence of the newest stored operation of @p account, 0 if there is none */
+         uint32_t last_sequence( account_id_type account )const;
+         /** @return highest sequence of @p account whose operation is not newer than @p op, 0 if there is none */
+         uint32_t find_sequence( account_id_type account, operation_history_id_type op )const;
+         optional<operation_history_object> get_operation( account_id_type account, uint32_t sequence )const;
+
+      private:
+         static const uint32_t page_size = 512;
+
+         struct page_header
+         {
+            uint64_t account;
+            uint32_t first_sequence;
+            uint32_t count;
+         };
+         struct page_entry
+         {
+            uint64_t operation;
+            uint64_t position; ///< segment number in the high 32 bits, offset in the low ones
+         };
+         static const uint32_t entries_per_page = (page_size - sizeof(page_header)) / sizeof(page_entry);
+
+         struct account_pages
+         {
+            uint32_t              first_sequence = 0;
+            uint32_t              count = 0;
+            std::vector<uint64_t> pages;
+         };
+
+         struct mapped_file
+         {
+            mapped_file( const fc::path& file, uint64_t size );
+
+            fc::file_mapping  mapping;
+            fc::mapped_region region;
+            const char*       data;
+            uint64_t          size;
+         };
+         typedef std::shared_ptr<const mapped_file> mapped_file_ptr;
+
+         fc::path segment_path( uint32_t segment )const;
+         /** @return a mapping of @p file covering at least @p min_size bytes, remapping @p current if it is too short */
+         const mapped_file& map_file( mapped_file_ptr& current, const fc::path& file, uint64_t min_size )const;
+         page_entry read_entry( const account_pages& pages, uint32_t index )const;
+         void open_segment( bool truncate );
+         void load_pages();
+
+         const uint64_t                                _segment_size_limit;
+         fc::path                                      _dir;
+         state                                         _state;
+         std::fstream                                  _segment;
+         std::fstream                                  _pages;
+         uint64_t                                      _page_count = 0;
+         std::unordered_map<uint64_t, account_pages>   _accounts;
+         mutable std::vector<mapped_file_ptr>          _segment_maps;
+         mutable mapped_file_ptr                       _pages_map;
+   };
+
+} } // graphene::account_history
+
+FC_REFLECT( graphene::account_history::history_store::state,
+            (last_operation)(empty)(segment)(segment_size)(page_count)(accounts_digest) )
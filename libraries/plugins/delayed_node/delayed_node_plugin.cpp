@@ -32,14 +32,21 @@
 #include <fc/rpc/websocket_api.hpp>
 #include <fc/api.hpp>
 #include <fc/smart_ref_impl.hpp>
+#include <fc/io/raw.hpp>
+
+#include <deque>
 
 
 namespace graphene { namespace delayed_node {
 namespace bpo = boost::program_options;
 
 namespace detail {
+/// blocks fetched from the trusted node by a single get_blocks call
+static const uint32_t blocks_per_request = 100;
+
 struct delayed_node_plugin_impl {
    std::string remote_endpoint;
+   uint32_t fetch_window = 4;
    fc::http::websocket_client client;
    std::shared_ptr<fc::rpc::websocket_api_connection> client_connection;
    fc::api<graphene::app::database_api> database_api;
@@ -60,6 +67,8 @@ void delayed_node_plugin::plugin_set_program_options(bpo::options_description& c
 {
    cli.add_options()
          ("trusted-node", boost::program_options::value<std::string>()->required(), "RPC endpoint of a trusted validating node (required)")
+         ("trusted-node-fetch-window", boost::program_options::value<uint32_t>()->default_value(4),
+          "Number of block ranges requested from the trusted node ahead of the blocks being applied")
          ;
    cfg.add(cli);
 }
@@ -76,6 +85,8 @@ void delayed_node_plugin::connect()
 void delayed_node_plugin::plugin_initialize(const boost::program_options::variables_map& options)
 {
    my->remote_endpoint = "ws://" + options.at("trusted-node").as<std::string>();
+   if( options.count("trusted-node-fetch-window") )
+      my->fetch_window = std::max( 1u, options.at("trusted-node-fetch-window").as<uint32_t>() );
 }
 
 void delayed_node_plugin::sync_with_trusted_node()
@@ -99,13 +110,65 @@ void delayed_node_plugin::sync_with_trusted_node()
          break;
       }
       pass_count++;
-      while( remote_dpo.last_irreversible_block_num > db.head_block_num() )
+
+      // keep up to fetch_window ranges of blocks on their way while the oldest one is applied
+      const uint32_t last_block_num = remote_dpo.last_irreversible_block_num;
+      uint32_t next_block_num = db.head_block_num() + 1;
+      std::deque< std::pair< uint32_t, fc::future< std::vector< std::vector<char> > > > > requests;
+      try
+      {
+         while( last_block_num > db.head_block_num() )
+         {
+            while( requests.size() < my->fetch_window && next_block_num <= last_block_num )
+            {
+               const uint32_t start = next_block_num;
+               const uint32_t count = std::min( detail::blocks_per_request, last_block_num - start + 1 );
+               requests.emplace_back( count, fc::async( [this, start, count]() {
+                  return my->database_api->get_blocks( start, count );
+               }, "delayed_node_fetch_blocks" ) );
+               next_block_num += count;
+            }
+            // everything requested has been pushed, the next pass asks the trusted node again
+            if( requests.empty() )
+               break;
+
+            const uint32_t count = requests.front().first;
+            const std::vector< std::vector<char> > packed_blocks = requests.front().second.wait();
+            requests.pop_front();
+            FC_ASSERT( packed_blocks.size() == count, "Trusted node claims it has blocks it doesn't actually have." );
+
+            std::vector< graphene::chain::validated_block_ptr > blocks;
+            blocks.reserve( packed_blocks.size() );
+            for( const std::vector<char>& packed : packed_blocks )
+            {
+               blocks.push_back( std::make_shared<const graphene::chain::validated_block>(
+                                    fc::raw::unpack<graphene::chain::signed_block>( packed ) ) );
+               db.precompute_block_signee( blocks.back() );
+            }
+
+            ilog( "Pushing blocks #${f} - #${l}", ("f", blocks.front()->block_num())("l", blocks.back()->block_num()) );
+            for( const graphene::chain::validated_block_ptr& block : blocks )
+            {
+               FC_ASSERT( block->block_num() == db.head_block_num() + 1, "Trusted node sent block ${n} out of order", ("n", block->block_num()) );
+               db.push_block( *block, 0, false );
+               synced_blocks++;
+            }
+         }
+      }
+      catch( ... )
       {
-         fc::optional<graphene::chain::signed_block> block = my->database_api->get_block( db.head_block_num()+1 );
-         FC_ASSERT(block, "Trusted node claims it has blocks it doesn't actually have.");
-         ilog("Pushing block #${n}", ("n", block->block_num()));
-         db.push_block(*block, 0, false);
-         synced_blocks++;
+         // the pending fetches use this plugin and its connection, let them finish before giving up
+         for( auto& request : requests )
+         {
+            try
+            {
+               request.second.wait();
+            }
+            catch( ... )
+            {
+            }
+         }
+         throw;
       }
    }
 }
@@ -110,6 +110,17 @@ namespace detail {
 
 class SeedingListener;
 
+/**
+ * @struct por_context Chain state a PoR is built on. It is read on the service thread, so that the PoR worker
+ * threads never touch the database.
+ */
+struct por_context
+{
+   block_id_type      head_block_id;
+   uint32_t           head_block_num = 0;
+   fc::time_point_sec head_block_time;
+   chain_id_type      chain_id;
+};
 
 
 /**
@@ -135,14 +146,39 @@ public:
    //void generate_por( my_seeding_id_type so_id, graphene::package::package_object downloaded_package );
 
    /**
-    * Generates proof of retrievability of a package
-    * @param so_id ID of the my_seeding_object
-    * @param downloaded_package Downloaded package object
+    * Generates proofs of retrievability of the packages whose PoR is due, see schedule_por
     */
    void generate_pors();
 
-   void generate_por_int(const my_seeding_object &so, decent::package::package_handle_t package_handle, fc::ecc::private_key privKey);
-   void generate_por_int(const my_seeding_object &so, decent::package::package_handle_t package_handle);
+   /**
+    * Plans when the PoR of a package is checked next. Shall be called from the service thread.
+    * @param so_id ID of the my_seeding_object
+    * @param when Time of the check; generate_pors computes the actual deadline from the content then
+    */
+   void schedule_por(my_seeding_id_type so_id, fc::time_point when);
+
+   /**
+    * Generates the PoR of a package on one of the PoR worker threads. Shall be called from the service thread.
+    * @param mso Copy of the my_seeding_object
+    * @param package_handle package handle
+    * @param privKey Private key of the seeder
+    */
+   void start_por(const my_seeding_object &mso, decent::package::package_handle_t package_handle, fc::ecc::private_key privKey);
+
+   /**
+    * Reads the chain state the next PoR is built on. Shall be called from the service thread.
+    */
+   por_context get_por_context();
+
+   /**
+    * Computes the PoR of a package and broadcasts it. Uses only its arguments, so it may run on any thread.
+    * @param so Copy of the my_seeding_object
+    * @param package_handle package handle
+    * @param privKey Private key of the seeder
+    * @param ctx Chain state the PoR is built on
+    */
+   void generate_por_int(const my_seeding_object &so, decent::package::package_handle_t package_handle, fc::ecc::private_key privKey,
+                         const por_context& ctx);
    /**
     * Process new content, from content_object
     * @param co Content object
@@ -200,6 +236,13 @@ public:
 //   std::map<package_transfer_interface::transfer_id, my_seeding_id_type> active_downloads; //<List of active downloads for whose we are expecting on_download_finished callback to be called
    std::shared_ptr<fc::thread> service_thread; //The thread where the computation shall happen
    fc::thread* main_thread; //The main thread, used mainly for DB modifications
+   std::vector<std::shared_ptr<fc::thread>> por_threads; //<Worker threads generating PoRs
+   size_t next_por_thread = 0;
+
+   // the PoR schedule is accessed from the service thread only
+   std::set<std::pair<fc::time_point, my_seeding_id_type>> por_schedule; //<Packages ordered by the time their PoR is checked next
+   std::map<my_seeding_id_type, fc::time_point> por_check_times; //<Time of the scheduled check of each package
+   std::set<my_seeding_id_type> pors_in_progress; //<Packages whose PoR is being generated by a worker thread
 
 };
 
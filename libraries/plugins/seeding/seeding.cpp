@@ -12,6 +12,7 @@
 #include <decent/package/package_config.hpp>
 #include <fc/smart_ref_impl.hpp>
 #include <algorithm>
+#include <thread>
 #include <ipfs/client.h>
 #include <graphene/chain/hardfork.hpp>
 
@@ -21,6 +22,7 @@ namespace bpo = boost::program_options;
 namespace detail {
 
 #define POR_WAKEUP_INTERVAL_SEC 300
+#define POR_MAX_WORKER_THREADS 4
 
 seeding_plugin_impl::~seeding_plugin_impl() {
    return;
@@ -206,29 +208,30 @@ void seeding_plugin_impl::handle_commited_operation(const operation_history_obje
 }
 
 
-void
-seeding_plugin_impl::generate_por_int(const my_seeding_object &mso, decent::package::package_handle_t package_handle)
-{try{
-      const auto& sidx = database().get_index_type<my_seeder_index>().indices().get<by_seeder>();
-      const auto& seeder = sidx.find(mso.seeder);
-      generate_por_int(mso, package_handle, seeder->privKey);
-}FC_CAPTURE_AND_RETHROW((mso))}
+por_context seeding_plugin_impl::get_por_context()
+{
+   graphene::chain::database &db = database();
+   const auto& dyn_props = db.get_dynamic_global_properties();
+   por_context ctx;
+   ctx.head_block_id = dyn_props.head_block_id;
+   ctx.head_block_num = dyn_props.head_block_number;
+   ctx.head_block_time = dyn_props.time;
+   ctx.chain_id = db.get_chain_id();
+   return ctx;
+}
 
 void
-seeding_plugin_impl::generate_por_int(const my_seeding_object &mso, decent::package::package_handle_t package_handle, fc::ecc::private_key privKey)
+seeding_plugin_impl::generate_por_int(const my_seeding_object &mso, decent::package::package_handle_t package_handle, fc::ecc::private_key privKey,
+                                      const por_context& ctx)
 {try {
-   graphene::chain::database &db = database();
    ilog("seeding plugin_impl: generate_por() - Creating operation");
    proof_of_custody_operation op;
    decent::encrypt::CustodyProof proof;
 
-   auto dyn_props = db.get_dynamic_global_properties();
-
    if(mso.cd && !package_handle->is_virtual ){
       ilog("seeding plugin_impl: generate_por() - calculating full PoR");
-      fc::ripemd160 b_id = dyn_props.head_block_id;
-      uint32_t b_num = dyn_props.head_block_number;
-      proof.reference_block = b_num;
+      fc::ripemd160 b_id = ctx.head_block_id;
+      proof.reference_block = ctx.head_block_num;
       for( int i = 0; i < 5; i++ )
          proof.seed.data[i] = b_id._hash[i]; //use the block ID as source of entrophy
 
@@ -247,13 +250,11 @@ seeding_plugin_impl::generate_por_int(const my_seeding_object &mso, decent::pack
    signed_transaction tx;
    tx.operations.push_back(op);
 
-   tx.set_reference_block(dyn_props.head_block_id);
-   tx.set_expiration(dyn_props.time + fc::seconds(30));
+   tx.set_reference_block(ctx.head_block_id);
+   tx.set_expiration(ctx.head_block_time + fc::seconds(30));
    tx.validate();
 
-   chain_id_type _chain_id = db.get_chain_id();
-
-   tx.sign(privKey, _chain_id);
+   tx.sign(privKey, ctx.chain_id);
    idump((tx));
 
    main_thread->async([this, tx]() { database().push_transaction(tx); });
@@ -273,11 +274,41 @@ void seeding_plugin_impl::release_package(const my_seeding_object &mso, decent::
    return;
 }
 
+void seeding_plugin_impl::schedule_por(my_seeding_id_type so_id, fc::time_point when)
+{
+   auto itr = por_check_times.find(so_id);
+   if( itr != por_check_times.end() ) {
+      por_schedule.erase(std::make_pair(itr->second, so_id));
+      itr->second = when;
+   } else
+      por_check_times.emplace(so_id, when);
+   por_schedule.emplace(when, so_id);
+}
+
+void seeding_plugin_impl::start_por(const my_seeding_object &mso, decent::package::package_handle_t package_handle, fc::ecc::private_key privKey)
+{
+   my_seeding_id_type so_id = mso.id;
+   const por_context ctx = get_por_context();
+   pors_in_progress.insert(so_id);
+   std::shared_ptr<fc::thread> worker = por_threads[next_por_thread++ % por_threads.size()];
+   worker->async([this, mso, package_handle, privKey, so_id, ctx]() {
+        try {
+           generate_por_int(mso, package_handle, privKey, ctx);
+        } catch( const fc::exception& e ) {
+           elog("seeding plugin_impl:  PoR generation for ${c} failed: ${e}", ("c", mso.URI)("e", e.to_detail_string()));
+        } catch( ... ) {
+           elog("seeding plugin_impl:  PoR generation for ${c} failed", ("c", mso.URI));
+        }
+        service_thread->async([this, so_id]() { pors_in_progress.erase(so_id); });
+   }, "Seeding plugin PoR worker");
+}
+
 void
 seeding_plugin_impl::generate_pors()
 {try{
    /*
     * Generate_por just generates the POR. The checking when and if have to be perfomed at upper layer.
+    * Only the packages whose check is due are visited, the rest waits in por_schedule.
     */
    graphene::chain::database &db = database();
    const auto &sidx = db.get_index_type<my_seeder_index>().indices().get<by_seeder>();
@@ -285,22 +316,30 @@ seeding_plugin_impl::generate_pors()
    ilog("seeding plugin_impl:  generate_pors() start");
    auto& pm = decent::package::PackageManager::instance();
 
-   for (const auto& mso : seeding_idx ) {
-      //Collect data first...
+   const fc::time_point now = fc::time_point::now();
+   while( !por_schedule.empty() && por_schedule.begin()->first <= now ) {
+      const my_seeding_id_type so_id = por_schedule.begin()->second;
+      por_schedule.erase(por_schedule.begin());
+      por_check_times.erase(so_id);
 
-      if(!mso.downloaded || mso.deleted )
+      const auto mso_itr = seeding_idx.find(so_id);
+      if( mso_itr == seeding_idx.end() || !mso_itr->downloaded || mso_itr->deleted )
+         continue;
+      const my_seeding_object& mso = *mso_itr;
+      if( pors_in_progress.count(so_id) ) {
+         schedule_por(so_id, now + fc::seconds(POR_WAKEUP_INTERVAL_SEC));
          continue;
+      }
       ilog("seeding plugin_impl:  generate_pors() content ${c} downloaded, continue processing", ("c", mso.URI));
-      auto package_handle = pm.get_package(mso.URI, mso._hash);
-      package_handle->remove_all_event_listeners();
 
       const auto &sritr = sidx.find(mso.seeder);
       FC_ASSERT(sritr != sidx.end());
       const auto &content = mso.get_content(db);
 
-
-      if( content.expiration < fc::time_point::now()) {
+      if( content.expiration < now ) {
          ilog("seeding plugin_impl:  generate_pors() content ${c} expired, clenaing up", ("c", mso.URI));
+         auto package_handle = pm.get_package(mso.URI, mso._hash);
+         package_handle->remove_all_event_listeners();
          release_package(mso, package_handle);
          ilog("seeding plugin_impl:  generate_pors() content cleaned, continue");
          continue;
@@ -309,7 +348,7 @@ seeding_plugin_impl::generate_pors()
 
       /*
        * calculate time when next PoR has to be sent out. The time shall be:
-       * 1. now after submitting the new content (generate_por_int is called directly from the callback, so not handled here);
+       * 1. now after submitting the new content (start_por is called directly from the callback, so not handled here);
        * 2. 23:55 after the last PoR
        * 3. 5m before the expiration time
        */
@@ -323,19 +362,24 @@ seeding_plugin_impl::generate_pors()
                                   content.expiration - fc::seconds(POR_WAKEUP_INTERVAL_SEC));
       } catch( std::out_of_range e ) {
          //no proof has been delivered by us yet...
-         generate_time = fc::time_point::now() + fc::seconds(1);
+         generate_time = now + fc::seconds(1);
       }
 
       ilog("seeding plugin_impl:  generate_por() - generate time for this content is planned at ${t}",
            ("t", generate_time));
-      //If we are about to generate PoR, generate it.
-      if( fc::time_point(generate_time) < fc::time_point::now() + fc::seconds(POR_WAKEUP_INTERVAL_SEC) ){
-         try {
-            generate_por_int(mso, package_handle, sritr->privKey);
-         }catch(...){}
-      }
+      //If we are about to generate PoR, generate it and check again whether it made it into the chain.
+      if( fc::time_point(generate_time) < now + fc::seconds(POR_WAKEUP_INTERVAL_SEC) ){
+         auto package_handle = pm.get_package(mso.URI, mso._hash);
+         package_handle->remove_all_event_listeners();
+         start_por(mso, package_handle, sritr->privKey);
+         schedule_por(so_id, now + fc::seconds(POR_WAKEUP_INTERVAL_SEC));
+      } else
+         schedule_por(so_id, fc::time_point(generate_time) - fc::seconds(POR_WAKEUP_INTERVAL_SEC));
    }
-   fc::time_point next_wakeup( fc::time_point::now() + fc::seconds(POR_WAKEUP_INTERVAL_SEC ));
+
+   fc::time_point next_wakeup( now + fc::seconds(POR_WAKEUP_INTERVAL_SEC ));
+   if( !por_schedule.empty() )
+      next_wakeup = std::max(std::min(next_wakeup, por_schedule.begin()->first), now + fc::seconds(1));
 
    ilog("seeding plugin_impl:  generate_pors() - planning next wake-up at ${t}",("t", next_wakeup) );
    service_thread->schedule([this]() { generate_pors(); }, next_wakeup,
@@ -432,44 +476,44 @@ void seeding_plugin_impl::send_ready_to_publish()
 
 
 void seeding_plugin_impl::resend_keys(){
-   //Re-send all missing keys
+   //Re-send all missing keys. Only the open buyings of the content we seed are visited, found through by_URI_open.
    const auto& sidx = database().get_index_type<my_seeder_index>().indices().get<by_seeder>();
-   const auto& buying_range = database().get_index_type<buying_index>().indices().get<by_open_expiration>().equal_range( true );
+   const auto& bidx = database().get_index_type<buying_index>().indices().get<by_URI_open>();
    const auto& content_idx = database().get_index_type<content_index>().indices().get<graphene::chain::by_URI>();
    const auto& cidx = database().get_index_type<my_seeding_index>().indices().get<by_URI>();
-   auto sitr = sidx.begin();
 
-   while( sitr != sidx.end() )
+   for( const my_seeding_object& mso : cidx )
    {
-      std::for_each(buying_range.first, buying_range.second, [&](const buying_object &buying_element)
-      {
-           const auto& content_itr = content_idx.find( buying_element.URI );
-           if( cidx.find(buying_element.URI) != cidx.end() ) //in case that some reason we don't have this content in the internal database, e.g. it was deleted or it is fraud
-
-              if( content_itr != content_idx.end() && buying_element.expiration_time >= database().head_block_time() )
-              {
+      if( mso.deleted || sidx.find( mso.seeder ) == sidx.end() )
+         continue;
+      const auto& content_itr = content_idx.find( mso.URI );
+      if( content_itr == content_idx.end() || content_itr->key_parts.find( mso.seeder ) == content_itr->key_parts.end() )
+         continue;
 
-                 for( const auto& seeder_element : content_itr->key_parts )
-                 {
-                    if( seeder_element.first == sitr->seeder &&
-                        std::find(buying_element.seeders_answered.begin(), buying_element.seeders_answered.end(), (sitr->seeder)) == buying_element.seeders_answered.end() )
-                    {
-                       request_to_buy_operation rtb_op;
-                       rtb_op.URI = buying_element.URI;
-                       rtb_op.consumer = buying_element.consumer;
-                       rtb_op.pubKey = buying_element.pubKey;
-                       rtb_op.price = buying_element.price;
-                       rtb_op.region_code_from = buying_element.region_code_from;
-                       ilog("seeding_plugin:  restore_state() processing unhandled request to buy ${s}",("s",rtb_op));
-                       handle_request_to_buy( rtb_op );
-                       break;
-                    }
-                 }
-              }
-      });
-      sitr++;
+      const auto buying_range = bidx.equal_range( std::make_tuple( mso.URI, true ) );
+      std::vector<request_to_buy_operation> missing;
+      for( auto bitr = buying_range.first; bitr != buying_range.second; ++bitr )
+      {
+         const buying_object& buying_element = *bitr;
+         if( buying_element.expiration_time < database().head_block_time() ||
+             std::find(buying_element.seeders_answered.begin(), buying_element.seeders_answered.end(), mso.seeder) != buying_element.seeders_answered.end() )
+            continue;
+
+         request_to_buy_operation rtb_op;
+         rtb_op.URI = buying_element.URI;
+         rtb_op.consumer = buying_element.consumer;
+         rtb_op.pubKey = buying_element.pubKey;
+         rtb_op.price = buying_element.price;
+         rtb_op.region_code_from = buying_element.region_code_from;
+         missing.push_back( rtb_op );
+      }
+      // handle_request_to_buy pushes a transaction, which modifies the buying objects we would be iterating over
+      for( const auto& rtb_op : missing )
+      {
+         ilog("seeding_plugin:  resend_keys() processing unhandled request to buy ${s}",("s",rtb_op));
+         handle_request_to_buy( rtb_op );
+      }
    }
-
 }
 
 void seeding_plugin_impl::restore_state(){
@@ -552,6 +596,7 @@ void seeding_plugin_impl::restore_state(){
 
            if(already_have){
               database().modify<my_seeding_object>(*citr, [](my_seeding_object& so){so.downloaded = true;});
+              schedule_por(citr->id, fc::time_point::now());
 
            }else{
               elog("restarting downloads, re-downloading package ${u}", ("u", citr->URI));
@@ -686,6 +731,9 @@ void seeding_plugin::plugin_pre_startup( const seeding_plugin_startup_options& s
    ilog("starting service thread");
    my = unique_ptr<detail::seeding_plugin_impl>( new detail::seeding_plugin_impl( *this) );
    my->service_thread = std::make_shared<fc::thread>("seeding");
+   const size_t por_thread_count = std::max(1u, std::min(std::thread::hardware_concurrency(), (unsigned)POR_MAX_WORKER_THREADS));
+   for( size_t i = 0; i < por_thread_count; ++i )
+      my->por_threads.push_back(std::make_shared<fc::thread>("seeding PoR " + std::to_string(i)));
    my->main_thread = &fc::thread::current();
 
    database().on_new_commited_operation.connect( [&]( const operation_history_object& b ){ my->handle_commited_operation( b, false ); } );
@@ -780,7 +828,13 @@ void detail::SeedingListener::package_download_complete() {
    //Don't block package manager thread for too long.
    seeding_plugin_impl *my = _my;
    _my->database().modify<my_seeding_object>(mso, [](my_seeding_object& so){so.downloaded = true;});
-   _my->service_thread->async([ this, &mso, pi ]() { _my->generate_por_int(mso, pi); });
+   _my->service_thread->async([ this, &mso, pi ]() {
+        const auto& sidx = _my->database().get_index_type<my_seeder_index>().indices().get<by_seeder>();
+        const auto& seeder = sidx.find(mso.seeder);
+        FC_ASSERT(seeder != sidx.end());
+        _my->start_por(mso, pi, seeder->privKey);
+        _my->schedule_por(mso.id, fc::time_point::now() + fc::seconds(POR_WAKEUP_INTERVAL_SEC));
+   });
 };
 
 
@@ -0,0 +1,130 @@
+/* (c) 2016, 2017 DECENT Services. For details refers to LICENSE.txt */
+/*
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE "P2P connection throughput benchmark"
+#include <boost/test/included/unit_test.hpp>
+
+#include <graphene/net/message_oriented_connection.hpp>
+#include <graphene/net/config.hpp>
+
+#include <fc/network/tcp_socket.hpp>
+#include <fc/network/ip.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/thread/future.hpp>
+
+#include <iostream>
+
+using namespace graphene::net;
+
+namespace {
+
+/** counts what arrives and fires a promise once the expected number of bytes are in */
+class counting_delegate : public message_oriented_connection_delegate
+{
+public:
+   uint64_t expected_bytes = 0;
+   uint64_t received_bytes = 0;
+   uint64_t received_messages = 0;
+   fc::promise<void>::ptr done;
+
+   void on_message(message_oriented_connection*, const message& received_message) override
+   {
+      ++received_messages;
+      received_bytes += received_message.size;
+      if( received_bytes == expected_bytes && done )
+         done->set_value();
+   }
+   void on_connection_closed(message_oriented_connection*) override {}
+};
+
+struct loopback_pair
+{
+   counting_delegate           receiver;
+   counting_delegate           unused;
+   fc::tcp_server              server;
+   message_oriented_connection sink;
+   message_oriented_connection source;
+
+   explicit loopback_pair(size_t buffer_size)
+      : sink(&receiver, buffer_size), source(&unused, buffer_size)
+   {
+      server.listen(0);
+      fc::future<void> accepted = fc::async([this](){
+         server.accept(sink.get_socket());
+         sink.accept();
+      }, "net_benchmark accept");
+      source.connect_to(fc::ip::endpoint(fc::ip::address("127.0.0.1"), server.get_port()));
+      accepted.wait();
+   }
+};
+
+/**
+ *  Pushes @p total_bytes of @p message_size byte messages through a loopback connection,
+ *  @p batch messages per send_messages() call, and returns the throughput in MB/s.
+ */
+double measure(size_t buffer_size, uint32_t message_size, size_t batch, uint64_t total_bytes)
+{
+   loopback_pair pair(buffer_size);
+
+   message m;
+   m.msg_type = 5000;
+   m.size = message_size;
+   m.data.resize(message_size, 'x');
+   std::vector<message> messages(batch, m);
+
+   uint64_t message_count = std::max<uint64_t>(total_bytes / message_size, batch);
+   message_count -= message_count % batch;
+   pair.receiver.expected_bytes = message_count * message_size;
+   pair.receiver.done.reset(new fc::promise<void>("net_benchmark done"));
+
+   fc::time_point start = fc::time_point::now();
+   for( uint64_t sent = 0; sent < message_count; sent += batch )
+      pair.source.send_messages(messages);
+   fc::future<void>(pair.receiver.done).wait(fc::seconds(300));
+   fc::microseconds elapsed = fc::time_point::now() - start;
+
+   BOOST_CHECK_EQUAL(pair.receiver.received_messages, message_count);
+
+   pair.source.close_connection();
+   pair.sink.close_connection();
+
+   double mb_per_sec = double(pair.receiver.received_bytes) / (1024 * 1024) / (double(elapsed.count()) / 1000000);
+   std::cout << "buffer " << buffer_size << " B, message " << message_size << " B, batch " << batch
+             << ": " << mb_per_sec << " MB/s" << std::endl;
+   return mb_per_sec;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( loopback_throughput )
+{
+   const uint64_t total_bytes = 256 * 1024 * 1024;
+   for( uint32_t message_size : { 256u, 4096u, 64u * 1024u, 1024u * 1024u } )
+   {
+      // 4 KiB buffers with one message per write approximate the old behaviour
+      measure(4096, message_size, 1, total_bytes);
+      measure(GRAPHENE_NET_DEFAULT_SOCKET_BUFFER_SIZE, message_size, 1, total_bytes);
+      measure(GRAPHENE_NET_DEFAULT_SOCKET_BUFFER_SIZE, message_size,
+              std::max<size_t>(1, GRAPHENE_NET_MAX_COALESCED_SEND_SIZE / message_size), total_bytes);
+   }
+}
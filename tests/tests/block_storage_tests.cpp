@@ -0,0 +1,246 @@
+/* (c) 2016, 2017 DECENT Services. For details refers to LICENSE.txt */
+/*
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <graphene/app/database_api.hpp>
+#include <graphene/chain/block_database.hpp>
+#include <graphene/chain/budget_record_object.hpp>
+#include <graphene/chain/global_property_object.hpp>
+#include <graphene/chain/protocol/block.hpp>
+#include <graphene/chain/protocol/fee_schedule.hpp>
+
+#include <fc/crypto/digest.hpp>
+#include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+#include "../common/database_fixture.hpp"
+#include "../common/tempdir.hpp"
+
+using namespace graphene::chain;
+using namespace graphene::chain::test;
+
+namespace {
+
+genesis_state_type make_checkpoint_genesis()
+{
+   genesis_state_type genesis_state;
+   genesis_state.initial_timestamp = time_point_sec( GRAPHENE_TESTING_GENESIS_TIMESTAMP );
+
+   auto init_account_priv_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "null_key" ) ) );
+   genesis_state.initial_active_miners = 10;
+   for( int i = 0; i < genesis_state.initial_active_miners; ++i )
+   {
+      auto name = "init" + fc::to_string( i );
+      genesis_state.initial_accounts.emplace_back( name,
+                                                   init_account_priv_key.get_public_key(),
+                                                   init_account_priv_key.get_public_key() );
+      genesis_state.initial_miner_candidates.push_back( {name, init_account_priv_key.get_public_key()} );
+   }
+   genesis_state.initial_parameters.current_fees->zero_all_fees();
+   return genesis_state;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE( block_storage_tests )
+
+BOOST_AUTO_TEST_CASE( validated_block_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto signing_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "validated_block" ) ) );
+
+      signed_block b;
+      b.miner = miner_id_type(1);
+      b.transactions.resize( 3 );
+      for( uint32_t i = 0; i < b.transactions.size(); ++i )
+         b.transactions[i].ref_block_num = i;
+      b.transaction_merkle_root = b.calculate_merkle_root();
+      b.sign( signing_key );
+
+      const validated_block vb( b );
+      FC_ASSERT( vb.id() == b.id() );
+      FC_ASSERT( vb.block_num() == b.block_num() );
+      FC_ASSERT( vb.signee() == signing_key.get_public_key() );
+      FC_ASSERT( vb.merkle_root() == b.transaction_merkle_root );
+      FC_ASSERT( vb.transaction_ids().size() == b.transactions.size() );
+      for( uint32_t i = 0; i < b.transactions.size(); ++i )
+         FC_ASSERT( vb.transaction_ids()[i] == b.transactions[i].id() );
+      FC_ASSERT( vb.packed() == fc::raw::pack( b ) );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      bdb.store( vb );
+      auto fetch = bdb.fetch_optional( b.id() );
+      FC_ASSERT( fetch.valid() );
+      FC_ASSERT( fetch->id() == b.id() );
+      FC_ASSERT( fetch->transactions.size() == b.transactions.size() );
+      bdb.close();
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( fetch_packed_range )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      block_database bdb;
+      bdb.open( data_dir.path() );
+
+      vector<signed_block> blocks;
+      block_id_type previous;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         signed_block b;
+         b.previous = previous;
+         b.timestamp = fc::time_point_sec( GRAPHENE_TESTING_GENESIS_TIMESTAMP + i );
+         b.miner = miner_id_type( i );
+         bdb.store( b.id(), b );
+         previous = b.id();
+         blocks.push_back( b );
+      }
+      bdb.flush();
+
+      auto check_range = [&]( uint32_t first, uint32_t count, uint32_t expected )
+      {
+         const vector<vector<char>> packed = bdb.fetch_packed_range( first, count );
+         BOOST_REQUIRE_EQUAL( packed.size(), expected );
+         for( uint32_t i = 0; i < packed.size(); ++i )
+         {
+            const signed_block b = fc::raw::unpack<signed_block>( packed[i] );
+            BOOST_CHECK_EQUAL( b.block_num(), first + i );
+            BOOST_CHECK( b.id() == blocks[first + i - 1].id() );
+         }
+      };
+
+      check_range( 1, 10, 10 );
+      check_range( 4, 3, 3 );
+      // the range is cut short at the last block
+      check_range( 8, 5, 3 );
+      check_range( 10, 100, 1 );
+      // nothing past the last block, no block 0 and no empty range
+      check_range( 11, 5, 0 );
+      check_range( 0, 5, 0 );
+      check_range( 3, 0, 0 );
+
+      // a missing block ends the range
+      bdb.remove( blocks[6].id() );
+      check_range( 5, 5, 2 );
+      check_range( 7, 5, 0 );
+      bdb.close();
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( get_blocks, database_fixture )
+{
+   try {
+      generate_blocks( 5 );
+      const uint32_t head_num = db.head_block_num();
+      graphene::app::database_api db_api( db );
+
+      vector<vector<char>> packed = db_api.get_blocks( 1, 100 );
+      BOOST_REQUIRE_EQUAL( packed.size(), head_num );
+      for( uint32_t i = 0; i < packed.size(); ++i )
+      {
+         const signed_block b = fc::raw::unpack<signed_block>( packed[i] );
+         BOOST_CHECK_EQUAL( b.block_num(), i + 1 );
+         BOOST_CHECK( b.id() == db.get_block_id_for_num( i + 1 ) );
+      }
+
+      packed = db_api.get_blocks( head_num, 10 );
+      BOOST_REQUIRE_EQUAL( packed.size(), 1u );
+      BOOST_CHECK( fc::raw::unpack<signed_block>( packed[0] ).id() == db.head_block_id() );
+
+      BOOST_CHECK( db_api.get_blocks( head_num + 1, 10 ).empty() );
+      BOOST_CHECK( db_api.get_blocks( 1, 0 ).empty() );
+      GRAPHENE_REQUIRE_THROW( db_api.get_blocks( 1, 101 ), fc::exception );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( state_checkpoint_fallback )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      const auto init_account_priv_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "null_key" ) ) );
+      block_id_type head_id;
+      uint32_t head_num;
+      {
+         database db;
+         db.open( data_dir.path(), make_checkpoint_genesis );
+         db.set_state_checkpoint_interval( 5 );
+         for( uint32_t i = 0; i < 60; ++i )
+            db.generate_block( db.get_slot_time( 1 ), db.get_scheduled_miner( 1 ), init_account_priv_key, database::skip_nothing );
+         head_id = db.head_block_id();
+         head_num = db.head_block_num();
+         // keep the reversible blocks, as an unclean shutdown would
+         db.close( false );
+      }
+
+      // the newest checkpoint gets the global properties of the older one, which passes the checksum
+      // but fails once loaded, after all the other objects of the checkpoint are in memory
+      const fc::path checkpoints_dir = data_dir.path() / "state_checkpoints";
+      vector<uint32_t> checkpoints;
+      for( fc::directory_iterator itr( checkpoints_dir ); itr != fc::directory_iterator(); ++itr )
+         checkpoints.push_back( std::stoul( (*itr).filename().generic_string() ) );
+      BOOST_REQUIRE_EQUAL( checkpoints.size(), 2u );
+      std::sort( checkpoints.begin(), checkpoints.end() );
+      const fc::path older = checkpoints_dir / fc::to_string( checkpoints[0] );
+      const fc::path newer = checkpoints_dir / fc::to_string( checkpoints[1] );
+      const fc::path dgp_file = fc::path( fc::to_string( uint64_t( dynamic_global_property_object::space_id ) ) ) /
+                                fc::to_string( uint64_t( dynamic_global_property_object::type_id ) );
+      fc::remove( newer / dgp_file );
+      fc::copy( older / dgp_file, newer / dgp_file );
+
+      database db;
+      fc::mutable_variant_object manifest( fc::json::from_file( newer / "manifest.json" ).get_object() );
+      manifest["checksum"] = fc::variant( db.snapshot_checksum( newer ) );
+      fc::json::save_to_file( fc::variant( manifest ), newer / "manifest.json" );
+
+      BOOST_CHECK( !db.replay_from_checkpoint( data_dir.path() ) );
+      db.reindex( data_dir.path(), make_checkpoint_genesis() );
+
+      BOOST_CHECK_EQUAL( db.head_block_num(), head_num );
+      BOOST_CHECK( db.head_block_id() == head_id );
+      // nothing of the failed checkpoint is counted twice by the secondary indexes
+      const real_supply supply = db.get_real_supply();
+      const real_supply scanned = db.scan_real_supply();
+      BOOST_CHECK( supply.account_balances == scanned.account_balances );
+      BOOST_CHECK( supply.vesting_balances == scanned.vesting_balances );
+      db.close();
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
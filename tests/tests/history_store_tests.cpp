@@ -0,0 +1,233 @@
+/* (c) 2016, 2017 DECENT Services. For details refers to LICENSE.txt */
+/*
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <graphene/account_history/history_store.hpp>
+
+#include <graphene/chain/protocol/fee_schedule.hpp>
+
+#include <fc/io/raw.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+#include <fstream>
+
+#include "../common/tempdir.hpp"
+
+using namespace graphene::chain;
+using graphene::account_history::history_store;
+
+namespace {
+
+const fc::sha256 tracked_accounts = fc::sha256::hash( std::string( "all" ) );
+
+operation_history_object make_operation( uint64_t instance )
+{
+   operation_history_object op;
+   op.id = operation_history_id_type( instance );
+   op.block_num = uint32_t( instance );
+   op.trx_in_block = uint16_t( instance % 7 );
+   return op;
+}
+
+/** stores operation @p instance as the next operation of each of @p accounts */
+void archive( history_store& store, uint64_t instance, std::initializer_list<account_id_type> accounts )
+{
+   const operation_history_object op = make_operation( instance );
+   const uint64_t position = store.store_operation( op );
+   for( account_id_type account : accounts )
+      store.store_account_entry( account, store.last_sequence( account ) + 1, op.id, position );
+}
+
+void append_garbage( const fc::path& file )
+{
+   std::ofstream out( file.generic_string().c_str(), std::ofstream::binary | std::ofstream::app );
+   const char garbage[100] = { 1, 2, 3 };
+   out.write( garbage, sizeof(garbage) );
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE( history_store_tests )
+
+BOOST_AUTO_TEST_CASE( find_sequence )
+{ try {
+   fc::temp_directory dir( graphene::utilities::temp_directory_path() );
+   history_store store;
+   store.open( dir.path(), tracked_accounts, false );
+
+   const account_id_type alice( 10 ), bob( 11 );
+   // alice gets the odd operations, bob every third one, spread over several pages
+   for( uint64_t instance = 1; instance <= 200; ++instance )
+   {
+      if( instance % 2 == 1 && instance % 3 == 0 )
+         archive( store, instance, { alice, bob } );
+      else if( instance % 2 == 1 )
+         archive( store, instance, { alice } );
+      else if( instance % 3 == 0 )
+         archive( store, instance, { bob } );
+   }
+   store.commit();
+
+   BOOST_CHECK_EQUAL( store.last_sequence( alice ), 100u );
+   BOOST_CHECK_EQUAL( store.last_sequence( bob ), 66u );
+   BOOST_CHECK_EQUAL( store.last_sequence( account_id_type( 12 ) ), 0u );
+
+   BOOST_CHECK_EQUAL( store.find_sequence( alice, operation_history_id_type( 0 ) ), 0u );
+   BOOST_CHECK_EQUAL( store.find_sequence( alice, operation_history_id_type( 1 ) ), 1u );
+   BOOST_CHECK_EQUAL( store.find_sequence( alice, operation_history_id_type( 2 ) ), 1u );
+   BOOST_CHECK_EQUAL( store.find_sequence( alice, operation_history_id_type( 99 ) ), 50u );
+   BOOST_CHECK_EQUAL( store.find_sequence( alice, operation_history_id_type( 1000 ) ), 100u );
+   BOOST_CHECK_EQUAL( store.find_sequence( bob, operation_history_id_type( 2 ) ), 0u );
+   BOOST_CHECK_EQUAL( store.find_sequence( bob, operation_history_id_type( 100 ) ), 33u );
+   BOOST_CHECK_EQUAL( store.find_sequence( account_id_type( 12 ), operation_history_id_type( 100 ) ), 0u );
+
+   optional<operation_history_object> op = store.get_operation( alice, 50 );
+   BOOST_REQUIRE( op.valid() );
+   BOOST_CHECK( op->id == operation_history_id_type( 99 ) );
+   op = store.get_operation( bob, 33 );
+   BOOST_REQUIRE( op.valid() );
+   BOOST_CHECK( op->id == operation_history_id_type( 99 ) );
+   BOOST_CHECK( !store.get_operation( bob, 67 ).valid() );
+   BOOST_CHECK( !store.get_operation( bob, 0 ).valid() );
+   store.close();
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( segment_roll_over )
+{ try {
+   fc::temp_directory dir( graphene::utilities::temp_directory_path() );
+   const account_id_type alice( 10 );
+   const uint64_t record_size = sizeof(uint32_t) + fc::raw::pack_size( make_operation( 1 ) );
+   {
+      // three records per segment
+      history_store store( 3 * record_size );
+      store.open( dir.path(), tracked_accounts, false );
+      for( uint64_t instance = 1; instance <= 10; ++instance )
+         archive( store, instance, { alice } );
+      store.close();
+   }
+
+   for( uint32_t segment = 0; segment < 4; ++segment )
+      BOOST_CHECK( fc::exists( dir.path() / ("operations." + fc::to_string( uint64_t(segment) )) ) );
+   BOOST_CHECK( !fc::exists( dir.path() / "operations.4" ) );
+
+   history_store store( 3 * record_size );
+   store.open( dir.path(), tracked_accounts, false );
+   for( uint32_t sequence = 1; sequence <= 10; ++sequence )
+   {
+      optional<operation_history_object> op = store.get_operation( alice, sequence );
+      BOOST_REQUIRE( op.valid() );
+      BOOST_CHECK( op->id == operation_history_id_type( sequence ) );
+      BOOST_CHECK_EQUAL( op->block_num, sequence );
+   }
+
+   // appending continues in the last segment
+   archive( store, 11, { alice } );
+   archive( store, 12, { alice } );
+   store.commit();
+   BOOST_CHECK( fc::exists( dir.path() / "operations.4" ) );
+   BOOST_CHECK( store.get_operation( alice, 12 ).valid() );
+   store.close();
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( torn_tail )
+{ try {
+   fc::temp_directory dir( graphene::utilities::temp_directory_path() );
+   const account_id_type alice( 10 );
+   {
+      history_store store;
+      store.open( dir.path(), tracked_accounts, false );
+      for( uint64_t instance = 1; instance <= 5; ++instance )
+         archive( store, instance, { alice } );
+      store.close();
+   }
+
+   // a crash in the middle of a write leaves partial records behind the committed sizes
+   append_garbage( dir.path() / "operations.0" );
+   append_garbage( dir.path() / "account_pages" );
+
+   history_store store;
+   store.open( dir.path(), tracked_accounts, false );
+   BOOST_CHECK( store.contains( operation_history_id_type( 5 ) ) );
+   BOOST_CHECK( !store.contains( operation_history_id_type( 6 ) ) );
+   BOOST_CHECK_EQUAL( store.last_sequence( alice ), 5u );
+
+   archive( store, 6, { alice } );
+   store.commit();
+   optional<operation_history_object> op = store.get_operation( alice, 6 );
+   BOOST_REQUIRE( op.valid() );
+   BOOST_CHECK( op->id == operation_history_id_type( 6 ) );
+   op = store.get_operation( alice, 5 );
+   BOOST_REQUIRE( op.valid() );
+   BOOST_CHECK( op->id == operation_history_id_type( 5 ) );
+   store.close();
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( rearchive_after_unclean_restart )
+{ try {
+   fc::temp_directory dir( graphene::utilities::temp_directory_path() );
+   const account_id_type alice( 10 ), bob( 11 );
+   {
+      history_store store;
+      store.open( dir.path(), tracked_accounts, false );
+      archive( store, 1, { alice } );
+      archive( store, 2, { alice, bob } );
+      store.commit();
+      // written but never committed, the node goes down without closing the store
+      archive( store, 3, { alice } );
+      archive( store, 4, { bob } );
+   }
+
+   history_store store;
+   store.open( dir.path(), tracked_accounts, false );
+   BOOST_CHECK( store.contains( operation_history_id_type( 2 ) ) );
+   BOOST_CHECK( !store.contains( operation_history_id_type( 3 ) ) );
+   BOOST_CHECK_EQUAL( store.last_sequence( alice ), 2u );
+   BOOST_CHECK_EQUAL( store.last_sequence( bob ), 1u );
+   BOOST_CHECK( !store.get_operation( alice, 3 ).valid() );
+
+   // the blocks are applied again after the restart and archive the same operations a second time
+   BOOST_CHECK_THROW( store.store_operation( make_operation( 2 ) ), fc::exception );
+   store.store_account_entry( alice, 2, operation_history_id_type( 2 ), 0 );
+   BOOST_CHECK_EQUAL( store.last_sequence( alice ), 2u );
+   archive( store, 3, { alice } );
+   archive( store, 4, { bob } );
+   store.commit();
+
+   BOOST_CHECK_EQUAL( store.last_sequence( alice ), 3u );
+   BOOST_CHECK_EQUAL( store.last_sequence( bob ), 2u );
+   optional<operation_history_object> op = store.get_operation( bob, 2 );
+   BOOST_REQUIRE( op.valid() );
+   BOOST_CHECK( op->id == operation_history_id_type( 4 ) );
+   BOOST_CHECK_EQUAL( store.find_sequence( bob, operation_history_id_type( 3 ) ), 1u );
+   store.close();
+
+   // a store built for other accounts is refused unless the chain is rebuilt
+   history_store other;
+   BOOST_CHECK_THROW( other.open( dir.path(), fc::sha256::hash( std::string( "some" ) ), false ), fc::exception );
+   other.open( dir.path(), fc::sha256::hash( std::string( "some" ) ), true );
+   BOOST_CHECK( !other.contains( operation_history_id_type( 1 ) ) );
+   other.close();
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_SUITE_END()
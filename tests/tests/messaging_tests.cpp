@@ -39,6 +39,7 @@
 #include <graphene/messaging/messaging.hpp> //added
 #include <graphene/utilities/key_conversion.hpp> //added
 #include <graphene/chain/message_object.hpp>
+#include <graphene/app/api.hpp>
 
 #include <graphene/db/simple_index.hpp>
 
@@ -115,23 +116,15 @@ BOOST_AUTO_TEST_CASE( messaging )
    const auto& idx = db.get_index_type<message_index>();
    const auto& aidx = dynamic_cast<const primary_index<message_index>&>(idx);
    const auto& refs = aidx.get_secondary_index<graphene::chain::message_receiver_index>();
-   auto itr = refs.message_to_receiver_memberships.find(bobian_id);
-
-   if (itr != refs.message_to_receiver_memberships.end())
-   {  
-      for (const object_id_type& item : itr->second) {
-               
-         auto msg_itr = db.get_index_type<message_index>().indices().get<by_id>().find(item);
-         if (msg_itr != db.get_index_type<message_index>().indices().get<by_id>().end()) {
-            message_object o = *msg_itr;
-            if ((*msg_itr).sender == nathan_id) {
-               msg_itr_found = msg_itr;
-               break;
-            }
-         }
-      }
+   auto range = refs.entries().get<by_receiver_sender>().equal_range(boost::make_tuple(bobian_id, nathan_id));
+
+   if (range.first != range.second)
+   {
+      BOOST_REQUIRE(std::distance(range.first, range.second) == 1);
+      msg_itr_found = db.get_index_type<message_index>().indices().get<by_id>().find(range.first->message);
    }
    BOOST_REQUIRE(msg_itr_found != db.get_index_type<message_index>().indices().get<by_id>().end());
+   BOOST_REQUIRE(refs.entries().get<by_receiver>().count(boost::make_tuple(alice_id)) == 1);
    std::string received_text_bobian;
    std::string received_text_alice;
    message_payload::get_message(bobian_private_key, nathan_public_key, (*msg_itr_found).receivers_data[0].data, received_text_bobian, (*msg_itr_found).receivers_data[0].nonce);
@@ -143,4 +136,112 @@ BOOST_AUTO_TEST_CASE( messaging )
 } FC_LOG_AND_RETHROW() }
 
 
+BOOST_AUTO_TEST_CASE( messaging_paging )
+{ try {
+
+   auto messaging_plug = app.register_plugin<decent::messaging::messaging_plugin>();
+   messaging_plug->plugin_set_app(&app);
+   boost::program_options::variables_map omap;
+   messaging_plug->plugin_initialize(omap);
+   messaging_plug->plugin_startup();
+
+   ACTOR(nathan);
+   ACTOR(bobian);
+   ACTOR(alice);
+
+   auto send = [&]( const account_object& from, const fc::ecc::private_key& from_key,
+                    const std::vector<const account_object*>& receivers ) -> object_id_type {
+      message_payload pl;
+      for( const account_object* to : receivers ) {
+         message_payload_receivers_data receivers_data_item;
+         receivers_data_item.to = to->id;
+         pl.set_message(from_key, to->options.memo_key, "paging", receivers_data_item);
+         pl.receivers_data.push_back(receivers_data_item);
+      }
+      pl.from = from.id;
+      pl.pub_from = from.options.memo_key;
+
+      custom_operation cust_op;
+      cust_op.id = graphene::chain::custom_operation_subtype_messaging;
+      cust_op.payer = from.id;
+      cust_op.set_messaging_payload(pl);
+
+      trx.clear();
+      trx.operations.push_back(cust_op);
+      trx.expiration = db.head_block_time() + db.get_global_properties().parameters.maximum_time_until_expiration;
+      trx.validate();
+      sign(trx, from_key);
+      PUSH_TX(db, trx);
+      return db.get_index_type<message_index>().indices().get<by_id>().rbegin()->id;
+   };
+
+   // expected results, oldest first
+   std::vector<object_id_type> to_bobian, from_nathan, nathan_to_bobian;
+   for( int i = 0; i < 7; ++i ) {
+      object_id_type id = send( nathan, nathan_private_key, { &alice, &bobian } );
+      to_bobian.push_back( id );
+      from_nathan.push_back( id );
+      nathan_to_bobian.push_back( id );
+      if( i % 2 == 0 ) {
+         id = send( alice, alice_private_key, { &bobian } );
+         to_bobian.push_back( id );
+      }
+      // several messages share the created time of their block, the rest differ in it
+      if( i % 3 == 2 )
+         generate_block();
+   }
+   from_nathan.push_back( send( nathan, nathan_private_key, { &alice } ) );
+
+   graphene::app::messaging_api mapi( app );
+
+   auto read_pages = [&]( optional<account_id_type> sender, optional<account_id_type> receiver, uint32_t page_size ) {
+      std::vector<object_id_type> ids;
+      optional<object_id_type> start;
+      while( true ) {
+         const vector<message_object> page = mapi.get_message_objects_before( sender, receiver, start, page_size );
+         BOOST_REQUIRE( page.size() <= page_size );
+         if( page.empty() )
+            break;
+         for( const message_object& m : page )
+            ids.push_back( m.id );
+         start = page.back().id;
+      }
+      // pages are newest first
+      std::reverse( ids.begin(), ids.end() );
+      return ids;
+   };
+
+   BOOST_CHECK( read_pages( optional<account_id_type>(), bobian_id, 3 ) == to_bobian );
+   BOOST_CHECK( read_pages( nathan_id, optional<account_id_type>(), 3 ) == from_nathan );
+   BOOST_CHECK( read_pages( nathan_id, bobian_id, 2 ) == nathan_to_bobian );
+   BOOST_CHECK( read_pages( nathan_id, bobian_id, 100 ) == nathan_to_bobian );
+   BOOST_CHECK( read_pages( bobian_id, optional<account_id_type>(), 3 ).empty() );
+
+   // newest first, and the start message itself is not repeated
+   vector<message_object> page = mapi.get_message_objects_before( optional<account_id_type>(), bobian_id, optional<object_id_type>(), 2 );
+   BOOST_REQUIRE_EQUAL( page.size(), 2u );
+   BOOST_CHECK( page[0].id == to_bobian[to_bobian.size() - 1] );
+   BOOST_CHECK( page[1].id == to_bobian[to_bobian.size() - 2] );
+   page = mapi.get_message_objects_before( optional<account_id_type>(), bobian_id, page[1].id, 1 );
+   BOOST_REQUIRE_EQUAL( page.size(), 1u );
+   BOOST_CHECK( page[0].id == to_bobian[to_bobian.size() - 3] );
+
+   // get_message_objects returns the newest messages in chronological order
+   vector<message_object> newest = mapi.get_message_objects( optional<account_id_type>(), bobian_id, 3 );
+   BOOST_REQUIRE_EQUAL( newest.size(), 3u );
+   for( size_t i = 0; i < newest.size(); ++i )
+      BOOST_CHECK( newest[i].id == to_bobian[to_bobian.size() - 3 + i] );
+   newest = mapi.get_message_objects( nathan_id, optional<account_id_type>(), 1000000 );
+   BOOST_REQUIRE_EQUAL( newest.size(), from_nathan.size() );
+   for( size_t i = 0; i < newest.size(); ++i )
+      BOOST_CHECK( newest[i].id == from_nathan[i] );
+
+   // the start cursor has to be an existing message
+   GRAPHENE_REQUIRE_THROW( mapi.get_message_objects_before( optional<account_id_type>(), bobian_id,
+                                                            object_id_type( message_object::space_id, message_object::type_id, 9999 ), 10 ),
+                           fc::exception );
+
+} FC_LOG_AND_RETHROW() }
+
+
 BOOST_AUTO_TEST_SUITE_END()